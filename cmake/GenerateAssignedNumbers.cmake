@@ -0,0 +1,76 @@
+# Generate a C++ X-macro include file from the Bluetooth SIG assigned numbers YAML files.
+#
+# Usage: cmake -DINPUT_DIR=<dir with *.yaml> -DOUTPUT=<file.inc> -P GenerateAssignedNumbers.cmake
+#
+# Each entry is emitted as:
+#   BLE_ASSIGNED_NUMBER(<Kind>, <value>, <Symbol>, "<Name>")
+# where Symbol is the CamelCase form of the last part of the SIG id, services suffixed with "Service".
+
+cmake_minimum_required(VERSION 3.13)
+
+if (NOT INPUT_DIR OR NOT OUTPUT)
+    message(FATAL_ERROR "INPUT_DIR and OUTPUT must be defined")
+endif()
+
+# Lookup tables are indexed directly by value, so all values must be inside this range.
+set(RANGE_FIRST 6144)  # 0x1800
+set(RANGE_LAST 11775)  # 0x2DFF
+
+set(SYMBOLS "")
+set(CONTENT "// Generated by cmake/GenerateAssignedNumbers.cmake, do not edit.\n")
+
+function(to_symbol ID KIND RESULT)
+    string(REGEX REPLACE "^.*\\." "" name "${ID}")
+    string(REGEX REPLACE "[-_]+" ";" parts "${name}")
+    set(symbol "")
+    foreach(part IN LISTS parts)
+        string(SUBSTRING "${part}" 0 1 first)
+        string(SUBSTRING "${part}" 1 -1 rest)
+        string(TOUPPER "${first}" first)
+        string(APPEND symbol "${first}${rest}")
+    endforeach()
+    if (KIND STREQUAL "Service" AND NOT symbol MATCHES "Service$")
+        string(APPEND symbol "Service")
+    endif()
+    set(${RESULT} "${symbol}" PARENT_SCOPE)
+endfunction()
+
+foreach(item "service_uuids.yaml;Service" "characteristic_uuids.yaml;Characteristic" "descriptors.yaml;Descriptor")
+    list(GET item 0 file_name)
+    list(GET item 1 kind)
+    file(STRINGS "${INPUT_DIR}/${file_name}" lines)
+    set(value "")
+    set(name "")
+    foreach(line IN LISTS lines)
+        if (line MATCHES "^ *- uuid: *(0x[0-9A-Fa-f]+)")
+            set(value "${CMAKE_MATCH_1}")
+            set(name "")
+        elseif (line MATCHES "^ *name: *(.*[^ ]) *$")
+            set(name "${CMAKE_MATCH_1}")
+        elseif (line MATCHES "^ *id: *org\\.bluetooth\\.[a-z]+\\.(.*[^ ]) *$")
+            set(id "${CMAKE_MATCH_1}")
+            if (value STREQUAL "" OR name STREQUAL "")
+                message(FATAL_ERROR "${file_name}: incomplete entry before id ${id}")
+            endif()
+            math(EXPR number "${value}")
+            if (number LESS RANGE_FIRST OR number GREATER RANGE_LAST)
+                message(FATAL_ERROR "${file_name}: ${value} is outside the supported range")
+            endif()
+            to_symbol("${id}" "${kind}" symbol)
+            if (symbol IN_LIST SYMBOLS)
+                message(FATAL_ERROR "${file_name}: duplicate symbol ${symbol}")
+            endif()
+            list(APPEND SYMBOLS "${symbol}")
+            string(REPLACE "\\" "\\\\" name "${name}")
+            string(REPLACE "\"" "\\\"" name "${name}")
+            string(APPEND CONTENT "BLE_ASSIGNED_NUMBER(${kind}, ${value}, ${symbol}, \"${name}\")\n")
+            set(value "")
+            set(name "")
+        endif()
+    endforeach()
+endforeach()
+
+# Only touch the output when content changes, to avoid needless rebuilds.
+file(WRITE "${OUTPUT}.tmp" "${CONTENT}")
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,91 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_BENCH_BENCHMARK_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_BENCH_BENCHMARK_H
+
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+#include <utils/DynamicData.h>
+
+namespace rsp::bench {
+
+/**
+ * \brief Keep the compiler from optimizing away a result that is never used.
+ */
+template <class T>
+inline void DoNotOptimize(const T &arValue)
+{
+    asm volatile("" : : "r,m"(arValue) : "memory");
+}
+
+/**
+ * \brief Stream buffer counting and discarding everything written to it.
+ */
+class NullBuffer : public std::streambuf
+{
+public:
+    [[nodiscard]] std::size_t GetCount() const { return mCount; }
+
+protected:
+    std::size_t mCount = 0;
+
+    int overflow(int aChar) override { mCount++; return aChar; }
+    std::streamsize xsputn(const char *, std::streamsize aSize) override { mCount += std::size_t(aSize); return aSize; }
+};
+
+/**
+ * \brief Small benchmark harness, timing a body over a given number of records.
+ *
+ * Every benchmark is a factory, called untimed with the record count to prepare its input.
+ * It returns the body to time, which is repeated until the minimum time has passed.
+ */
+class Benchmark
+{
+public:
+    using Body = std::function<void()>;
+    using Factory = std::function<Body(std::size_t aRecords)>;
+
+    struct Result {
+        std::string mName{};
+        std::size_t mRecords = 0;
+        std::size_t mIterations = 0;
+        std::chrono::nanoseconds mMean{};
+        std::chrono::nanoseconds mMin{};
+        std::chrono::nanoseconds mCpuMean{};    // Process CPU time, all threads
+    };
+
+    Benchmark& Add(std::string aName, Factory aFactory);
+
+    /**
+     * \brief Run all benchmarks containing the filter text, for every size.
+     * \param arProgress Stream for progress lines, while results are collected
+     */
+    [[nodiscard]] std::vector<Result> Run(const std::vector<std::size_t> &arSizes, const std::string &arFilter,
+                                          std::chrono::milliseconds aMinTime, std::ostream &arProgress) const;
+
+    /**
+     * \brief Results in the layout of Google Benchmark JSON output, for comparison tools.
+     *
+     * Each result is one run of type "iteration", with the record count and rates as user counters.
+     */
+    [[nodiscard]] static utils::DynamicData ToDynamicData(const std::vector<Result> &arResults);
+
+protected:
+    std::vector<std::pair<std::string, Factory>> mBenchmarks{};
+};
+
+} // rsp::bench
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_BENCH_BENCHMARK_H
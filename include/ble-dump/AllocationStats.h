@@ -0,0 +1,89 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_ALLOCATIONSTATS_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_ALLOCATIONSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rsp {
+
+/**
+ * \brief Heap allocation counts per session phase, and peak memory use.
+ *
+ * The library only does the accounting, the application replaces the global operator new
+ * and delete and reports to Allocated() and Freed(). Nothing is counted until enabled, and
+ * the heap size only covers blocks allocated since then.
+ *
+ * Allocations are attributed to the phase most recently entered by the allocating thread.
+ * Work done for a phase on another thread, e.g. decoding notifications on the Bluetooth
+ * callback thread, enters the phase there with the index from GetCurrentPhase().
+ */
+class AllocationStats
+{
+public:
+    static constexpr std::size_t cMaxPhases = 32;
+
+    struct Counts {
+        std::string mPhase{};
+        std::uint64_t mAllocations = 0;
+        std::uint64_t mFrees = 0;
+        std::uint64_t mBytes = 0;
+        // Peak resident set size of the process when the phase last ended
+        std::uint64_t mPeakRssKb = 0;
+    };
+
+    /**
+     * \brief Allocations within a phase, restoring the previous phase at the end of the scope.
+     */
+    class PhaseScope
+    {
+    public:
+        explicit PhaseScope(const std::string &arPhase);
+        /**
+         * \brief Continue a phase from another thread.
+         * \param aPhase Phase index returned by GetCurrentPhase() on that thread
+         */
+        explicit PhaseScope(int aPhase);
+        ~PhaseScope();
+
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+
+    protected:
+        int mPrevious;
+        int mPhase;
+    };
+
+    static void Enable(bool aEnable = true);
+    [[nodiscard]] static bool IsEnabled();
+    /**
+     * \brief Index of the phase the calling thread is in, 0 outside of any phase.
+     */
+    [[nodiscard]] static int GetCurrentPhase();
+
+    /**
+     * \brief Account for a heap block. Called from operator new and delete, so they never allocate or lock.
+     * \param aSize Usable size of the block
+     */
+    static void Allocated(std::size_t aSize) noexcept;
+    static void Freed(std::size_t aSize) noexcept;
+
+    [[nodiscard]] static std::vector<Counts> GetPhases();
+    [[nodiscard]] static Counts GetTotal();
+    [[nodiscard]] static std::uint64_t GetPeakHeapBytes();
+    [[nodiscard]] static std::uint64_t GetPeakRssKb();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_ALLOCATIONSTATS_H
@@ -0,0 +1,71 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_ASYNCGATT_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_ASYNCGATT_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <logging/LogChannel.h>
+#include <simpleble/SimpleBLE.h>
+#include "Coroutine.h"
+#include "TrustedDevice.h"
+#include "UUID.h"
+
+namespace rsp {
+
+/**
+ * \brief Awaitable GATT operations on a connected device.
+ *
+ * E.g.
+ *   Task<void> session(Executor &e, TrustedDevice &d) {
+ *       AsyncGatt gatt(e, d);
+ *       auto name = co_await gatt.Read(Identifiers::DeviceInformationService, Identifiers::ModelNumberString);
+ *       auto value = co_await gatt.Notification(Identifiers::GlucoseService, Identifiers::GlucoseMeasurement, 2000ms);
+ *   }
+ */
+class AsyncGatt : public logging::NamedLogger<AsyncGatt>
+{
+public:
+    AsyncGatt(Executor &arExecutor, TrustedDevice &arDevice);
+    ~AsyncGatt() override;
+
+    AsyncGatt(const AsyncGatt&) = delete;
+    AsyncGatt& operator=(const AsyncGatt&) = delete;
+
+    Task<SimpleBLE::ByteArray> Read(uuid::Identifiers aService, uuid::Identifiers aCharacteristic);
+    Task<void> Write(uuid::Identifiers aService, uuid::Identifiers aCharacteristic, SimpleBLE::ByteArray aValue, bool aWithResponse = true);
+
+    /**
+     * \brief Wait for the next notification or indication from the characteristic.
+     *        The characteristic is subscribed on first use, values arriving between calls are queued.
+     * \return The value, or std::nullopt on timeout
+     */
+    Task<std::optional<SimpleBLE::ByteArray>> Notification(uuid::Identifiers aService, uuid::Identifiers aCharacteristic, std::chrono::milliseconds aTimeout);
+
+    [[nodiscard]] Executor& GetExecutor() { return mExecutor; }
+
+protected:
+    using Key = std::pair<uuid::Identifiers, uuid::Identifiers>;
+
+    Executor &mExecutor;
+    TrustedDevice &mDevice;
+    std::mutex mMutex{};
+    std::map<Key, std::unique_ptr<AsyncQueue<SimpleBLE::ByteArray>>> mSubscriptions{};
+
+    Task<AsyncQueue<SimpleBLE::ByteArray>*> subscribe(uuid::Identifiers aService, uuid::Identifiers aCharacteristic);
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_ASYNCGATT_H
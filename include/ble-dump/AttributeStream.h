@@ -7,6 +7,7 @@
 
 #include <simpleble/SimpleBLE.h>
 #include <utils/DateTime.h>
+#include "EpochTime.h"
 
 namespace rsp {
 
@@ -33,6 +34,10 @@ public:
     float MedFloat16();
     float MedFloat32();
     rsp::utils::DateTime DateTime(bool aIncludeDayOfWeek = false, bool aIncludeFractions = false);
+    /**
+     * \brief Read a GATT Date Time without the conversions of utils::DateTime.
+     */
+    rsp::EpochTime EpochTime();
     std::string String();
 
     [[nodiscard]] const SimpleBLE::ByteArray& GetArray() const { return mByteArray; }
@@ -42,7 +47,7 @@ protected:
     SimpleBLE::ByteArray::iterator mIt;
 
     static float makeFloat(int aExponent, int aMantissa);
-    static void splitFloat(float aValue, int &arExponent, int &arMantissa);
+    static void splitFloat(float aValue, int aMinExponent, int aMaxExponent, int aMaxMantissa, int &arExponent, int &arMantissa);
 };
 
 std::ostream& operator<<(std::ostream &o, const AttributeStream &arBA);
@@ -10,8 +10,20 @@
 #ifndef BLUETOOTHGLUCOSE_BLE_DUMP_BLEAPPLICATION_H
 #define BLUETOOTHGLUCOSE_BLE_DUMP_BLEAPPLICATION_H
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <application/ApplicationBase.h>
 #include <simpleble/SimpleBLE.h>
+#include "DaemonServer.h"
+#include "GlucoseServiceProfile.h"
+#include "Scanner.h"
+#include "SessionArena.h"
+#include "ShmRing.h"
+#include "Trace.h"
+#include "SimulatedMeter.h"
 #include "TrustedDevice.h"
 
 namespace rsp {
@@ -35,6 +47,31 @@ protected:
     std::vector<SimpleBLE::Peripheral> mPeripherals;
     std::string mDeviceMAC{};
     std::string mEncoder{};
+    std::string mCacheDirectory{};
+    Scanner::DiscoveryFilter mScanFilter{};
+    std::optional<SimulatedMeter::Config> mSimulation{};
+    std::string mRecordFile{};
+    std::string mReplayFile{};
+    double mReplaySpeed = 1.0;
+    std::string mMetricsFile{};
+    std::string mTraceFile{};
+    bool mVerboseTrace = false;
+    bool mShowStats = false;
+    // Memory allowed for buffered records, 0 to keep all records of a dump in memory
+    std::size_t mMemoryCeiling = 0;
+    // Output for --sink=shm:<name>, replacing the output file
+    std::unique_ptr<ShmRingWriter> mRing{};
+    Trace::Timestamp mTraceDumped = Trace::Timestamp::min();
+    // Session state, shared by all commands executed in one run
+    SessionArena mArena{};
+    std::optional<SimpleBLE::Adapter> mAdapter{};
+    std::unique_ptr<TrustedDevice> mDevice{};
+    std::unique_ptr<GlucoseServiceProfile> mGlucoseService{};
+    // Daemon state, kept between requests
+    std::atomic_bool mStopServer = false;
+    std::map<std::string, SimpleBLE::Peripheral> mKnownPeripherals{};
+    std::map<std::string, std::unique_ptr<TrustedDevice>> mHeldDevices{};
+    std::vector<std::string> mKeepConnected{};
 
     void beforeExecute() override;
     void afterExecute() override;
@@ -43,19 +80,48 @@ protected:
     void handleOptions() override;
     void execute() override;
 
-    SimpleBLE::Adapter getAdapter();
-    TrustedDevice getDevice(SimpleBLE::Adapter &arAdapter);
+    using CommandHandler = void (BleApplication::*)();
+
+    std::vector<std::string> getCommandList();
+    /**
+     * \return The member running a command, nullptr for unknown commands
+     */
+    static CommandHandler findCommand(const std::string &arCommand);
+    bool executeCommand(const std::string &arCommand);
+    SimpleBLE::Adapter& getAdapter();
+    TrustedDevice& getDevice();
+    std::unique_ptr<TrustedDevice> connect(const std::string &arAddress);
+    std::unique_ptr<TrustedDevice> makeDevice(std::shared_ptr<GattPeripheral> aPeripheral, const std::string &arCacheDirectory);
+    [[nodiscard]] bool usesBluetooth() const { return !mSimulation && mReplayFile.empty(); }
+    GlucoseServiceProfile& getGlucoseService();
+    void closeSession();
     std::string getFileName(TrustedDevice &arDevice);
-    static void saveToCsv(std::ostream &o, const utils::DynamicData &arData);
-    static void saveToJson(std::ostream &o, const utils::DynamicData &arData);
+    void dumpRecords(GlucoseServiceProfile &arGls, const std::string &arFileName);
+    void publishRecords(GlucoseServiceProfile &arGls);
+    void streamRecords(GlucoseServiceProfile &arGls, const std::string &arFileName);
+    void writeRecords(const std::string &arFileName, std::span<const GlucoseServiceProfile::GlucoseMeasurement> aRecords);
+    void showAllocationStats();
+    void saveMetrics();
+    void saveTimeline();
+    std::string traceSinceLastDump();
+    static std::vector<std::string> splitList(const std::string &arList);
+    static std::vector<uuid::Identifiers> infoFields(const std::string &arList);
+    void handleRequest(const DaemonServer::Request &arRequest, DaemonServer::Responder &arResponder);
+    TrustedDevice& requestDevice(const std::string &arAddress, bool aKeep, std::unique_ptr<TrustedDevice> &arConnection);
 
     void devicesCommand();
     void dumpCommand();
+    void fleetDumpCommand();
     void clearCommand();
     void attributesCommand();
     void infoCommand();
     void timeCommand();
     void syncTimeCommand();
+    void serveCommand();
+    void replayCommand();
+    void linkStatsCommand();
+    void watchCommand();
+    void cgmStreamCommand();
 };
 
 } // rsp
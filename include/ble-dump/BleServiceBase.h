@@ -10,9 +10,13 @@
 #ifndef BLUETOOTHGLUCOSE_BLESERVICEBASE_H
 #define BLUETOOTHGLUCOSE_BLESERVICEBASE_H
 
+#include <atomic>
+#include <mutex>
 #include <logging/LogChannel.h>
+#include "AllocationStats.h"
 #include "UUID.h"
 #include <simpleble/SimpleBLE.h>
+#include "Reactor.h"
 #include "TrustedDevice.h"
 
 namespace rsp {
@@ -20,28 +24,60 @@ namespace rsp {
 class BleServiceBase
 {
 public:
-    explicit BleServiceBase(const TrustedDevice &arDevice, uuid::Identifiers aServiceUuid);
+    explicit BleServiceBase(TrustedDevice &arDevice, uuid::Identifiers aServiceUuid);
     virtual ~BleServiceBase() = default;
 
-    [[nodiscard]] SimpleBLE::Service& GetService() { return mService; }
+    [[nodiscard]] const std::string& GetServiceUuid() const { return mServiceUuid; }
 
     [[nodiscard]] uuid::Identifiers GetId() const { return mId; }
     [[nodiscard]] bool operator==(uuid::Identifiers aId) const { return mId == aId; }
 
 protected:
+    /**
+     * \brief Attribute allocations in the notification handlers to the phase of the calling
+     *        thread while in scope, the handlers run on the Bluetooth callback thread.
+     */
+    class CallbackPhaseScope
+    {
+    public:
+        explicit CallbackPhaseScope(BleServiceBase &arService)
+            : mrService(arService)
+        {
+            mrService.mCallbackPhase = AllocationStats::GetCurrentPhase();
+        }
+        ~CallbackPhaseScope() { mrService.mCallbackPhase = 0; }
+
+        CallbackPhaseScope(const CallbackPhaseScope&) = delete;
+        CallbackPhaseScope& operator=(const CallbackPhaseScope&) = delete;
+
+    protected:
+        BleServiceBase &mrService;
+    };
+
     uuid::Identifiers mId = uuid::Identifiers::None;
-    TrustedDevice mDevice;
-    SimpleBLE::Service mService;
+    TrustedDevice &mDevice;
+    const std::string &mServiceUuid;
+    std::mutex mWaitMutex{};
+    Reactor *mpWaitingReactor = nullptr;
+    // Entered by the notification handlers with AllocationStats::PhaseScope
+    std::atomic_int mCallbackPhase = 0;
 
-    SimpleBLE::Characteristic findCharacteristicByUuid(const std::string &arUUID);
-    static void delay(std::uint32_t aMilliseconds, const bool volatile *apAbort = nullptr);
+    [[nodiscard]] const std::string& characteristicUuid(uuid::Identifiers aId) const { return mDevice.GetCharacteristicUuid(mId, aId); }
+    [[nodiscard]] bool hasCharacteristic(uuid::Identifiers aId) const { return mDevice.HasCharacteristic(mId, aId); }
+    /**
+     * \brief Wait in the reactor of the calling thread, until the time has passed or *apDone is set.
+     *        Handlers setting *apDone call wake().
+     * \return True if *apDone was set
+     */
+    bool delay(std::uint32_t aMilliseconds, const std::atomic_bool *apDone = nullptr);
+    void wake();
 };
 
 template<class T>
 class BleService : public BleServiceBase, public rsp::logging::NamedLogger<T>
 {
 public:
-    explicit BleService(const TrustedDevice &arDevice, uuid::Identifiers aServiceUuid) : BleServiceBase(arDevice, aServiceUuid) {}
+    explicit BleService(TrustedDevice &arDevice, uuid::Identifiers aServiceUuid) : BleServiceBase(arDevice, aServiceUuid) {}
 };
 
 
@@ -0,0 +1,222 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_CGMSERVICEPROFILE_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_CGMSERVICEPROFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utils/DynamicData.h>
+#include "AttributeStream.h"
+#include "BleServiceBase.h"
+#include "EpochTime.h"
+
+namespace rsp {
+
+/**
+ * \brief Continuous Glucose Monitoring Service profile.
+ *
+ * A sensor notifies CGM Measurements every few minutes for the length of a session, each
+ * notification can hold several records. Records are timed in minutes since the session start,
+ * which is read from CGM Session Start Time when the profile is created. Stored records are
+ * requested over the Record Access Control Point, all or from a time offset on, and are
+ * delivered through the same callback as live records.
+ *
+ * If the sensor supports E2E-CRC, it is checked on all values read and added to all writes.
+ */
+class CgmServiceProfile : public BleService<CgmServiceProfile>
+{
+public:
+    enum Features : std::uint32_t {
+        CalibrationSupported                = 0x000001,
+        PatientHighLowAlertsSupported       = 0x000002,
+        HypoAlertsSupported                 = 0x000004,
+        HyperAlertsSupported                = 0x000008,
+        RateAlertsSupported                 = 0x000010,
+        DeviceSpecificAlertSupported        = 0x000020,
+        SensorMalfunctionDetectionSupported = 0x000040,
+        SensorTemperatureDetectionSupported = 0x000080,
+        SensorResultDetectionSupported      = 0x000100,
+        LowBatteryDetectionSupported        = 0x000200,
+        SensorTypeErrorDetectionSupported   = 0x000400,
+        GeneralDeviceFaultSupported         = 0x000800,
+        E2ECrcSupported                     = 0x001000,
+        MultipleBondSupported               = 0x002000,
+        MultipleSessionsSupported           = 0x004000,
+        TrendInformationSupported           = 0x008000,
+        QualitySupported                    = 0x010000
+    };
+
+    /**
+     * \brief Sensor Status Annunciation, the Status, Cal/Temp and Warning octets in that order from bit 0.
+     */
+    enum SensorStatus : std::uint32_t {
+        None = 0,
+        SessionStopped                 = 0x000001,
+        DeviceBatteryLow               = 0x000002,
+        SensorTypeIncorrect            = 0x000004,
+        SensorMalfunction              = 0x000008,
+        DeviceSpecificAlert            = 0x000010,
+        GeneralDeviceFault             = 0x000020,
+        TimeSynchronizationRequired    = 0x000100,
+        CalibrationNotAllowed          = 0x000200,
+        CalibrationRecommended         = 0x000400,
+        CalibrationRequired            = 0x000800,
+        SensorTemperatureTooHigh       = 0x001000,
+        SensorTemperatureTooLow        = 0x002000,
+        CalibrationPending             = 0x004000,
+        ResultBelowPatientLow          = 0x010000,
+        ResultAbovePatientHigh         = 0x020000,
+        ResultBelowHypo                = 0x040000,
+        ResultAboveHyper               = 0x080000,
+        RateOfDecreaseExceeded         = 0x100000,
+        RateOfIncreaseExceeded         = 0x200000,
+        ResultBelowDeviceRange         = 0x400000,
+        ResultAboveDeviceRange         = 0x800000
+    };
+
+    struct Measurement {
+        enum Flags : std::uint8_t {
+            TrendInformationPresent = 0x01,
+            QualityPresent          = 0x02,
+            WarningOctetPresent     = 0x20,
+            CalTempOctetPresent     = 0x40,
+            StatusOctetPresent      = 0x80
+        };
+        Flags mFlags = Flags(0);
+        float mGlucoseConcentration = 0.0f; // mg/dL
+        std::uint16_t mTimeOffset = 0;      // Minutes since the session start
+        SensorStatus mSensorStatus = SensorStatus::None;
+        float mTrend = 0.0f;                // mg/dL/min
+        float mQuality = 0.0f;              // %
+        EpochTime mCaptureTime{};           // Session start plus time offset
+
+        Measurement() = default;
+        /**
+         * \brief Decode one record of a CGM Measurement.
+         * \param arRecord Bytes of the record, starting with its size field
+         * \param aCheckCrc Verify the E2E-CRC ending the record
+         * \Reference Section 3.2.1 in Continuous Glucose Monitoring Service 1.0.2
+         */
+        Measurement(const SimpleBLE::ByteArray &arRecord, bool aCheckCrc);
+    };
+
+    struct SessionStartTime {
+        static constexpr std::int8_t cTimeZoneUnknown = -128;
+        static constexpr std::uint8_t cDstOffsetUnknown = 255;
+
+        EpochTime mLocalTime{};
+        std::int8_t mTimeZone = cTimeZoneUnknown;      // Quarter hours from UTC
+        std::uint8_t mDstOffset = cDstOffsetUnknown;   // Quarter hours of daylight saving
+
+        /**
+         * \brief Start time in UTC, or in the local time of the sensor if its time zone is not known.
+         */
+        [[nodiscard]] std::int64_t UtcSeconds() const;
+    };
+
+    using MeasurementCallback = std::function<void(const Measurement&)>;
+
+    explicit CgmServiceProfile(TrustedDevice &arDevice);
+    ~CgmServiceProfile() override;
+
+    [[nodiscard]] Features GetFeatures() const { return mFeatures; }
+    SessionStartTime GetSessionStartTime();
+    /**
+     * \return Expected run time of the session in hours
+     */
+    std::uint16_t GetSessionRunTime();
+    /**
+     * \return Minutes between measurement notifications, 0 if disabled
+     */
+    std::uint8_t GetCommunicationInterval();
+    CgmServiceProfile& SetCommunicationInterval(std::uint8_t aMinutes);
+    CgmServiceProfile& StartSession();
+    CgmServiceProfile& StopSession();
+
+    /**
+     * \param aFromTimeOffset Only count records from this time offset on
+     */
+    std::size_t GetMeasurementsCount(std::optional<std::uint16_t> aFromTimeOffset = {});
+    /**
+     * \brief Request stored records, they are delivered to the measurement callback as they arrive.
+     * \param aFromTimeOffset Only records from this time offset on, e.g. those missed while disconnected
+     * \return Number of records received
+     */
+    std::size_t ReadMeasurements(std::optional<std::uint16_t> aFromTimeOffset = {});
+
+    /**
+     * \brief Set the receiver of all records, stored and live. Called from the Bluetooth callback thread.
+     */
+    CgmServiceProfile& OnMeasurement(MeasurementCallback aCallback);
+
+    /**
+     * \brief Record Access Control Point values, op code and operator as written to the characteristic.
+     */
+    static constexpr std::uint16_t cRacpReportRecords = 0x0101;
+    static constexpr std::uint16_t cRacpReportRecordsFrom = 0x0301;
+    static constexpr std::uint16_t cRacpReportNumberOfRecords = 0x0104;
+    static constexpr std::uint16_t cRacpReportNumberOfRecordsFrom = 0x0304;
+    static constexpr std::uint8_t cRacpFilterTimeOffset = 0x01;
+    static constexpr std::uint8_t cRacpNumberOfRecordsResponse = 0x05;
+    static constexpr std::uint8_t cRacpResponseCode = 0x06;
+    static constexpr std::uint8_t cRacpSuccess = 0x01;
+    static constexpr std::uint8_t cRacpNoRecordsFound = 0x06;
+
+    /**
+     * \brief CGM Specific Ops Control Point op codes.
+     */
+    static constexpr std::uint8_t cOpsSetCommunicationInterval = 0x01;
+    static constexpr std::uint8_t cOpsGetCommunicationInterval = 0x02;
+    static constexpr std::uint8_t cOpsCommunicationIntervalResponse = 0x03;
+    static constexpr std::uint8_t cOpsStartSession = 0x1A;
+    static constexpr std::uint8_t cOpsStopSession = 0x1B;
+    static constexpr std::uint8_t cOpsResponseCode = 0x1C;
+    static constexpr std::uint8_t cOpsSuccess = 0x01;
+
+    /**
+     * \brief E2E-CRC, the CRC-CCITT with seed 0xFFFF over the bytes least significant bit first.
+     */
+    static std::uint16_t Crc(const char *apData, std::size_t aSize);
+
+protected:
+    const std::string &mMeasurementUuid;
+    const std::string &mFeatureUuid;
+    const std::string &mSessionStartTimeUuid;
+    const std::string &mSessionRunTimeUuid;
+    const std::string &mRACP;
+    const std::string &mOpsControlPoint;
+    Features mFeatures = Features(0);
+    std::mutex mMutex{};
+    MeasurementCallback mCallback{};
+    std::int64_t mSessionStart = EpochTime::cUnknown;
+    std::atomic_bool mCommandDone = false;
+    std::atomic<std::uint64_t> mReceived = 0;
+    std::uint16_t mRecordCount = 0;
+    std::uint8_t mOpsResult = 0;
+    std::uint8_t mInterval = 0;
+
+    [[nodiscard]] bool hasCrc() const { return mFeatures & Features::E2ECrcSupported; }
+    AttributeStream read(const std::string &arCharacteristic, std::size_t aSize);
+    void racpCommand(std::uint16_t aCommand, std::optional<std::uint16_t> aFromTimeOffset, int aTimeoutMs);
+    void opsCommand(std::uint8_t aOpCode, std::optional<std::uint8_t> aOperand);
+    void measurementHandler(const SimpleBLE::ByteArray &arValue);
+    void racpHandler(AttributeStream aStream);
+    void opsHandler(AttributeStream aStream);
+};
+
+utils::DynamicData& operator<<(utils::DynamicData &o, const CgmServiceProfile::Measurement &arMeasurement);
+std::ostream& operator<<(std::ostream &o, const CgmServiceProfile::SessionStartTime &arStart);
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_CGMSERVICEPROFILE_H
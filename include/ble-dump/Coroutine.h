@@ -0,0 +1,468 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_COROUTINE_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_COROUTINE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <logging/LogChannel.h>
+
+namespace rsp {
+
+template <class T> class Task;
+
+namespace detail {
+
+template <class T>
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> mContinuation{};
+    std::exception_ptr mException{};
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> aHandle) noexcept {
+            auto next = aHandle.promise().mContinuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { mException = std::current_exception(); }
+};
+
+template <class T>
+struct TaskPromise : TaskPromiseBase<T>
+{
+    std::optional<T> mValue{};
+
+    Task<T> get_return_object() noexcept;
+    template <class U>
+    void return_value(U &&aValue) { mValue.emplace(std::forward<U>(aValue)); }
+    T Result() {
+        if (this->mException) {
+            std::rethrow_exception(this->mException);
+        }
+        return std::move(*mValue);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void>
+{
+    Task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+    void Result() {
+        if (mException) {
+            std::rethrow_exception(mException);
+        }
+    }
+};
+
+/**
+ * \brief Fire and forget coroutine, owns its own frame.
+ */
+struct Detached
+{
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+/**
+ * \brief Lazily started coroutine returning T, started when awaited.
+ */
+template <class T = void>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> aHandle) : mHandle(aHandle) {}
+    Task(Task &&arOther) noexcept : mHandle(std::exchange(arOther.mHandle, {})) {}
+    Task& operator=(Task &&arOther) noexcept {
+        if (this != &arOther) {
+            destroy();
+            mHandle = std::exchange(arOther.mHandle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { destroy(); }
+
+    bool await_ready() const noexcept { return !mHandle || mHandle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> aContinuation) noexcept {
+        mHandle.promise().mContinuation = aContinuation;
+        return mHandle;
+    }
+    T await_resume() { return mHandle.promise().Result(); }
+
+protected:
+    std::coroutine_handle<promise_type> mHandle{};
+
+    void destroy() {
+        if (mHandle) {
+            mHandle.destroy();
+            mHandle = {};
+        }
+    }
+};
+
+namespace detail {
+template <class T>
+Task<T> TaskPromise<T>::get_return_object() noexcept { return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this)); }
+inline Task<void> TaskPromise<void>::get_return_object() noexcept { return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this)); }
+} // namespace detail
+
+/**
+ * \brief Small executor resuming coroutines on a fixed set of threads.
+ *
+ * Blocking calls, like the synchronous D-Bus calls behind SimpleBLE, are run on a separate
+ * pool with Offload(), so they never hold up the threads running coroutines.
+ */
+class Executor : public logging::NamedLogger<Executor>
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Executor(std::size_t aThreads = 1, std::size_t aBlockingThreads = 2);
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void Post(std::function<void()> aWork);
+    void Post(std::coroutine_handle<> aHandle) { Post([aHandle]() { aHandle.resume(); }); }
+    void PostAt(Clock::time_point aDeadline, std::function<void()> aWork);
+    void PostBlocking(std::function<void()> aWork);
+
+    /**
+     * \brief co_await Schedule() continues the coroutine on an executor thread.
+     */
+    auto Schedule() {
+        struct Awaiter {
+            Executor &mExecutor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> aHandle) { mExecutor.Post(aHandle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    /**
+     * \brief co_await Sleep(ms) continues the coroutine after the given time, without holding a thread.
+     */
+    auto Sleep(std::chrono::milliseconds aDuration) {
+        struct Awaiter {
+            Executor &mExecutor;
+            Clock::time_point mDeadline;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> aHandle) { mExecutor.PostAt(mDeadline, [aHandle]() { aHandle.resume(); }); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, Clock::now() + aDuration};
+    }
+
+    /**
+     * \brief Run a blocking function on the blocking pool, and continue with its result on an executor thread.
+     */
+    template <class F, class R = std::invoke_result_t<F>>
+    Task<R> Offload(F aFunction) {
+        struct Awaiter {
+            Executor &mExecutor;
+            std::function<void()> mWork;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> aHandle) {
+                mExecutor.PostBlocking([this, aHandle]() {
+                    mWork();
+                    mExecutor.Post(aHandle);
+                });
+            }
+            void await_resume() const noexcept {}
+        };
+        // Awaiters are named locals, GCC destroys some temporary awaiters twice.
+        std::exception_ptr error;
+        if constexpr (std::is_void_v<R>) {
+            Awaiter awaiter{*this, [&]() {
+                try { aFunction(); } catch (...) { error = std::current_exception(); }
+            }};
+            co_await awaiter;
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        else {
+            std::optional<R> result;
+            Awaiter awaiter{*this, [&]() {
+                try { result.emplace(aFunction()); } catch (...) { error = std::current_exception(); }
+            }};
+            co_await awaiter;
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            co_return std::move(*result);
+        }
+    }
+
+    /**
+     * \brief Start a task on the executor without waiting for it. Exceptions are logged.
+     */
+    void Spawn(Task<void> aTask) { spawn(*this, std::move(aTask)); }
+
+    /**
+     * \brief Run a task on the executor and block the calling thread until it completes.
+     *        Must not be called from an executor thread.
+     */
+    template <class T>
+    T SyncWait(Task<T> aTask) {
+        std::promise<T> promise;
+        auto future = promise.get_future();
+        syncWait(*this, std::move(aTask), promise);
+        return future.get();
+    }
+
+protected:
+    struct Timer {
+        Clock::time_point mDeadline;
+        std::uint64_t mSequence;
+        std::function<void()> mWork;
+        bool operator>(const Timer &arOther) const {
+            return (mDeadline != arOther.mDeadline) ? (mDeadline > arOther.mDeadline) : (mSequence > arOther.mSequence);
+        }
+    };
+
+    std::mutex mMutex{};
+    std::condition_variable mCondition{};
+    std::deque<std::function<void()>> mReady{};
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> mTimers{};
+    std::uint64_t mTimerSequence = 0;
+
+    std::mutex mBlockingMutex{};
+    std::condition_variable mBlockingCondition{};
+    std::deque<std::function<void()>> mBlocking{};
+
+    bool mStop = false;
+    std::vector<std::thread> mThreads{};
+
+    void run();
+    void runBlocking();
+
+    static detail::Detached spawn(Executor &arExecutor, Task<void> aTask);
+
+    template <class T>
+    static detail::Detached syncWait(Executor &arExecutor, Task<T> aTask, std::promise<T> &arPromise) {
+        co_await arExecutor.Schedule();
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await aTask;
+                arPromise.set_value();
+            }
+            else {
+                arPromise.set_value(co_await aTask);
+            }
+        }
+        catch (...) {
+            arPromise.set_exception(std::current_exception());
+        }
+    }
+};
+
+namespace detail {
+
+/**
+ * \brief State of one suspended coroutine waiting for a value or a timeout, whichever comes first.
+ */
+template <class T>
+struct TimedWaiter
+{
+    std::atomic_bool mResumed = false;
+    std::coroutine_handle<> mHandle{};
+    std::optional<T> mValue{};
+
+    bool Claim() { return !mResumed.exchange(true); }
+};
+
+} // namespace detail
+
+/**
+ * \brief Queue of values delivered from callback threads to one awaiting coroutine.
+ */
+template <class T>
+class AsyncQueue
+{
+public:
+    void Push(T aValue) {
+        std::shared_ptr<detail::TimedWaiter<T>> waiter;
+        Executor *executor;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            waiter = std::exchange(mWaiter, {});
+            if (!waiter || !waiter->Claim()) {
+                mItems.push_back(std::move(aValue));
+                return;
+            }
+            executor = mpExecutor;
+        }
+        waiter->mValue.emplace(std::move(aValue));
+        executor->Post(waiter->mHandle);
+    }
+
+    /**
+     * \brief co_await Pop(executor, timeout) returns the next value, or std::nullopt on timeout.
+     */
+    auto Pop(Executor &arExecutor, std::chrono::milliseconds aTimeout) {
+        struct Awaiter {
+            AsyncQueue &mQueue;
+            Executor &mExecutor;
+            std::chrono::milliseconds mTimeout;
+            std::optional<T> mValue{};
+            std::shared_ptr<detail::TimedWaiter<T>> mWaiter{};
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> aHandle) {
+                auto deadline = Executor::Clock::now() + mTimeout;
+                auto &executor = mExecutor;
+                auto waiter = std::make_shared<detail::TimedWaiter<T>>();
+                waiter->mHandle = aHandle;
+                {
+                    std::lock_guard<std::mutex> lock(mQueue.mMutex);
+                    if (!mQueue.mItems.empty()) {
+                        mValue.emplace(std::move(mQueue.mItems.front()));
+                        mQueue.mItems.pop_front();
+                        return false;
+                    }
+                    mWaiter = waiter;
+                    mQueue.mWaiter = waiter;
+                    mQueue.mpExecutor = &executor;
+                }
+                // A Push() may resume the coroutine from here on, which destroys this awaiter.
+                executor.PostAt(deadline, [waiter]() {
+                    if (waiter->Claim()) {
+                        waiter->mHandle.resume();
+                    }
+                });
+                return true;
+            }
+            std::optional<T> await_resume() { return mWaiter ? std::move(mWaiter->mValue) : std::move(mValue); }
+        };
+        return Awaiter{*this, arExecutor, aTimeout};
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mItems.clear();
+    }
+
+protected:
+    std::mutex mMutex{};
+    std::deque<T> mItems{};
+    std::shared_ptr<detail::TimedWaiter<T>> mWaiter{};
+    Executor *mpExecutor = nullptr;
+};
+
+/**
+ * \brief Manual reset event that coroutines can await with a timeout.
+ */
+class AsyncEvent
+{
+public:
+    void Set() {
+        std::vector<std::pair<std::shared_ptr<detail::TimedWaiter<bool>>, Executor*>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mSet = true;
+            waiters.swap(mWaiters);
+        }
+        for (auto &[waiter, executor] : waiters) {
+            if (waiter->Claim()) {
+                waiter->mValue = true;
+                executor->Post(waiter->mHandle);
+            }
+        }
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSet = false;
+    }
+
+    /**
+     * \brief co_await Wait(executor, timeout) returns true if the event was set, false on timeout.
+     */
+    auto Wait(Executor &arExecutor, std::chrono::milliseconds aTimeout) {
+        struct Awaiter {
+            AsyncEvent &mEvent;
+            Executor &mExecutor;
+            std::chrono::milliseconds mTimeout;
+            std::shared_ptr<detail::TimedWaiter<bool>> mWaiter{};
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> aHandle) {
+                auto deadline = Executor::Clock::now() + mTimeout;
+                auto &executor = mExecutor;
+                auto waiter = std::make_shared<detail::TimedWaiter<bool>>();
+                waiter->mHandle = aHandle;
+                {
+                    std::lock_guard<std::mutex> lock(mEvent.mMutex);
+                    if (mEvent.mSet) {
+                        return false;
+                    }
+                    mWaiter = waiter;
+                    // Drop waiters that already timed out
+                    std::erase_if(mEvent.mWaiters, [](auto &arEntry) { return arEntry.first->mResumed.load(); });
+                    mEvent.mWaiters.emplace_back(waiter, &executor);
+                }
+                // A Set() may resume the coroutine from here on, which destroys this awaiter.
+                executor.PostAt(deadline, [waiter]() {
+                    if (waiter->Claim()) {
+                        waiter->mHandle.resume();
+                    }
+                });
+                return true;
+            }
+            bool await_resume() const { return !mWaiter || mWaiter->mValue.value_or(false); }
+        };
+        return Awaiter{*this, arExecutor, aTimeout};
+    }
+
+protected:
+    std::mutex mMutex{};
+    bool mSet = false;
+    std::vector<std::pair<std::shared_ptr<detail::TimedWaiter<bool>>, Executor*>> mWaiters{};
+};
+
+} // namespace rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_COROUTINE_H
@@ -28,7 +28,7 @@ public:
         Reserved = 16
     };
 
-    explicit CurrentTimeServiceProfile(const TrustedDevice &arDevice);
+    explicit CurrentTimeServiceProfile(TrustedDevice &arDevice);
 
     utils::DateTime GetTime();
     CurrentTimeServiceProfile& SetTime(const utils::DateTime &arDT);
@@ -36,7 +36,8 @@ public:
     [[nodiscard]] AdjustReason GetReason() const { return mAdjustReason; }
 
 protected:
-    std::string mRootUuid{};
+    const std::string &mCurrentTime;
+    const std::string mClientConfiguration;
     AdjustReason mAdjustReason = AdjustReason::None;
 };
 std::ostream& operator<<(std::ostream &o, CurrentTimeServiceProfile &arService);
@@ -0,0 +1,86 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_DAEMONSERVER_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_DAEMONSERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <logging/LogChannel.h>
+#include <utils/DynamicData.h>
+
+namespace rsp {
+
+/**
+ * \brief UNIX domain socket server speaking newline delimited JSON (NDJSON).
+ *
+ * Each request is a flat JSON object on one line, e.g.
+ *   {"id":"1","cmd":"dump","device":"CC:78:AB:A3:F4:34"}
+ * The handler streams any number of response objects back, each written as one line.
+ * Requests are handled one at a time, since they share the Bluetooth adapter,
+ * but any number of clients can be connected.
+ */
+class DaemonServer : public logging::NamedLogger<DaemonServer>
+{
+public:
+    using Request = utils::DynamicData;
+
+    /**
+     * \brief Writes responses directly to the client socket, nothing is buffered beyond the socket send buffer.
+     *
+     * A client not reading its responses makes Send() fail after a timeout, and all later
+     * calls fail immediately, so a stalled client is disconnected instead of stalling the server.
+     */
+    class Responder
+    {
+    public:
+        explicit Responder(int aFd) : mFd(aFd) {}
+        void Send(const utils::DynamicData &arResponse);
+
+    protected:
+        int mFd;
+        bool mFailed = false;
+    };
+
+    using Handler = std::function<void(const Request &arRequest, Responder &arResponder)>;
+
+    explicit DaemonServer(std::string aSocketPath);
+    ~DaemonServer() override;
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+    /**
+     * \brief Accept clients and dispatch requests until arStop is set.
+     */
+    void Run(const Handler &arHandler, const std::atomic_bool &arStop);
+
+    /**
+     * \brief Decode a request line, which must be a JSON object.
+     * \throws std::invalid_argument on malformed input
+     */
+    static Request ParseRequest(std::string_view aLine);
+
+protected:
+    std::string mSocketPath;
+    int mListenFd = -1;
+    std::mutex mHandlerMutex{};
+    std::mutex mClientsMutex{};
+    std::condition_variable mClientsDone{};
+    int mClients = 0;
+
+    void serveClient(int aFd, const Handler &arHandler, const std::atomic_bool &arStop);
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_DAEMONSERVER_H
@@ -0,0 +1,52 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_DEVICECACHE_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_DEVICECACHE_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <logging/LogChannel.h>
+
+namespace rsp {
+
+/**
+ * \brief Small on-disk cache of static per-device data, stored as one text file per key.
+ *
+ * Keys are typically built from device address and firmware revision, so data is
+ * invalidated automatically when the device firmware changes.
+ */
+class DeviceCache : public logging::NamedLogger<DeviceCache>
+{
+public:
+    /**
+     * \param aDirectory Cache directory, an empty string disables the cache.
+     */
+    explicit DeviceCache(std::string aDirectory);
+
+    /**
+     * \brief Get the default cache directory, $XDG_CACHE_HOME/ble-dump or ~/.cache/ble-dump
+     */
+    static std::string DefaultDirectory();
+
+    static std::string MakeKey(const std::string &arAddress, const std::string &arRevision, const std::string &arName);
+
+    [[nodiscard]] bool IsEnabled() const { return !mDirectory.empty(); }
+
+    bool Load(const std::string &arKey, std::vector<std::string> &arLines);
+    void Save(const std::string &arKey, const std::vector<std::string> &arLines);
+
+protected:
+    std::filesystem::path mDirectory;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_DEVICECACHE_H
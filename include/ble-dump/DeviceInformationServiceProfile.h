@@ -13,7 +13,10 @@
 
 #include "AttributeStream.h"
 #include "BleServiceBase.h"
+#include <map>
+#include <optional>
 #include <ostream>
+#include <vector>
 
 namespace rsp {
 
@@ -36,22 +39,59 @@ public:
         explicit PnPID(AttributeStream aStream);
     };
 
-    explicit DeviceInformationServiceProfile(const TrustedDevice &arDevice);
+    /**
+     * \brief Characteristics of the Device Information Service, in presentation order.
+     */
+    static constexpr uuid::Identifiers cAllFields[] = {
+        uuid::Identifiers::SystemId,
+        uuid::Identifiers::ModelNumberString,
+        uuid::Identifiers::SerialNumberString,
+        uuid::Identifiers::FirmwareRevisionString,
+        uuid::Identifiers::SoftwareRevisionString,
+        uuid::Identifiers::ManufacturerNameString,
+        uuid::Identifiers::Ieee1107320601RegulatoryCertificationDataList,
+        uuid::Identifiers::PnpId
+    };
+
+    /**
+     * \brief Values are read lazily when first requested, and cached on disk per device and firmware revision.
+     *        Nothing is read from the device until then, the firmware revision is read with the first value.
+     */
+    explicit DeviceInformationServiceProfile(TrustedDevice &arDevice);
+    ~DeviceInformationServiceProfile() override;
+
+    /**
+     * \brief Read the given characteristics concurrently, instead of one round trip at a time.
+     * \param arFields Characteristics to read, values already known are skipped.
+     */
+    DeviceInformationServiceProfile& Prefetch(const std::vector<uuid::Identifiers> &arFields);
+    DeviceInformationServiceProfile& Prefetch() { return Prefetch({std::begin(cAllFields), std::end(cAllFields)}); }
+
+    // All characteristics are optional in the service, so missing values are returned as std::nullopt.
+    std::optional<uint64_t> GetSystemId();
+    std::optional<std::string> GetModelNumber() { return getString(uuid::Identifiers::ModelNumberString); }
+    std::optional<std::string> GetSerialNumber() { return getString(uuid::Identifiers::SerialNumberString); }
+    std::optional<std::string> GetFirmwareRevision() { return getString(uuid::Identifiers::FirmwareRevisionString); }
+    std::optional<std::string> GetSoftwareRevision() { return getString(uuid::Identifiers::SoftwareRevisionString); }
+    std::optional<std::string> GetManufacturerName() { return getString(uuid::Identifiers::ManufacturerNameString); }
+    std::optional<AttributeStream> GetRegulatoryCertDataList();
+    std::optional<PnPID> GetPnPID();
 
 protected:
     friend std::ostream& operator<<(std::ostream &o, const DeviceInformationServiceProfile &arDeviceInformation);
 
-    std::string mRootUuid{};
-    uint64_t mSystemId{};
-    std::string mModelNumber{};
-    std::string mSerialNumber{};
-    std::string mFirmwareRevision{};
-    std::string mSoftwareRevision{};
-    std::string mManufacturerName{};
-    AttributeStream mRegulatoryCertDataList;
-    PnPID mPnPID{};
-
-    AttributeStream read(uuid::Identifiers aIdentifier);
+    using Value = std::optional<SimpleBLE::ByteArray>; // std::nullopt if not present on the device
+
+    std::map<uuid::Identifiers, Value> mValues{};
+    std::string mCacheKey{};
+    bool mCacheLoaded = false;
+    bool mCacheDirty = false;
+
+    const Value& value(uuid::Identifiers aIdentifier);
+    std::optional<std::string> getString(uuid::Identifiers aIdentifier);
+    Value read(uuid::Identifiers aIdentifier);
+    void loadCache();
+    void saveCache();
 };
 std::ostream& operator<<(std::ostream &o, const DeviceInformationServiceProfile &arDeviceInformation);
 std::ostream& operator<<(std::ostream &o, const DeviceInformationServiceProfile::PnPID &arPnpID);
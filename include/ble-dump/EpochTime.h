@@ -0,0 +1,91 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_EPOCHTIME_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_EPOCHTIME_H
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+
+namespace rsp {
+
+/**
+ * \brief Time of a record as sent by a device: the base time from a GATT Date Time, in seconds
+ *        since 1970-01-01 in the time of the device, and the time offset in minutes sent with it.
+ *
+ * GATT Date Time fields of 0 mean not known, such times are kept as cUnknown. The user facing
+ * time is the base time plus the offset.
+ */
+struct EpochTime {
+    static constexpr std::int64_t cUnknown = std::numeric_limits<std::int64_t>::min();
+
+    std::int64_t mSeconds = cUnknown;
+    std::int16_t mOffsetMinutes = 0;
+
+    /**
+     * \brief From the fields of a GATT Date Time.
+     * \throws std::invalid_argument if a field is out of range, e.g. February 30th or hour 24
+     */
+    static constexpr EpochTime FromDateTime(unsigned aYear, unsigned aMonth, unsigned aDay, unsigned aHour, unsigned aMinute, unsigned aSecond)
+    {
+        using namespace std::chrono;
+        if (aYear == 0 || aMonth == 0 || aDay == 0) {
+            return {};
+        }
+        if (aYear > 9999 || aMonth > 12 || aDay > 31 || aHour > 23 || aMinute > 59 || aSecond > 59) {
+            throw std::invalid_argument("Invalid Date Time");
+        }
+        year_month_day ymd{year(int(aYear)), month(aMonth), day(aDay)};
+        if (!ymd.ok()) {
+            throw std::invalid_argument("Invalid Date Time");
+        }
+        auto days = sys_days(ymd).time_since_epoch().count();
+        return {std::int64_t(days) * 86400 + aHour * 3600 + aMinute * 60 + aSecond, 0};
+    }
+
+    [[nodiscard]] constexpr bool IsKnown() const { return mSeconds != cUnknown; }
+    /**
+     * \brief Base time with the time offset applied, in seconds since 1970-01-01.
+     */
+    [[nodiscard]] constexpr std::int64_t UserFacing() const { return IsKnown() ? mSeconds + std::int64_t(mOffsetMinutes) * 60 : cUnknown; }
+    [[nodiscard]] std::chrono::system_clock::time_point ToTimePoint() const
+    {
+        return std::chrono::system_clock::time_point(std::chrono::seconds(UserFacing()));
+    }
+};
+
+/**
+ * \brief ISO 8601 formatting of epoch seconds, as "2024-01-31T08:00:00.000Z", into an internal buffer.
+ *
+ * Records come in time order, so the date part is only converted when the day changes.
+ * Nothing is allocated.
+ */
+class Iso8601Formatter
+{
+public:
+    static constexpr std::size_t cLength = 24;
+
+    /**
+     * \brief Format a time.
+     * \return View of the internal buffer, valid until the next call. Empty for unknown times.
+     */
+    std::string_view Format(std::int64_t aSeconds);
+    std::string_view Format(const EpochTime &arTime) { return Format(arTime.UserFacing()); }
+
+protected:
+    char mBuffer[cLength + 1] = "0000-00-00T00:00:00.000Z";
+    std::int64_t mDay = EpochTime::cUnknown;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_EPOCHTIME_H
@@ -0,0 +1,95 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_FLEETSCHEDULER_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_FLEETSCHEDULER_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <logging/LogChannel.h>
+#include <simpleble/SimpleBLE.h>
+#include "Scanner.h"
+
+namespace rsp {
+
+/**
+ * \brief Distribute work on many devices over several Bluetooth adapters.
+ *
+ * All adapters scan concurrently. Each device found is assigned to the adapter that saw it
+ * with the best signal, penalized by the number of devices already assigned to that adapter.
+ * Every adapter then gets its own worker thread, running at most the configured number of
+ * concurrent connections.
+ */
+class FleetScheduler : public logging::NamedLogger<FleetScheduler>
+{
+public:
+    using Job = std::function<void(SimpleBLE::Peripheral &arPeripheral)>;
+
+    struct Result {
+        std::string mIdentifier{};
+        std::string mAddress{};
+        std::string mAdapter{};
+        bool mSuccess = false;
+        std::string mError{};
+        std::chrono::milliseconds mDuration{};
+    };
+
+    /**
+     * \param aAdapters Adapters to use, each is owned by one worker.
+     * \param aMaxConnections Maximum number of concurrent connections per adapter.
+     */
+    FleetScheduler(std::vector<SimpleBLE::Adapter> aAdapters, std::size_t aMaxConnections);
+
+    FleetScheduler& SetAcceptFilter(Scanner::FilterList aFilter) { mAcceptFilter = std::move(aFilter); return *this; }
+    FleetScheduler& SetDiscoveryFilter(Scanner::DiscoveryFilter aFilter) { mDiscoveryFilter = std::move(aFilter); return *this; }
+
+    /**
+     * \brief Scan on all adapters, then run the job once for every device found.
+     * \param aScanMilliseconds Scan duration
+     * \param arJob Job executed on a worker thread, exceptions are recorded in the result.
+     * \return Result for each device
+     */
+    std::vector<Result> Run(std::uint32_t aScanMilliseconds, const Job &arJob);
+
+protected:
+    // RSSI penalty per device already assigned, so a slightly weaker but idle adapter wins.
+    static constexpr int cLoadPenaltyDbm = 6;
+
+    struct Sighting {
+        SimpleBLE::Peripheral mPeripheral;
+        std::string mAddress{};
+        std::size_t mAdapterIndex = 0;
+        int16_t mRssi = 0;
+    };
+
+    struct Worker {
+        SimpleBLE::Adapter mAdapter;
+        std::deque<SimpleBLE::Peripheral> mQueue{};
+    };
+
+    std::vector<Worker> mWorkers{};
+    std::size_t mMaxConnections;
+    Scanner::FilterList mAcceptFilter{};
+    Scanner::DiscoveryFilter mDiscoveryFilter{};
+    std::mutex mMutex{};
+    std::vector<Result> mResults{};
+
+    std::vector<Sighting> scan(std::uint32_t aScanMilliseconds);
+    void assign(const std::vector<Sighting> &arSightings);
+    void runWorker(Worker &arWorker, const Job &arJob);
+    void runJob(Worker &arWorker, SimpleBLE::Peripheral &arPeripheral, const Job &arJob);
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_FLEETSCHEDULER_H
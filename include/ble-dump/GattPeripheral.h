@@ -0,0 +1,107 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_GATTPERIPHERAL_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_GATTPERIPHERAL_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <simpleble/SimpleBLE.h>
+
+namespace rsp {
+
+/**
+ * \brief Transport used by TrustedDevice and the profiles to reach a GATT server.
+ *
+ * UUIDs are full 128-bit strings, as used by SimpleBLE.
+ */
+class GattPeripheral
+{
+public:
+    using ByteArray = SimpleBLE::ByteArray;
+    using Callback = std::function<void(ByteArray aValue)>;
+
+    struct Service {
+        std::string mUuid{};
+        std::vector<std::string> mCharacteristics{};
+    };
+
+    virtual ~GattPeripheral() = default;
+
+    virtual std::string Identifier() = 0;
+    virtual std::string Address() = 0;
+    virtual std::int16_t Rssi() = 0;
+
+    virtual void Connect() = 0;
+    virtual void Disconnect() = 0;
+    virtual bool IsConnected() = 0;
+
+    virtual std::vector<Service> Services() = 0;
+    virtual ByteArray Read(const std::string &arService, const std::string &arCharacteristic) = 0;
+    virtual void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) = 0;
+    virtual void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) = 0;
+    virtual void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) = 0;
+    virtual void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) = 0;
+    virtual void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) = 0;
+
+    /**
+     * \brief Print the attribute table.
+     */
+    virtual void Print(std::ostream &o) = 0;
+};
+
+/**
+ * \brief GattPeripheral on a SimpleBLE peripheral, i.e. a real device.
+ */
+class SimpleBlePeripheral : public GattPeripheral
+{
+public:
+    explicit SimpleBlePeripheral(SimpleBLE::Peripheral aPeripheral) : mPeripheral(std::move(aPeripheral)) {}
+
+    std::string Identifier() override { return mPeripheral.identifier(); }
+    std::string Address() override { return mPeripheral.address(); }
+    std::int16_t Rssi() override { return mPeripheral.rssi(); }
+
+    void Connect() override { mPeripheral.connect(); }
+    void Disconnect() override { mPeripheral.disconnect(); }
+    bool IsConnected() override { return mPeripheral.is_connected() && mPeripheral.initialized(); }
+
+    std::vector<Service> Services() override;
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override {
+        return mPeripheral.read(arService, arCharacteristic);
+    }
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override {
+        mPeripheral.write_request(arService, arCharacteristic, arValue);
+    }
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override {
+        mPeripheral.write_command(arService, arCharacteristic, arValue);
+    }
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) override {
+        mPeripheral.write(arService, arCharacteristic, arDescriptor, arValue);
+    }
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override {
+        mPeripheral.notify(arService, arCharacteristic, std::move(aCallback));
+    }
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override {
+        mPeripheral.unsubscribe(arService, arCharacteristic);
+    }
+    void Print(std::ostream &o) override;
+
+    SimpleBLE::Peripheral& GetUnderlying() { return mPeripheral; }
+
+protected:
+    SimpleBLE::Peripheral mPeripheral;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_GATTPERIPHERAL_H
@@ -10,13 +10,22 @@
 #ifndef GLUCOSE_SERVICE_PROFILE_H
 #define GLUCOSE_SERVICE_PROFILE_H
 
+#include <chrono>
+#include <functional>
 #include <utils/DateTime.h>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <utils/DynamicData.h>
 #include "UUID.h"
 #include "BleServiceBase.h"
 #include "AttributeStream.h"
+#include "Coroutine.h"
+#include "LinkStats.h"
+#include "Metrics.h"
 
 namespace rsp {
 
@@ -156,11 +165,12 @@ struct GlucoseMeasurementContext {
             TimeOffsetPresent           = 0x01,
             GlucoseConcentrationPresent = 0x02,
             GlucoseInMMol               = 0x04,
-            SensorStatusPresent         = 0x08
+            SensorStatusPresent         = 0x08,
+            ContextInformationFollows   = 0x10
         };
         Flags mFlags = Flags(0);
         uint16_t mSequenceNo = 0;
-        rsp::utils::DateTime mCaptureTime{};
+        EpochTime mCaptureTime{};
         GlucoseUnits mUnit = GlucoseUnits::mg_dL;
         float mGlucoseConcentration = 0.0;
         Type mType = Type::Reserved;
@@ -177,24 +187,141 @@ struct GlucoseMeasurementContext {
         explicit GlucoseMeasurement(AttributeStream &s);
     };
 
-    explicit GlucoseServiceProfile(const TrustedDevice &arDevice);
+    using Measurements = std::pmr::vector<GlucoseMeasurement>;
+    /**
+     * \brief Receives records that no longer fit in the buffer, in the order they were received.
+     */
+    using RecordSink = std::function<void(std::span<const GlucoseMeasurement>)>;
+    /**
+     * \brief Records passed on together, shared by all subscribers and never changed. A subscriber
+     *        keeps records beyond its call by keeping their batch, rather than copying them.
+     */
+    using RecordBatch = std::shared_ptr<const std::vector<GlucoseMeasurement>>;
+    /**
+     * \brief Receives each record, arRecord is an element of *arBatch.
+     */
+    using Subscriber = std::function<void(const GlucoseMeasurement &arRecord, const RecordBatch &arBatch)>;
+    using SubscriptionId = std::uint32_t;
+
+    /**
+     * \param arDevice Connected device
+     * \param apResource Memory for the buffered records, e.g. a SessionArena
+     */
+    explicit GlucoseServiceProfile(TrustedDevice &arDevice, std::pmr::memory_resource *apResource = std::pmr::get_default_resource());
     ~GlucoseServiceProfile() override;
 
     size_t GetMeasurementsCount();
-    const std::vector<GlucoseMeasurement>& ReadAllMeasurements();
+    const Measurements& ReadAllMeasurements();
+    /**
+     * \brief Read the records with a sequence number from aSequenceNo on, e.g. those taken since the last transfer.
+     */
+    const Measurements& ReadMeasurementsFrom(std::uint16_t aSequenceNo);
+    /**
+     * \brief Read the most recent record only, none if the meter has no records.
+     */
+    const Measurements& ReadLastMeasurement();
     GlucoseServiceProfile& ClearAllMeasurements();
 
-    [[nodiscard]] const std::vector<GlucoseMeasurement>& GetMeasurements() const { return mMeasurements; }
+    /**
+     * \brief Keep at most aMaxRecords records in memory, passing older ones to the sink as
+     *        they arrive, and the rest when a transfer completes. The records returned by
+     *        ReadAllMeasurements() are then only those not yet passed to the sink, i.e. none.
+     *        The sink is called from the Bluetooth callback thread during a transfer.
+     * \param aMaxRecords Records to buffer, at least 1, since a record can be followed by its context
+     * \param aSink Sink, or empty to buffer all records again
+     */
+    GlucoseServiceProfile& SetRecordSink(std::size_t aMaxRecords, RecordSink aSink);
+
+    /**
+     * \brief Add a consumer of all records, stored and live. Records are no longer buffered
+     *        once there is a consumer, i.e. ReadAllMeasurements() returns none.
+     *        Subscribers are called on the Bluetooth callback thread, in the order they subscribed.
+     *        A subscriber or sink may itself call Subscribe() or SetRecordSink().
+     * \return Id for Unsubscribe()
+     */
+    SubscriptionId Subscribe(Subscriber aSubscriber);
+    /**
+     * \brief Remove a consumer, not from within a subscriber. It is not called again once this returns.
+     */
+    GlucoseServiceProfile& Unsubscribe(SubscriptionId aId);
+    /**
+     * \brief Pass records on in batches of at most aMaxRecords as they arrive. A batch is passed
+     *        on as soon as its newest record is complete, i.e. no context follows or it has arrived.
+     *        Records left from an earlier transfer are dropped, unless aMaxRecords is 0.
+     * \param aMaxRecords Records per batch, 0 for one batch when a transfer completes
+     */
+    GlucoseServiceProfile& SetBatchSize(std::size_t aMaxRecords);
+
+    [[nodiscard]] const Measurements& GetMeasurements() const { return mMeasurements; }
+    /**
+     * \brief Timing of the notifications of all record transfers made by this profile.
+     */
+    [[nodiscard]] const LinkStats& GetLinkStats() const { return mLinkStats; }
+
+    // Awaitable versions, RACP completion is awaited without holding a thread. Metrics are
+    // recorded with the labels of the thread that constructed the profile.
+    Task<std::size_t> GetMeasurementsCountAsync(Executor &arExecutor);
+    Task<std::vector<GlucoseMeasurement>> ReadAllMeasurementsAsync(Executor &arExecutor);
+    Task<void> ClearAllMeasurementsAsync(Executor &arExecutor);
+
+    /*
+     * Record Access Control Point values, as read and written with AttributeStream::Uint16(),
+     * i.e. op code in the low byte and operator in the high byte.
+     */
+    static constexpr std::uint16_t cRacpReportAllRecords = 0x0101;
+    static constexpr std::uint16_t cRacpReportRecordsFrom = 0x0301;
+    static constexpr std::uint16_t cRacpReportLastRecord = 0x0601;
+    static constexpr std::uint16_t cRacpDeleteAllRecords = 0x0102;
+    static constexpr std::uint16_t cRacpAbort = 0x0003;
+    static constexpr std::uint16_t cRacpReportNumberOfRecords = 0x0104;
+    static constexpr std::uint16_t cRacpNumberOfRecordsResponse = 0x0005;
+    static constexpr std::uint16_t cRacpResponseCode = 0x0006;
+    static constexpr std::uint8_t cRacpFilterSequenceNumber = 0x01;
+    static constexpr std::uint8_t cRacpSuccess = 0x01;
+    static constexpr std::uint8_t cRacpNoRecordsFound = 0x06;
 
 protected:
-    std::string mRACP{};
-    std::string mGlucoseMeasurement{};
-    std::string mGlucoseMeasurementContext{};
-    std::vector<GlucoseMeasurement> mMeasurements{};
+    const std::string &mRACP;
+    const std::string &mGlucoseMeasurement;
+    const std::string &mGlucoseMeasurementContext;
+    struct Consumers {
+        RecordSink mRecordSink{};
+        std::vector<std::pair<SubscriptionId, Subscriber>> mSubscribers{};
+    };
+    // The buffered records and the consumers, guarded by mConsumerMutex since notifications
+    // arrive on the Bluetooth callback thread while the application configures the profile.
+    // Consumers are replaced rather than changed, so a batch is passed on to a snapshot of them
+    // without holding mConsumerMutex.
+    Measurements mMeasurements;
+    std::mutex mConsumerMutex{};
+    std::shared_ptr<const Consumers> mpConsumers = std::make_shared<const Consumers>();
+    // Held while passing on a batch, so batches arrive one at a time and in order
+    std::mutex mDeliverMutex{};
+    // The batch passed to a sink when there are no subscribers, guarded by mDeliverMutex
+    Measurements mDelivery;
+    SubscriptionId mNextSubscriptionId = 1;
+    std::atomic<std::size_t> mMaxRecords = 0;
+    std::size_t mRecordsSpilled = 0;
     std::uint16_t mRecordCount = 0;
-    bool mCommandDone = false;
+    std::atomic_bool mCommandDone = false;
+    AsyncEvent mRacpDone{};
+    Metrics::Labels mLabels;
+    // Counted by the notification handlers, added to Metrics when a transfer completes
+    std::atomic<std::uint64_t> mNotificationBytes = 0;
+    std::atomic<std::uint64_t> mContextsReceived = 0;
+    LinkStats mLinkStats{};
 
-    void sendCommand(std::uint16_t aCommand, int aTimeoutMs);
+    void sendCommand(std::uint16_t aCommand, int aTimeoutMs, std::optional<std::uint16_t> aFromSequenceNo = {});
+    const Measurements& readMeasurements(std::uint16_t aCommand, std::optional<std::uint16_t> aFromSequenceNo = {});
+    /**
+     * \brief Write command to the Record Access Control Point and await the response.
+     * \return False on timeout
+     */
+    Task<bool> racp(Executor &arExecutor, std::uint16_t aCommand, std::chrono::milliseconds aTimeout);
+    void countReceived();
+    void setBatchSize(std::size_t aMaxRecords);
+    void clearMeasurements();
+    void spillRecords(std::size_t aKeep);
     void racpHandler(AttributeStream aStream);
     void measurementHandler(AttributeStream aStream);
     void measurementContextHandler(AttributeStream aStream);
@@ -202,7 +329,7 @@ protected:
 
 utils::DynamicData& operator<<(utils::DynamicData &o, const GlucoseServiceProfile::GlucoseMeasurement &arGM);
 utils::DynamicData& operator<<(utils::DynamicData &o, const GlucoseServiceProfile::GlucoseMeasurementContext &arGMC);
-utils::DynamicData& operator<<(utils::DynamicData &o, const std::vector<GlucoseServiceProfile::GlucoseMeasurement> &arList);
+utils::DynamicData& operator<<(utils::DynamicData &o, std::span<const GlucoseServiceProfile::GlucoseMeasurement> aList);
 
 } // namespace rsp
 
@@ -0,0 +1,63 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_HISTOGRAM_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_HISTOGRAM_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace rsp {
+
+/**
+ * \brief Histogram of integer values with a fixed relative precision, in the style of HdrHistogram.
+ *
+ * Values below 64 are counted exactly. Above that, every power of two is split into 32 buckets,
+ * so a reported value is never more than about 3% above the recorded one, over the full 64 bit range.
+ */
+class Histogram
+{
+public:
+    void Record(std::uint64_t aValue, std::uint64_t aCount = 1);
+    void Merge(const Histogram &arOther);
+    void Clear();
+
+    [[nodiscard]] std::uint64_t GetCount() const { return mCount; }
+    [[nodiscard]] std::uint64_t GetMin() const { return mCount ? mMin : 0; }
+    [[nodiscard]] std::uint64_t GetMax() const { return mMax; }
+    [[nodiscard]] double GetMean() const { return mCount ? double(mSum) / double(mCount) : 0.0; }
+    /**
+     * \brief Highest value equivalent to the one at the percentile.
+     * \param aPercentile 0 to 100
+     */
+    [[nodiscard]] std::uint64_t ValueAtPercentile(double aPercentile) const;
+
+protected:
+    static constexpr unsigned cSubBucketBits = 5;
+    static constexpr std::uint64_t cSubBuckets = 1u << cSubBucketBits;
+
+    std::vector<std::uint64_t> mBuckets{};
+    std::uint64_t mCount = 0;
+    std::uint64_t mSum = 0;
+    std::uint64_t mMin = 0;
+    std::uint64_t mMax = 0;
+
+    static std::size_t indexOf(std::uint64_t aValue);
+    static std::uint64_t highestValueAt(std::size_t aIndex);
+};
+
+/**
+ * \brief One line summary: count, min, mean, p50, p90, p99 and max.
+ */
+std::ostream& operator<<(std::ostream &o, const Histogram &arHistogram);
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_HISTOGRAM_H
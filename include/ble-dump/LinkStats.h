@@ -0,0 +1,66 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_LINKSTATS_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_LINKSTATS_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include "Histogram.h"
+
+namespace rsp {
+
+/**
+ * \brief Timing of the notifications answering Record Access Control Point commands.
+ *
+ * Latencies are in microseconds. Notification rates are counted in whole seconds of a transfer,
+ * per characteristic, and the count of each second is recorded.
+ */
+class LinkStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void CommandSent(Clock::time_point aTime = Clock::now());
+    void CommandCompleted(Clock::time_point aTime = Clock::now());
+    void Notification(const std::string &arCharacteristic, Clock::time_point aTime = Clock::now());
+    void Clear();
+
+    [[nodiscard]] Histogram GetInterArrival() const;
+    [[nodiscard]] Histogram GetFirstNotificationLatency() const;
+    [[nodiscard]] Histogram GetCompletionLatency() const;
+    [[nodiscard]] std::map<std::string, Histogram> GetNotificationRates() const;
+
+    friend std::ostream& operator<<(std::ostream &o, const LinkStats &arStats);
+
+protected:
+    struct RateWindow {
+        std::optional<Clock::time_point> mStart{};
+        std::uint64_t mCount = 0;
+        Histogram mRate{};
+    };
+
+    mutable std::mutex mMutex{};
+    std::optional<Clock::time_point> mCommandTime{};
+    std::optional<Clock::time_point> mLastNotification{};
+    Histogram mInterArrival{};
+    Histogram mFirstNotification{};
+    Histogram mCompletion{};
+    std::map<std::string, RateWindow> mRates{};
+
+    static std::uint64_t microseconds(Clock::duration aDuration);
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_LINKSTATS_H
@@ -0,0 +1,150 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_METRICS_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <utils/DynamicData.h>
+#include "AllocationStats.h"
+
+namespace rsp {
+
+/**
+ * \brief Process wide registry of session phase timings and counters.
+ *
+ * Every value is stored with the labels of the calling thread, e.g. adapter and device, so
+ * concurrent sessions of a fleet dump are kept apart. Phases are timed with the Timer returned
+ * by Time(), which records when it goes out of scope. While a timer runs, heap allocations
+ * are attributed to its phase in AllocationStats.
+ */
+class Metrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Labels = std::map<std::string, std::string>;
+
+    class Timer
+    {
+    public:
+        Timer(Metrics &arMetrics, std::string aPhase);
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        /**
+         * \brief Record the phase now instead of on destruction.
+         */
+        void Stop();
+
+    protected:
+        Metrics *mpMetrics;
+        std::string mPhase;
+        Clock::time_point mStart;
+        std::optional<AllocationStats::PhaseScope> mAllocations{};
+    };
+
+    /**
+     * \brief Add labels to the calling thread for the lifetime of the scope.
+     */
+    class LabelScope
+    {
+    public:
+        explicit LabelScope(const Labels &arLabels);
+        ~LabelScope();
+
+        LabelScope(const LabelScope&) = delete;
+        LabelScope& operator=(const LabelScope&) = delete;
+
+    protected:
+        Labels mPrevious;
+    };
+
+    static Metrics& Get();
+
+    /**
+     * \brief Set a label on all values later recorded by the calling thread.
+     */
+    static void SetLabel(const std::string &arName, const std::string &arValue);
+    /**
+     * \brief Labels of the calling thread, to record with a LabelScope on another thread.
+     */
+    [[nodiscard]] static Labels GetLabels();
+
+    [[nodiscard]] Timer Time(std::string aPhase) { return {*this, std::move(aPhase)}; }
+    void AddTime(const std::string &arPhase, Clock::duration aDuration);
+    void Count(const std::string &arName, std::uint64_t aValue = 1);
+    /**
+     * \brief Value of a counter summed over all labels.
+     */
+    [[nodiscard]] std::uint64_t GetCount(const std::string &arName) const;
+    void Clear();
+
+    [[nodiscard]] utils::DynamicData ToDynamicData() const;
+    /**
+     * \brief Prometheus text exposition format, metric names prefixed with "ble_dump_".
+     */
+    void WritePrometheus(std::ostream &o) const;
+    /**
+     * \brief Save as Prometheus text if the file name ends with .prom or .txt, otherwise as JSON.
+     *        The file is replaced atomically, so a collector never reads a partial file.
+     */
+    void Save(const std::string &arFileName) const;
+
+protected:
+    struct Phase {
+        std::uint64_t mCount = 0;
+        Clock::duration mTotal{};
+        Clock::duration mMax{};
+    };
+    using Key = std::pair<std::string, Labels>;
+
+    mutable std::mutex mMutex{};
+    std::map<Key, Phase> mPhases{};
+    std::map<Key, std::uint64_t> mCounters{};
+};
+
+/**
+ * \brief Buffered stream buffer writing through to another, adding the time spent in
+ *        the writes to a Metrics phase. Used to tell file I/O apart from encoding.
+ */
+class TimedStreamBuffer : public std::streambuf
+{
+public:
+    TimedStreamBuffer(std::streambuf &arTarget, std::string aPhase);
+    ~TimedStreamBuffer() override;
+
+    [[nodiscard]] Metrics::Clock::duration GetElapsed() const { return mElapsed; }
+    [[nodiscard]] std::uint64_t GetCount() const { return mCount; }
+
+protected:
+    std::streambuf &mrTarget;
+    std::string mPhase;
+    std::array<char, 65536> mBuffer{};
+    Metrics::Clock::duration mElapsed{};
+    std::uint64_t mCount = 0;
+
+    int overflow(int aChar) override;
+    int sync() override;
+    bool flush();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_METRICS_H
@@ -0,0 +1,91 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_REACTOR_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_REACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <logging/LogChannel.h>
+
+namespace rsp {
+
+/**
+ * \brief Event loop on epoll, with a timerfd for deadlines and an eventfd for wake-ups from other threads.
+ *
+ * SIGTERM is read from a signalfd by a dedicated thread, which wakes all reactors.
+ * Each thread has its own reactor, see Current(). Threads waiting for something another thread
+ * delivers, like a notification from the Bluetooth stack, wait in WaitUntil() and are woken with Wake().
+ */
+class Reactor : public logging::NamedLogger<Reactor>
+{
+public:
+    using Handler = std::function<void(std::uint32_t aEvents)>;
+
+    /**
+     * \brief Reactor of the calling thread, created on first use.
+     */
+    static Reactor& Current();
+
+    /**
+     * \brief Handle SIGTERM on a dedicated thread instead of as an asynchronous signal.
+     *        Must be called before other threads are started, so they inherit the blocked signal.
+     * \param aCallback Called once, from the signal thread, before the reactors are woken
+     */
+    static void HandleTermination(std::function<void()> aCallback);
+    static void RestoreTermination();
+    [[nodiscard]] static bool IsTerminated();
+
+    Reactor();
+    ~Reactor() override;
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /**
+     * \brief Dispatch events on the file descriptor to the handler, while this thread is waiting.
+     * \param aEvents epoll event mask, e.g. EPOLLIN
+     */
+    void Add(int aFd, std::uint32_t aEvents, Handler aHandler);
+    void Remove(int aFd);
+
+    /**
+     * \brief Dispatch events until arDone returns true, the timeout expires or the application terminates.
+     * \param aTimeout Maximum time to wait, std::nullopt to wait without timeout
+     * \param arDone Checked after each dispatch
+     * \return Result of arDone
+     */
+    bool WaitUntil(std::optional<std::chrono::milliseconds> aTimeout, const std::function<bool()> &arDone);
+
+    /**
+     * \brief Make WaitUntil check its condition. Safe to call from any thread.
+     */
+    void Wake();
+
+    [[nodiscard]] std::uint64_t GetWakeups() const { return mWakeups; }
+
+protected:
+    int mEpollFd = -1;
+    int mEventFd = -1;
+    int mTimerFd = -1;
+    std::map<int, Handler> mHandlers{};
+    std::atomic_uint64_t mWakeups = 0;
+
+    void setTimer(std::optional<std::chrono::steady_clock::time_point> aDeadline);
+    void watch(int aFd, std::uint32_t aEvents);
+    static void signalThread();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_REACTOR_H
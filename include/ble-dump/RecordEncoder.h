@@ -0,0 +1,82 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_RECORDENCODER_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_RECORDENCODER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utils/DynamicData.h>
+
+namespace rsp {
+
+/**
+ * \brief Output formats of dumped records.
+ */
+class RecordEncoder
+{
+public:
+    /**
+     * \brief Save with the named encoder.
+     * \param arEncoder "csv" or "json"
+     */
+    static void Save(std::ostream &o, const utils::DynamicData &arData, const std::string &arEncoder);
+
+    static void SaveToCsv(std::ostream &o, const utils::DynamicData &arData);
+    static void SaveToJson(std::ostream &o, const utils::DynamicData &arData);
+
+protected:
+    friend class RecordWriter;
+    static void saveToCsv(std::ostream &o, const utils::DynamicData &arData, bool aHeader);
+};
+
+/**
+ * \brief Writes records in batches, so only one batch needs to be in memory.
+ *
+ * The records and values are the same as from RecordEncoder::Save() of all records at once, and
+ * CSV only has the header line once. JSON is written as one array with each record encoded on
+ * its own, so the indentation is not byte identical to an array encoded in one go.
+ */
+class RecordWriter
+{
+public:
+    /**
+     * \param o Output stream, must outlive the writer
+     * \param aEncoder "csv" or "json"
+     */
+    RecordWriter(std::ostream &o, std::string aEncoder);
+
+    /**
+     * \brief Add a record to the current batch.
+     */
+    RecordWriter& Add(const utils::DynamicData &arRecord);
+    /**
+     * \brief Encode the current batch to the stream.
+     */
+    void Flush();
+    /**
+     * \brief Flush and close the document.
+     */
+    void Finish();
+
+    [[nodiscard]] std::uint64_t GetCount() const { return mCount; }
+
+protected:
+    std::ostream &mrOut;
+    std::string mEncoder;
+    utils::DynamicData mBatch{};
+    std::size_t mBatchSize = 0;
+    std::uint64_t mCount = 0;
+    bool mFinished = false;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_RECORDENCODER_H
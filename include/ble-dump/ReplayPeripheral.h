@@ -0,0 +1,88 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_REPLAYPERIPHERAL_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_REPLAYPERIPHERAL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <logging/LogChannel.h>
+#include "GattPeripheral.h"
+#include "SessionRecording.h"
+
+namespace rsp {
+
+/**
+ * \brief GattPeripheral playing back a session recorded with RecordingPeripheral.
+ *
+ * Every write is matched with the next recorded write to the same characteristic, and the
+ * notifications that followed it in the recording are then delivered from a worker thread.
+ * Reads return the next recorded value of the characteristic.
+ */
+class ReplayPeripheral : public GattPeripheral, public logging::NamedLogger<ReplayPeripheral>
+{
+public:
+    /**
+     * \param arFileName Session recording
+     * \param aSpeed Replay speed relative to the recording, 0 replays as fast as possible
+     */
+    explicit ReplayPeripheral(const std::string &arFileName, double aSpeed = 1.0);
+    ~ReplayPeripheral() override;
+
+    std::string Identifier() override { return mIdentifier; }
+    std::string Address() override { return mAddress; }
+    std::int16_t Rssi() override { return mRssi; }
+
+    void Connect() override { mConnected = true; }
+    void Disconnect() override;
+    bool IsConnected() override { return mConnected; }
+
+    std::vector<Service> Services() override;
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override;
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) override;
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override;
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override;
+    void Print(std::ostream &o) override;
+
+    [[nodiscard]] std::size_t GetEventCount() const { return mEvents.size(); }
+    [[nodiscard]] std::size_t GetNotificationsReplayed() const { return mNotificationsReplayed; }
+    [[nodiscard]] std::size_t GetBytesReplayed() const { return mBytesReplayed; }
+
+protected:
+    std::string mIdentifier{};
+    std::string mAddress{};
+    std::int16_t mRssi = 0;
+    double mSpeed;
+    std::vector<SessionEvent> mEvents{};
+    std::size_t mPosition = 0;  // Next event to match, guarded by mMutex
+    std::atomic_bool mConnected = false;
+    std::atomic_bool mAbort = false;
+    std::atomic_size_t mNotificationsReplayed = 0;
+    std::atomic_size_t mBytesReplayed = 0;
+    std::mutex mMutex{};
+    std::condition_variable mAbortCondition{};
+    std::map<std::string, Callback> mSubscriptions{};   // By characteristic UUID
+    std::thread mWorker{};
+    std::mutex mDeliverMutex{};
+
+    void write(const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue);
+    void replay(std::size_t aFirst, std::size_t aEnd);
+    void stopWorker();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_REPLAYPERIPHERAL_H
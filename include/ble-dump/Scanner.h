@@ -11,6 +11,9 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <atomic>
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 #include <logging/LogChannel.h>
@@ -23,9 +26,34 @@ class Scanner : public logging::NamedLogger<Scanner>
 public:
     using FilterList = std::vector<std::string>;
 
+    /**
+     * \brief Discovery filter applied by the Bluetooth stack, before advertisements reach the callbacks.
+     */
+    struct DiscoveryFilter {
+        enum class Transport {
+            Auto,
+            BrEdr,
+            LE
+        };
+        Transport mTransport = Transport::Auto;
+        std::optional<std::int16_t> mMinRssi{};
+        std::vector<std::string> mServiceUuids{}; // Full 128-bit UUID strings
+        // Report every advertisement, or only changed ones. The stack default if not set.
+        std::optional<bool> mDuplicateData{};
+
+        DiscoveryFilter() = default;
+        /**
+         * \brief Construct filter from a comma separated option string.
+         * \param arOptions E.g. "le,rssi:-80,uuid:1808,no-duplicates"
+         */
+        explicit DiscoveryFilter(const std::string &arOptions);
+    };
+
     explicit Scanner(const SimpleBLE::Adapter &arAdapter, FilterList aAddressList = {});
     explicit Scanner(const SimpleBLE::Adapter &arAdapter, const std::string &arAddress);
 
+    Scanner& SetDiscoveryFilter(DiscoveryFilter aFilter) { mDiscoveryFilter = std::move(aFilter); return *this; }
+
     const std::vector<SimpleBLE::Peripheral>& RunFor(std::uint32_t aMilliseconds);
     bool RunUntilFound(std::uint32_t aTimeoutMilliseconds);
 
@@ -34,11 +62,15 @@ public:
 protected:
     SimpleBLE::Adapter mAdapter;
     FilterList mAcceptFilter{};
+    DiscoveryFilter mDiscoveryFilter{};
     std::vector<SimpleBLE::Peripheral> mScanResult{};
-    bool mFoundDevice = false;
+    std::atomic_bool mFoundDevice = false;
 
     void execute(std::uint32_t aMilliseconds, bool aStopWhenFound);
     [[nodiscard]] bool addressAccepted(SimpleBLE::Peripheral &arPeripheral) const;
+    [[nodiscard]] bool rssiAccepted(SimpleBLE::Peripheral &arPeripheral) const;
+    void applyDiscoveryFilter();
+    void clearCallbacks();
 };
 
 } // rsp
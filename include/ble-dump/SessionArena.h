@@ -0,0 +1,54 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONARENA_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+namespace rsp {
+
+/**
+ * \brief Memory resource for the objects of one device session, e.g. the buffered records.
+ *
+ * Blocks are pooled by size, so a buffer that is filled and emptied over and over reuses
+ * its memory, and everything is returned to the heap in one go by Release() when the
+ * session is closed. Allocation may happen from the Bluetooth callback thread.
+ */
+class SessionArena : public std::pmr::memory_resource
+{
+public:
+    explicit SessionArena(std::pmr::memory_resource *apUpstream = std::pmr::new_delete_resource());
+
+    SessionArena(const SessionArena&) = delete;
+    SessionArena& operator=(const SessionArena&) = delete;
+
+    /**
+     * \brief Free all memory of the session. Nothing allocated from the arena may be used afterwards.
+     */
+    void Release();
+
+    [[nodiscard]] std::size_t GetBytesInUse() const { return mBytesInUse; }
+    [[nodiscard]] std::size_t GetPeakBytes() const { return mPeakBytes; }
+
+protected:
+    std::pmr::synchronized_pool_resource mPool;
+    std::atomic<std::size_t> mBytesInUse = 0;
+    std::atomic<std::size_t> mPeakBytes = 0;
+
+    void* do_allocate(std::size_t aBytes, std::size_t aAlignment) override;
+    void do_deallocate(void *p, std::size_t aBytes, std::size_t aAlignment) override;
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &arOther) const noexcept override;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONARENA_H
@@ -0,0 +1,153 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONRECORDING_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONRECORDING_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <logging/LogChannel.h>
+#include "GattPeripheral.h"
+
+namespace rsp {
+
+/**
+ * \brief One GATT operation in a session recording.
+ */
+struct SessionEvent
+{
+    enum class Types : std::uint8_t {
+        Characteristic = 0, // Assigns an index to a service and characteristic, only used in the file
+        Read,
+        WriteRequest,
+        WriteCommand,
+        WriteDescriptor,
+        Notification,
+        Subscribe,
+        Unsubscribe
+    };
+
+    Types mType = Types::Read;
+    std::string mService{};
+    std::string mCharacteristic{};
+    std::string mDescriptor{};          // UUID of the descriptor written, empty for other events
+    std::chrono::microseconds mTime{};  // Monotonic, from the start of the recording
+    GattPeripheral::ByteArray mValue{};
+
+    [[nodiscard]] bool IsWrite() const {
+        return (mType == Types::WriteRequest) || (mType == Types::WriteCommand) || (mType == Types::WriteDescriptor);
+    }
+};
+
+/**
+ * \brief Writes GATT traffic to a compact binary file.
+ *
+ * The file starts with "BGSR", a version byte, the identifier and address of the peripheral as
+ * length prefixed strings and its RSSI. Every event has a 9 byte header: type (uint8),
+ * characteristic index (uint16), microseconds since the previous event (uint32) and value length
+ * (uint16), followed by the value. A characteristic is given its index by a Characteristic event,
+ * the first time it is used. The value of a WriteDescriptor event starts with the descriptor UUID
+ * as a length prefixed string, since version 2. All integers are little endian.
+ *
+ * Events are mostly written from the notification callbacks of the Bluetooth stack, so a failing
+ * write is logged and stops the recording instead of throwing.
+ */
+class SessionWriter : public logging::NamedLogger<SessionWriter>
+{
+public:
+    SessionWriter(const std::string &arFileName, GattPeripheral &arPeripheral);
+
+    void Write(SessionEvent::Types aType, const std::string &arService, const std::string &arCharacteristic, const GattPeripheral::ByteArray &arValue = {});
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const GattPeripheral::ByteArray &arValue);
+
+    [[nodiscard]] std::size_t GetEventCount() const { return mEvents; }
+
+protected:
+    std::mutex mMutex{};
+    std::ofstream mFile{};
+    std::map<std::pair<std::string, std::string>, std::uint16_t> mIndex{};
+    std::chrono::steady_clock::time_point mLastEvent;
+    std::size_t mEvents = 0;
+    bool mFailed = false;
+
+    void writeEvent(SessionEvent::Types aType, std::uint16_t aIndex, std::uint32_t aDelta, const GattPeripheral::ByteArray &arValue);
+};
+
+/**
+ * \brief Reads a file written by SessionWriter.
+ */
+class SessionReader
+{
+public:
+    explicit SessionReader(const std::string &arFileName);
+
+    /**
+     * \brief Read the next event.
+     * \return False at the end of the recording
+     */
+    bool Next(SessionEvent &arEvent);
+
+    [[nodiscard]] const std::string& GetIdentifier() const { return mIdentifier; }
+    [[nodiscard]] const std::string& GetAddress() const { return mAddress; }
+    [[nodiscard]] std::int16_t GetRssi() const { return mRssi; }
+
+protected:
+    std::string mFileName;
+    std::ifstream mFile{};
+    std::uint8_t mVersion = 0;
+    std::string mIdentifier{};
+    std::string mAddress{};
+    std::int16_t mRssi = 0;
+    std::vector<std::pair<std::string, std::string>> mCharacteristics{};
+    std::chrono::microseconds mTime{};
+
+    bool readBytes(std::size_t aSize, GattPeripheral::ByteArray &arResult);
+};
+
+/**
+ * \brief GattPeripheral recording all traffic to and from another peripheral.
+ */
+class RecordingPeripheral : public GattPeripheral
+{
+public:
+    RecordingPeripheral(std::shared_ptr<GattPeripheral> aPeripheral, const std::string &arFileName);
+
+    std::string Identifier() override { return mPeripheral->Identifier(); }
+    std::string Address() override { return mPeripheral->Address(); }
+    std::int16_t Rssi() override { return mPeripheral->Rssi(); }
+
+    void Connect() override { mPeripheral->Connect(); }
+    void Disconnect() override { mPeripheral->Disconnect(); }
+    bool IsConnected() override { return mPeripheral->IsConnected(); }
+
+    std::vector<Service> Services() override { return mPeripheral->Services(); }
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override;
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) override;
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override;
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override;
+    void Print(std::ostream &o) override { mPeripheral->Print(o); }
+
+protected:
+    std::shared_ptr<GattPeripheral> mPeripheral;
+    // Shared with the notification callbacks, which may outlive this object in the Bluetooth stack.
+    std::shared_ptr<SessionWriter> mpWriter;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_SESSIONRECORDING_H
@@ -0,0 +1,162 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_SHMRING_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_SHMRING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include "bluetooth-glucose.h"
+#include "GlucoseServiceProfile.h"
+
+namespace rsp {
+
+/**
+ * \brief Convert a record to the fixed layout of the C interface, as stored in the ring.
+ */
+bg_glucose_measurement ToCRecord(const GlucoseServiceProfile::GlucoseMeasurement &arGM);
+
+/**
+ * \brief Layout of the POSIX shared memory segment of a record ring.
+ *
+ * Records are numbered from 0 in the order written, record n is kept in slot n % capacity
+ * until it is overwritten capacity records later. Each slot holds the number of its record
+ * plus 1, which is cleared while the slot is written, so readers detect records overwritten
+ * while they copied them. Readers wait on mSignal with a futex.
+ *
+ * mWaiters counts the waiting readers in its low 16 bits. A reader that dies while waiting
+ * never takes itself off, so when a wake finds nobody asleep the writer clears the count and
+ * increments the generation in the high 16 bits. Readers only take themselves off the count
+ * of the generation they joined.
+ *
+ * The segment never shrinks, a reader may still have the slots of an earlier, larger ring mapped.
+ */
+struct ShmRingLayout {
+    static constexpr std::uint32_t cMagic = 0x52474221; // "!BGR"
+    static constexpr std::uint32_t cVersion = 2;
+    static constexpr std::uint32_t cWaiterMask = 0xFFFF;
+    static constexpr unsigned cWaiterGenerationShift = 16;
+
+    struct Header {
+        std::uint32_t mMagic;
+        std::uint32_t mVersion;
+        std::uint32_t mRecordSize;      // sizeof(bg_glucose_measurement) of the writer
+        std::uint32_t mCapacity;        // Slots, a power of two
+        alignas(64) std::atomic<std::uint64_t> mWritten;    // Records written
+        alignas(64) std::atomic<std::uint32_t> mSignal;     // Futex word, changed on every write
+        std::atomic<std::uint32_t> mWaiters;                // Readers waiting on mSignal, and generation
+    };
+
+    struct Slot {
+        std::atomic<std::uint64_t> mSequence;   // Record number + 1, 0 while written
+        bg_glucose_measurement mRecord;
+    };
+
+    static constexpr std::size_t Size(std::uint32_t aCapacity) { return sizeof(Header) + std::size_t(aCapacity) * sizeof(Slot); }
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "Shared memory atomics must be lock free");
+
+/**
+ * \brief Single writer of a shared memory record ring.
+ *
+ * The segment is kept when the writer is closed, so readers keep their place when ble-dump
+ * is run again with the same name. Only one writer at a time can open a ring, Write() is
+ * thread safe within that writer.
+ *
+ * The segment is created with mode 0660. Readers open it for reading and writing, as they
+ * wait on a futex in it, so they must run as the user of the writer or be in its group.
+ */
+class ShmRingWriter
+{
+public:
+    /**
+     * \param arName Shared memory object name, with or without the leading '/'
+     * \param aCapacity Records kept for readers, rounded up to a power of two
+     */
+    ShmRingWriter(const std::string &arName, std::uint32_t aCapacity);
+    ~ShmRingWriter();
+
+    ShmRingWriter(const ShmRingWriter&) = delete;
+    ShmRingWriter& operator=(const ShmRingWriter&) = delete;
+
+    void Write(const GlucoseServiceProfile::GlucoseMeasurement &arRecord);
+    void Write(const bg_glucose_measurement &arRecord);
+
+    [[nodiscard]] std::uint64_t GetWritten() const { return mpHeader->mWritten.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::uint32_t GetCapacity() const { return mpHeader->mCapacity; }
+
+protected:
+    std::string mName;
+    int mFd = -1;
+    std::size_t mSize = 0;
+    ShmRingLayout::Header *mpHeader = nullptr;
+    ShmRingLayout::Slot *mpSlots = nullptr;
+    std::mutex mMutex{};
+};
+
+/**
+ * \brief Reader of a shared memory record ring, any number of readers can follow one writer.
+ */
+class ShmRingReader
+{
+public:
+    using Callback = std::function<void(const bg_glucose_measurement &arRecord)>;
+
+    /**
+     * \param arName Shared memory object name, with or without the leading '/'
+     * \param aFromOldest Start with the oldest record kept in the ring, otherwise with the next one written
+     */
+    explicit ShmRingReader(const std::string &arName, bool aFromOldest = false);
+    ~ShmRingReader();
+
+    ShmRingReader(const ShmRingReader&) = delete;
+    ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+    /**
+     * \brief Deliver the records written since the last call, waiting for one if there are none.
+     *        When a new writer has reinitialized the ring, reading starts over with its first record.
+     * \param aTimeout Maximum wait, none to wait until a record is written
+     * \return Number of records delivered, 0 on timeout
+     * \throws EInvalidShmRing if the ring has been replaced by one this reader cannot read
+     */
+    std::size_t Read(const Callback &arCallback, std::optional<std::chrono::milliseconds> aTimeout = {});
+
+    /**
+     * \return Records overwritten before this reader got to them
+     */
+    [[nodiscard]] std::uint64_t GetLost() const { return mLost; }
+
+protected:
+    std::string mName;
+    int mFd = -1;
+    std::size_t mSize = 0;
+    ShmRingLayout::Header *mpHeader = nullptr;
+    const ShmRingLayout::Slot *mpSlots = nullptr;
+    // Capacity when mapped, the slots beyond the mapping must not be touched if it changes
+    std::uint32_t mCapacity = 0;
+    std::uint64_t mNext = 0;
+    std::uint64_t mLost = 0;
+
+    /**
+     * \brief Map the ring in its current size, replacing an earlier mapping.
+     */
+    void mapRing();
+    bool wait(std::optional<std::chrono::milliseconds> aTimeout);
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_SHMRING_H
@@ -0,0 +1,136 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_SIMULATEDMETER_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_SIMULATEDMETER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <logging/LogChannel.h>
+#include <utils/DateTime.h>
+#include "GattPeripheral.h"
+
+namespace rsp {
+
+/**
+ * \brief In-process blood glucose meter, exposing the Glucose, Device Information and Current Time services.
+ *
+ * Records are generated from a seed, so runs are repeatable. Notifications are delivered from a
+ * thread of its own, like the Bluetooth stack does, at the configured rate and with the
+ * configured loss, reordering and disconnects.
+ */
+class SimulatedMeter : public GattPeripheral, public logging::NamedLogger<SimulatedMeter>
+{
+public:
+    struct Config {
+        std::string mName = "Simulated BGM";
+        std::string mAddress = "00:00:5E:00:53:01";
+        std::int16_t mRssi = -50;
+        std::size_t mRecords = 100;
+        double mRate = 0.0;                 // Notifications per second, 0 is as fast as possible
+        double mLoss = 0.0;                 // Probability of dropping a record
+        double mReorder = 0.0;              // Probability of swapping a notification with the next
+        std::size_t mDisconnectAfter = 0;   // Disconnect after this many notifications, 0 never
+        std::size_t mContextEvery = 0;      // Every n'th record has a context, 0 none
+        double mLiveInterval = 0.0;         // Seconds between new measurements notified while connected, 0 none
+        std::uint32_t mSeed = 1;
+
+        Config() = default;
+        /**
+         * \brief Construct from a comma separated option string.
+         * \param arOptions E.g. "records:1000,rate:200,loss:0.01,reorder:0.02,disconnect:500,context:10,live:60,seed:7"
+         */
+        explicit Config(const std::string &arOptions);
+    };
+
+    SimulatedMeter();
+    explicit SimulatedMeter(Config aConfig);
+    ~SimulatedMeter() override;
+
+    std::string Identifier() override { return mConfig.mName; }
+    std::string Address() override { return mConfig.mAddress; }
+    std::int16_t Rssi() override { return mConfig.mRssi; }
+
+    void Connect() override;
+    void Disconnect() override;
+    bool IsConnected() override { return mConnected; }
+
+    std::vector<Service> Services() override;
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override;
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) override;
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override;
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override;
+    void Print(std::ostream &o) override;
+
+    struct Record {
+        ByteArray mMeasurement{};
+        ByteArray mContext{};   // Empty if none
+    };
+
+    /**
+     * \brief Get the number of notifications sent since the last Connect().
+     */
+    [[nodiscard]] std::size_t GetNotificationsSent() const { return mNotificationsSent; }
+    /**
+     * \brief Get the value last written to the Client Characteristic Configuration of a characteristic.
+     * \return 0x0001 for notifications, 0x0002 for indications, 0 if not configured
+     */
+    [[nodiscard]] std::uint16_t GetClientConfiguration(const std::string &arCharacteristic);
+    /**
+     * \brief Get the raw measurement and context values of the generated records.
+     */
+    [[nodiscard]] const std::vector<Record>& GetRecords() const { return mRecords; }
+
+protected:
+    Config mConfig;
+    std::atomic_bool mConnected = false;
+    std::atomic_bool mAbort = false;
+    std::atomic_size_t mNotificationsSent = 0;
+    std::vector<Record> mRecords{};
+    std::map<std::string, ByteArray> mValues{};         // Readable characteristics by UUID
+    std::mutex mMutex{};
+    std::map<std::string, Callback> mSubscriptions{};   // By characteristic UUID
+    std::map<std::string, std::uint16_t> mClientConfigurations{};   // By characteristic UUID
+    std::chrono::system_clock::duration mClockOffset{};             // Set through the Current Time Service
+    std::uint8_t mAdjustReason = 0;
+    std::thread mWorker{};
+    std::mutex mDeliverMutex{};
+    // Measurements taken while connected
+    std::thread mLive{};
+    std::mutex mLiveMutex{};
+    std::condition_variable mLiveWake{};
+    std::mt19937 mRandom;
+    // Shared by the RACP worker and the live measurements, which are paced together
+    std::mutex mPaceMutex{};
+    std::chrono::steady_clock::time_point mNextNotification{};
+
+    void generateRecords();
+    Record makeRecord(std::uint16_t aSequenceNo, const utils::DateTime &arTime, std::mt19937 &arRandom) const;
+    void takeMeasurements();
+    void stopLive();
+    void racp(const ByteArray &arCommand);
+    void reportRecords(std::size_t aFirst, std::size_t aCount);
+    bool notify(const std::string &arCharacteristic, const ByteArray &arValue);
+    void respond(std::uint8_t aOpCode, std::uint8_t aStatus);
+    void stopWorker();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_SIMULATEDMETER_H
@@ -0,0 +1,126 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_TIMELINE_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_TIMELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "GattPeripheral.h"
+
+namespace rsp {
+
+/**
+ * \brief Timeline of a session in the Chrome trace event format, for chrome://tracing or Perfetto.
+ *
+ * Spans and instant events are collected with a track per thread, only while enabled. Metrics
+ * timers add their phases as spans, so the timeline shows the same phases as the metrics.
+ */
+class Timeline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Args = std::map<std::string, std::string>;
+
+    /**
+     * \brief Span from construction to destruction, if the timeline was enabled at construction.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(std::string aName, const char *apCategory = "session", Args aArgs = {});
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    protected:
+        bool mEnabled;
+        std::string mName;
+        const char *mpCategory;
+        Args mArgs;
+        Clock::time_point mStart;
+    };
+
+    static Timeline& Get();
+    [[nodiscard]] static bool IsEnabled() { return mEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief Name the track of the calling thread.
+     */
+    static void SetThreadName(const std::string &arName);
+
+    void Enable(bool aEnable = true);
+    void Complete(std::string aName, const char *apCategory, Clock::time_point aStart, Clock::time_point aEnd, Args aArgs = {});
+    void Instant(std::string aName, const char *apCategory, Args aArgs = {});
+
+    void Write(std::ostream &o) const;
+    void Save(const std::string &arFileName) const;
+
+protected:
+    struct Event {
+        char mType = 'X';
+        std::string mName{};
+        const char *mpCategory = "";
+        std::int64_t mStart = 0;
+        std::int64_t mDuration = 0;
+        std::uint32_t mThread = 0;
+        Args mArgs{};
+    };
+
+    static std::atomic_bool mEnabled;
+    Clock::time_point mOrigin = Clock::now();
+    mutable std::mutex mMutex{};
+    std::vector<Event> mEvents{};
+    std::map<std::uint32_t, std::string> mThreadNames{};
+
+    static std::uint32_t threadId();
+    void add(Event aEvent);
+};
+
+/**
+ * \brief Adds every GATT read and write as a span, and every notification as an instant event, to the Timeline.
+ */
+class TimelinePeripheral : public GattPeripheral
+{
+public:
+    explicit TimelinePeripheral(std::shared_ptr<GattPeripheral> aPeripheral) : mPeripheral(std::move(aPeripheral)) {}
+
+    std::string Identifier() override { return mPeripheral->Identifier(); }
+    std::string Address() override { return mPeripheral->Address(); }
+    std::int16_t Rssi() override { return mPeripheral->Rssi(); }
+
+    // Connecting is a phase of TrustedDevice, already on the timeline.
+    void Connect() override { mPeripheral->Connect(); }
+    void Disconnect() override;
+    bool IsConnected() override { return mPeripheral->IsConnected(); }
+
+    std::vector<Service> Services() override;
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override;
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override;
+    void WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue) override;
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override;
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override;
+    void Print(std::ostream &o) override { mPeripheral->Print(o); }
+
+protected:
+    std::shared_ptr<GattPeripheral> mPeripheral;
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_TIMELINE_H
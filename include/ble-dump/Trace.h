@@ -0,0 +1,67 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_BLE_DUMP_TRACE_H
+#define BLUETOOTHGLUCOSE_BLE_DUMP_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace rsp {
+
+/**
+ * \brief Binary trace of raw attribute values, in a lock-free ring per thread.
+ *
+ * Recording copies the event id, a timestamp and the first cMaxPayload bytes of the value,
+ * nothing is formatted. The rings keep the last cRingSize events of every thread, and are
+ * only formatted when dumped, or by the crash handler.
+ */
+class Trace
+{
+public:
+    enum class Events : std::uint16_t {
+        None = 0,
+        Measurement,
+        MeasurementContext,
+        RacpResponse,
+        CharacteristicRead,
+        CgmMeasurement,
+        CgmOpsResponse
+    };
+
+    using Timestamp = std::chrono::nanoseconds;
+
+    static constexpr std::size_t cRingSize = 1024;
+    static constexpr std::size_t cMaxPayload = 36;
+    static constexpr std::size_t cMaxThreads = 64;
+
+    /**
+     * \brief Record an event in the ring of the calling thread. Never blocks.
+     * \param aTag Event specific value, e.g. the assigned number of the characteristic read
+     */
+    static void Record(Events aEvent, std::string_view aPayload, std::uint32_t aTag = 0);
+
+    /**
+     * \brief Format the events of all threads recorded after the given time, in time order.
+     * \return Time of the last event dumped, to continue from on the next dump
+     */
+    static Timestamp Dump(std::ostream &o, Timestamp aAfter = Timestamp::min());
+
+    /**
+     * \brief Write the rings to stderr on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT.
+     */
+    static void InstallCrashHandler();
+};
+
+} // rsp
+
+#endif //BLUETOOTHGLUCOSE_BLE_DUMP_TRACE_H
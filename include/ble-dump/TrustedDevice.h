@@ -10,26 +10,56 @@
 #ifndef BLUETOOTHGLUCOSE_BLE_DUMP_TRUSTEDDEVICE_H
 #define BLUETOOTHGLUCOSE_BLE_DUMP_TRUSTEDDEVICE_H
 
+#include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
 #include <logging/LogChannel.h>
+#include "DeviceCache.h"
+#include "GattPeripheral.h"
 #include "UUID.h"
-#include <vector>
 
 namespace rsp {
 
 class TrustedDevice : public rsp::logging::NamedLogger<TrustedDevice>
 {
 public:
-    explicit TrustedDevice(const SimpleBLE::Peripheral &arDevice);
+    /**
+     * \brief Connect to the given peripheral and index its services and characteristics.
+     * \param arDevice Peripheral found by the Scanner
+     * \param aCacheDirectory Directory used to persist static device data, empty to disable
+     */
+    explicit TrustedDevice(const SimpleBLE::Peripheral &arDevice, std::string aCacheDirectory = {});
+    /**
+     * \brief Connect through any transport, e.g. a SimulatedMeter.
+     */
+    explicit TrustedDevice(std::shared_ptr<GattPeripheral> aDevice, std::string aCacheDirectory = {});
     ~TrustedDevice() override;
 
-    [[nodiscard]] bool HasServiceWithId(uuid::Identifiers aId);
-    [[nodiscard]] SimpleBLE::Service GetServiceById(uuid::Identifiers aId);
+    // The destructor disconnects, so there must only be one owner of the connection.
+    TrustedDevice(const TrustedDevice&) = delete;
+    TrustedDevice& operator=(const TrustedDevice&) = delete;
 
-    SimpleBLE::Peripheral& GetPeripheral()  { return mDevice; }
+    [[nodiscard]] bool HasServiceWithId(uuid::Identifiers aId) const;
+    [[nodiscard]] bool HasCharacteristic(uuid::Identifiers aServiceId, uuid::Identifiers aCharacteristicId) const;
+    [[nodiscard]] const std::string& GetServiceUuid(uuid::Identifiers aServiceId) const;
+    [[nodiscard]] const std::string& GetCharacteristicUuid(uuid::Identifiers aServiceId, uuid::Identifiers aCharacteristicId) const;
+
+    GattPeripheral& GetPeripheral()  { return *mDevice; }
+    DeviceCache& GetCache() { return mCache; }
 
 protected:
-    SimpleBLE::Peripheral mDevice;
+    struct ServiceEntry {
+        std::string mUuid{};
+        std::unordered_map<uuid::Identifiers, std::string> mCharacteristics{};
+    };
+
+    std::shared_ptr<GattPeripheral> mDevice;
+    DeviceCache mCache;
+    std::unordered_map<uuid::Identifiers, ServiceEntry> mIndex{};
+
+    void indexFromPeripheral();
+    [[nodiscard]] const ServiceEntry& getServiceEntry(uuid::Identifiers aServiceId) const;
 };
 
 std::ostream& operator<<(std::ostream &o, TrustedDevice &arDevice);
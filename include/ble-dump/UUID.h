@@ -10,45 +10,174 @@
 #ifndef BLUETOOTHGLUCOSE_BLE_DUMP_UUID_H
 #define BLUETOOTHGLUCOSE_BLE_DUMP_UUID_H
 
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <simpleble/SimpleBLE.h>
 
 namespace rsp::uuid {
 
-// Service and Characteristic identifiers:
+/**
+ * \brief Service, Characteristic and Descriptor identifiers.
+ *
+ * Generated at build time from the Bluetooth SIG assigned numbers in data/assigned_numbers,
+ * see cmake/GenerateAssignedNumbers.cmake.
+ */
 enum class Identifiers : uint32_t
 {
     None = 0,
-    GenericAttributeProfileService = 0x1801,
-    CurrentTimeService = 0x1805,
-    GlucoseService = 0x1808,
-    DeviceInformationService = 0x180a,
-
-    ClientCharacteristicConfiguration = 0x2902,
-    GlucoseMeasurement = 0x2a18,
-    GlucoseMeasurementContext = 0x2a34,
-    GlucoseFeature = 0x2a51,
-    RecordAccessControlPoint = 0x2a52,
-
-    SystemID = 0x2a23,
-    ModelNumberString = 0x2a24,
-    SerialNumberString = 0x2a25,
-    FirmwareRevisionString = 0x2a26,
-    SoftwareRevisionString = 0x2a28,
-    ManufacturerNameString = 0x2a29,
-    IEEE_11073_20601_RegulatoryCertDataList = 0x2a2a,
-    PnPID = 0x2a50,
-
-    CurrentTime = 0x2a2b
+#define BLE_ASSIGNED_NUMBER(kind, value, symbol, name) symbol = value,
+#include <sig-assigned-numbers.inc>
+#undef BLE_ASSIGNED_NUMBER
+};
+
+// Suffix of the Bluetooth Base UUID, 0000xxxx-0000-1000-8000-00805f9b34fb
+constexpr std::string_view cBaseUuidSuffix = "-0000-1000-8000-00805f9b34fb";
+
+/**
+ * \brief 128-bit UUID value type.
+ *
+ * Stored as two 64-bit words in the textual (big endian) order, so comparison and hashing
+ * are plain integer operations. 16 and 32-bit SIG assigned numbers are expanded with the
+ * Bluetooth Base UUID.
+ */
+class Uuid
+{
+public:
+    static constexpr std::size_t cStringLength = 36;
+
+    constexpr Uuid() = default;
+    constexpr Uuid(std::uint64_t aHigh, std::uint64_t aLow) : mHigh(aHigh), mLow(aLow) {}
+    constexpr Uuid(Identifiers aIdentifier) : Uuid(FromShort(std::uint32_t(aIdentifier))) {} // NOLINT
+
+    /**
+     * \brief Parse UUID from its textual form.
+     * \param aText Either 4 or 8 hex digits (16/32-bit short form) or the full 36 character form.
+     * \throws std::invalid_argument on malformed input
+     */
+    constexpr explicit Uuid(std::string_view aText)
+    {
+        if (aText.size() == 4 || aText.size() == 8) {
+            std::uint32_t value = 0;
+            for (char chr : aText) {
+                value = (value << 4) | hexValue(chr);
+            }
+            *this = FromShort(value);
+            return;
+        }
+        if (aText.size() != cStringLength || aText[8] != '-' || aText[13] != '-' || aText[18] != '-' || aText[23] != '-') {
+            throw std::invalid_argument("Invalid UUID");
+        }
+        int nibble = 0;
+        for (std::size_t i = 0; i < cStringLength; ++i) {
+            if (isDashPosition(i)) {
+                continue;
+            }
+            auto &word = (nibble++ < 16) ? mHigh : mLow;
+            word = (word << 4) | hexValue(aText[i]);
+        }
+    }
+
+    static constexpr Uuid FromShort(std::uint32_t aValue)
+    {
+        return {(std::uint64_t(aValue) << 32) | cBaseHigh, cBaseLow};
+    }
+
+    /**
+     * \brief Check if this UUID is derived from the Bluetooth Base UUID
+     */
+    [[nodiscard]] constexpr bool IsBase() const
+    {
+        return ((mHigh & 0xFFFFFFFF) == cBaseHigh) && (mLow == cBaseLow);
+    }
+
+    /**
+     * \brief Get the leading 32 bits, which is the assigned number for base derived UUIDs.
+     */
+    [[nodiscard]] constexpr std::uint32_t GetShort() const { return std::uint32_t(mHigh >> 32); }
+    [[nodiscard]] constexpr Identifiers ToIdentifier() const { return Identifiers(GetShort()); }
+
+    [[nodiscard]] constexpr std::uint64_t GetHigh() const { return mHigh; }
+    [[nodiscard]] constexpr std::uint64_t GetLow() const { return mLow; }
+
+    /**
+     * \brief Format as lower case 36 character string, same as reported by the Bluetooth stack.
+     */
+    [[nodiscard]] constexpr std::array<char, cStringLength> Format() const
+    {
+        constexpr char cDigits[] = "0123456789abcdef";
+        std::array<char, cStringLength> result{};
+        int nibble = 0;
+        for (std::size_t i = 0; i < cStringLength; ++i) {
+            if (isDashPosition(i)) {
+                result[i] = '-';
+                continue;
+            }
+            auto word = (nibble < 16) ? mHigh : mLow;
+            result[i] = cDigits[(word >> (60 - 4 * (nibble % 16))) & 0xF];
+            nibble++;
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::string ToString() const
+    {
+        auto text = Format();
+        return {text.data(), text.size()};
+    }
+
+    constexpr auto operator<=>(const Uuid &arOther) const = default;
+
+protected:
+    static constexpr std::uint64_t cBaseHigh = 0x0000000000001000;
+    static constexpr std::uint64_t cBaseLow = 0x800000805F9B34FB;
+
+    std::uint64_t mHigh = 0;
+    std::uint64_t mLow = 0;
+
+    static constexpr bool isDashPosition(std::size_t aIndex)
+    {
+        return aIndex == 8 || aIndex == 13 || aIndex == 18 || aIndex == 23;
+    }
+
+    static constexpr std::uint32_t hexValue(char aChar)
+    {
+        if (aChar >= '0' && aChar <= '9') {
+            return std::uint32_t(aChar - '0');
+        }
+        if (aChar >= 'a' && aChar <= 'f') {
+            return std::uint32_t(aChar - 'a' + 10);
+        }
+        if (aChar >= 'A' && aChar <= 'F') {
+            return std::uint32_t(aChar - 'A' + 10);
+        }
+        throw std::invalid_argument("Invalid UUID");
+    }
 };
 
 Identifiers FromString(const std::string &arUUID);
 std::string ToString(Identifiers aIdentifier);
-std::string ToName(Identifiers aIdentifier);
+std::string ToFullString(Identifiers aIdentifier);
+std::string_view ToName(Identifiers aIdentifier);
+std::string_view ToName(const Uuid &arUuid);
 std::ostream &operator<<(std::ostream &o, Identifiers aIdentifier);
+std::ostream &operator<<(std::ostream &o, const Uuid &arUuid);
 
 } // namespace rsp::uuid
 
+template<>
+struct std::hash<rsp::uuid::Uuid>
+{
+    std::size_t operator()(const rsp::uuid::Uuid &arUuid) const noexcept
+    {
+        return std::hash<std::uint64_t>{}(arUuid.GetHigh() ^ (arUuid.GetLow() * 0x9E3779B97F4A7C15ull));
+    }
+};
+
 namespace SimpleBLE {
 
 std::ostream &operator<<(std::ostream &o, Peripheral &arPeripheral);
@@ -0,0 +1,118 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#ifndef BLUETOOTHGLUCOSE_C_API_H
+#define BLUETOOTHGLUCOSE_C_API_H
+
+/**
+ * C interface to the bluetooth-glucose library.
+ *
+ * Functions returning int return a negative value on failure, the reason is
+ * then available from bg_last_error(). No exceptions cross this interface.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BG_API_VERSION 2
+
+/** Opaque handle to a connected glucose meter. */
+typedef struct bg_meter bg_meter;
+
+/** Decoded Glucose Measurement record, joined with its Glucose Measurement Context if any. */
+typedef struct bg_glucose_measurement {
+    uint8_t flags;                      /* Glucose Measurement flags field */
+    uint16_t sequence_number;
+    int64_t capture_time_ms;            /* Milliseconds since 1970-01-01, in the time zone of the device, 0 if not known */
+    float concentration;
+    uint8_t unit;                       /* 0: mg/dL, 1: mmol/L */
+    uint8_t type;                       /* Sample type as defined by the Glucose Service */
+    uint8_t location;                   /* Sample location as defined by the Glucose Service */
+    uint16_t sensor_status;
+    /* Context, only valid when context_flags is not zero */
+    uint8_t context_flags;              /* Glucose Measurement Context flags field */
+    uint8_t carbohydrate_id;
+    float carbohydrate;                 /* Kilogram */
+    uint8_t meal;
+    uint8_t tester;
+    uint8_t health;
+    uint16_t exercise_duration_seconds;
+    uint8_t exercise_intensity;         /* Percent */
+    uint8_t medication_id;
+    float medication;
+    uint8_t medication_unit;            /* 0: kilogram, 1: litre */
+    float hba1c;                        /* Percent */
+} bg_glucose_measurement;
+
+/** Called once per record, the record is only valid during the call. */
+typedef void (*bg_measurement_callback)(const bg_glucose_measurement *record, void *user_data);
+
+/**
+ * Scan for and connect to a meter.
+ * \param adapter Adapter name or address, NULL for the first adapter
+ * \param address Device address or name, wildcards as accepted by ble-dump --device
+ * \param timeout_ms Maximum time to scan
+ * \param cache_dir Directory for cached device information, NULL to disable
+ * \return Handle to pass to other functions, NULL on failure
+ */
+bg_meter* bg_meter_open(const char *adapter, const char *address, uint32_t timeout_ms, const char *cache_dir);
+
+/** Disconnect and release the handle. NULL is ignored. */
+void bg_meter_close(bg_meter *meter);
+
+/** \return Number of records stored on the meter, negative on failure */
+int bg_meter_record_count(bg_meter *meter);
+
+/**
+ * Read all records from the meter, calling callback for each one in the order the meter sends them,
+ * which is normally oldest first.
+ * \return Number of records delivered, negative on failure
+ */
+int bg_meter_read_all(bg_meter *meter, bg_measurement_callback callback, void *user_data);
+
+/** Delete all records on the meter. \return 0 on success, negative on failure */
+int bg_meter_clear(bg_meter *meter);
+
+/** Opaque handle to a reader of the shared memory ring written by ble-dump --sink=shm:<name>. */
+typedef struct bg_shm_reader bg_shm_reader;
+
+/**
+ * Open a shared memory record ring. The ring is created with mode 0660, so the reader must run as
+ * the user of ble-dump or be in its group.
+ * \param name Name given to --sink=shm:<name>
+ * \param from_oldest Non-zero to start with the oldest record kept in the ring, otherwise with the next one written
+ * \return Handle to pass to other functions, NULL on failure
+ */
+bg_shm_reader* bg_shm_reader_open(const char *name, int from_oldest);
+
+/** Release the handle. NULL is ignored. */
+void bg_shm_reader_close(bg_shm_reader *reader);
+
+/**
+ * Deliver the records written since the last call, waiting for one if there are none.
+ * The records are copied out of the ring, they are only valid during the callback.
+ * \param timeout_ms Maximum wait, negative to wait until a record is written
+ * \return Number of records delivered, 0 on timeout, negative on failure
+ */
+int bg_shm_reader_read(bg_shm_reader *reader, int32_t timeout_ms, bg_measurement_callback callback, void *user_data);
+
+/** \return Records overwritten in the ring before the reader got to them, 0 for a NULL handle */
+uint64_t bg_shm_reader_lost(const bg_shm_reader *reader);
+
+/** \return Description of the last failure on the calling thread, never NULL */
+const char* bg_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLUETOOTHGLUCOSE_C_API_H */
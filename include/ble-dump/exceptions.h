@@ -50,6 +50,18 @@ public:
     explicit EGlucoseArgument() : ApplicationException("Invalid glucose measurement received") {}
 };
 
+class ECgmArgument : public exceptions::ApplicationException
+{
+public:
+    explicit ECgmArgument(const std::string &arReason) : ApplicationException("Invalid CGM value received: " + arReason) {}
+};
+
+class ECgmOperationFailed : public exceptions::ApplicationException
+{
+public:
+    explicit ECgmOperationFailed(const std::string &arOperation) : ApplicationException("CGM operation failed: " + arOperation) {}
+};
+
 class EServiceNotFound : public exceptions::ApplicationException
 {
 public:
@@ -62,6 +74,60 @@ public:
     explicit ECharacteristicNotFound(const std::string &arUuid) : ApplicationException("Characteristic not found: " + arUuid) {}
 };
 
+class EInvalidScanFilter : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidScanFilter(const std::string &arFilter) : ApplicationException("Invalid scan filter: " + arFilter) {}
+};
+
+class EInvalidOption : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidOption(const std::string &arOption) : ApplicationException("Invalid option value: " + arOption) {}
+};
+
+class EUnknownCommand : public exceptions::ApplicationException
+{
+public:
+    explicit EUnknownCommand(const std::string &arCommand) : ApplicationException("Unknown command: " + arCommand) {}
+};
+
+class EUnknownRequest : public exceptions::ApplicationException
+{
+public:
+    explicit EUnknownRequest(const std::string &arCommand) : ApplicationException("Unknown request command: " + arCommand) {}
+};
+
+class EInvalidSimulation : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidSimulation(const std::string &arOption) : ApplicationException("Invalid simulation option: " + arOption) {}
+};
+
+class EInvalidRecording : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidRecording(const std::string &arFileName) : ApplicationException("Invalid session recording: " + arFileName) {}
+};
+
+class ENoRecording : public exceptions::ApplicationException
+{
+public:
+    explicit ENoRecording() : ApplicationException("Missing replay option.") {}
+};
+
+class EInvalidSink : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidSink(const std::string &arSink) : ApplicationException("Invalid sink: " + arSink) {}
+};
+
+class EInvalidShmRing : public exceptions::ApplicationException
+{
+public:
+    explicit EInvalidShmRing(const std::string &arReason) : ApplicationException("Invalid shared memory ring: " + arReason) {}
+};
+
 } // namespace rsp
 
 #endif //BLUETOOTHGLUCOSE_BLE_DUMP_EXCEPTIONS_H
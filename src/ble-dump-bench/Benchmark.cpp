@@ -0,0 +1,104 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <ctime>
+#include <Benchmark.h>
+#include <utils/DateTime.h>
+
+using namespace rsp::utils;
+
+namespace rsp::bench {
+
+static std::chrono::nanoseconds cpuTime()
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+Benchmark& Benchmark::Add(std::string aName, Factory aFactory)
+{
+    mBenchmarks.emplace_back(std::move(aName), std::move(aFactory));
+    return *this;
+}
+
+std::vector<Benchmark::Result> Benchmark::Run(const std::vector<std::size_t> &arSizes, const std::string &arFilter,
+                                              std::chrono::milliseconds aMinTime, std::ostream &arProgress) const
+{
+    using Clock = std::chrono::steady_clock;
+    std::vector<Result> results;
+    for (auto &[name, factory] : mBenchmarks) {
+        if (name.find(arFilter) == std::string::npos) {
+            continue;
+        }
+        for (auto size : arSizes) {
+            Result &result = results.emplace_back();
+            result.mName = name + "/" + std::to_string(size);
+            result.mRecords = size;
+            result.mMin = std::chrono::nanoseconds::max();
+
+            auto body = factory(size);
+            Clock::duration total{};
+            auto cpu_start = cpuTime();
+            // At least one iteration, the largest sizes can take longer than the minimum time.
+            while ((result.mIterations == 0) || (total < aMinTime)) {
+                auto start = Clock::now();
+                body();
+                auto elapsed = Clock::now() - start;
+                total += elapsed;
+                result.mMin = std::min(result.mMin, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+                result.mIterations++;
+            }
+            result.mCpuMean = (cpuTime() - cpu_start) / result.mIterations;
+            result.mMean = std::chrono::duration_cast<std::chrono::nanoseconds>(total) / result.mIterations;
+            arProgress << result.mName << ": " << result.mMean.count() << " ns, " << result.mIterations << " iterations" << std::endl;
+        }
+    }
+    return results;
+}
+
+DynamicData Benchmark::ToDynamicData(const std::vector<Result> &arResults)
+{
+    DynamicData benchmarks;
+    for (auto &result : arResults) {
+        double mean = double(result.mMean.count());
+        DynamicData entry;
+        entry.Add("name", result.mName)
+             .Add("run_name", result.mName)
+             .Add("run_type", "iteration")
+             .Add("repetitions", std::uint64_t(1))
+             .Add("repetition_index", std::uint64_t(0))
+             .Add("threads", std::uint64_t(1))
+             .Add("iterations", std::uint64_t(result.mIterations))
+             .Add("real_time", mean)
+             .Add("cpu_time", double(result.mCpuMean.count()))
+             .Add("time_unit", "ns")
+             .Add("records", std::uint64_t(result.mRecords))
+             .Add("min_time", double(result.mMin.count()))
+             .Add("ns_per_record", result.mRecords ? mean / double(result.mRecords) : 0.0)
+             .Add("records_per_second", (mean > 0.0) ? double(result.mRecords) * 1e9 / mean : 0.0);
+        benchmarks.Add(entry);
+    }
+
+    DynamicData context;
+    context.Add("date", DateTime::Now().ToISO8601UTC());
+#ifdef NDEBUG
+    context.Add("library_build_type", "release");
+#else
+    context.Add("library_build_type", "debug");
+#endif
+
+    DynamicData result;
+    result.Add("context", context).Add("benchmarks", benchmarks);
+    return result;
+}
+
+} // rsp::bench
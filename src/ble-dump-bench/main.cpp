@@ -0,0 +1,338 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <AttributeStream.h>
+#include <Benchmark.h>
+#include <GlucoseServiceProfile.h>
+#include <json/JsonEncoder.h>
+#include <RecordEncoder.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+
+using namespace rsp;
+using namespace rsp::bench;
+using namespace rsp::utils;
+
+/**
+ * \brief Glucose Service with the notification handlers exposed, connected to a simulated meter.
+ */
+class GlucoseServiceHarness : public GlucoseServiceProfile
+{
+public:
+    explicit GlucoseServiceHarness(TrustedDevice &arDevice) : GlucoseServiceProfile(arDevice) {}
+
+    using GlucoseServiceProfile::measurementHandler;
+    using GlucoseServiceProfile::measurementContextHandler;
+    using GlucoseServiceProfile::spillRecords;
+
+    void Clear() { mMeasurements.clear(); }
+};
+
+/**
+ * \brief Synthetic raw records with a context for every 10th, as produced by the simulated meter.
+ *        The records of the last size are kept, as all benchmarks use the same sizes in turn.
+ */
+static const std::vector<SimulatedMeter::Record>& syntheticRecords(std::size_t aRecords)
+{
+    static std::unique_ptr<SimulatedMeter> meter;
+    if (!meter || (meter->GetRecords().size() != aRecords)) {
+        meter.reset();
+        meter = std::make_unique<SimulatedMeter>(SimulatedMeter::Config("records:" + std::to_string(aRecords) + ",context:10"));
+    }
+    return meter->GetRecords();
+}
+
+/**
+ * \brief Records as decoded and joined by the Glucose Service.
+ */
+static std::vector<GlucoseServiceProfile::GlucoseMeasurement> decodedRecords(std::size_t aRecords)
+{
+    TrustedDevice device(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:0")));
+    GlucoseServiceHarness gls(device);
+    for (auto &record : syntheticRecords(aRecords)) {
+        gls.measurementHandler(AttributeStream(record.mMeasurement));
+        if (!record.mContext.empty()) {
+            gls.measurementContextHandler(AttributeStream(record.mContext));
+        }
+    }
+    auto &records = gls.GetMeasurements();
+    return {records.begin(), records.end()};
+}
+
+static void addAttributeStreamBenchmarks(Benchmark &arBench)
+{
+    arBench.Add("AttributeStream/ReadUint16", [](std::size_t aRecords) {
+        AttributeStream data(aRecords * 2);
+        for (std::size_t i = 0; i < aRecords; i++) {
+            data.Uint16(std::uint16_t(i));
+        }
+        return [bytes = data.GetArray(), aRecords]() {
+            AttributeStream s(bytes);
+            std::uint32_t sum = 0;
+            for (std::size_t i = 0; i < aRecords; i++) {
+                sum += s.Uint16();
+            }
+            DoNotOptimize(sum);
+        };
+    });
+    arBench.Add("AttributeStream/WriteUint16", [](std::size_t aRecords) {
+        return [aRecords]() {
+            AttributeStream s(aRecords * 2);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                s.Uint16(std::uint16_t(i));
+            }
+            DoNotOptimize(s.GetArray());
+        };
+    });
+    arBench.Add("AttributeStream/ReadMedFloat16", [](std::size_t aRecords) {
+        AttributeStream data(aRecords * 2);
+        for (std::size_t i = 0; i < aRecords; i++) {
+            data.MedFloat16(float(i % 200) / 10000.0f);
+        }
+        return [bytes = data.GetArray(), aRecords]() {
+            AttributeStream s(bytes);
+            float sum = 0.0f;
+            for (std::size_t i = 0; i < aRecords; i++) {
+                sum += s.MedFloat16();
+            }
+            DoNotOptimize(sum);
+        };
+    });
+    arBench.Add("AttributeStream/WriteMedFloat16", [](std::size_t aRecords) {
+        return [aRecords]() {
+            AttributeStream s(aRecords * 2);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                s.MedFloat16(float(i % 200) / 10000.0f);
+            }
+            DoNotOptimize(s.GetArray());
+        };
+    });
+    arBench.Add("AttributeStream/ReadDateTime", [](std::size_t aRecords) {
+        AttributeStream data(aRecords * 7);
+        DateTime time(2024, 1, 1, 8, 0, 0);
+        for (std::size_t i = 0; i < aRecords; i++) {
+            data.DateTime(time);
+            time += std::chrono::minutes(17);
+        }
+        return [bytes = data.GetArray(), aRecords]() {
+            AttributeStream s(bytes);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                auto dt = s.DateTime();
+                DoNotOptimize(dt);
+            }
+        };
+    });
+    arBench.Add("AttributeStream/ReadEpochTime", [](std::size_t aRecords) {
+        AttributeStream data(aRecords * 7);
+        DateTime time(2024, 1, 1, 8, 0, 0);
+        for (std::size_t i = 0; i < aRecords; i++) {
+            data.DateTime(time);
+            time += std::chrono::minutes(17);
+        }
+        return [bytes = data.GetArray(), aRecords]() {
+            AttributeStream s(bytes);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                auto et = s.EpochTime();
+                DoNotOptimize(et);
+            }
+        };
+    });
+    arBench.Add("Iso8601Formatter/Format", [](std::size_t aRecords) {
+        return [aRecords]() {
+            Iso8601Formatter formatter;
+            auto time = EpochTime::FromDateTime(2024, 1, 1, 8, 0, 0);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                DoNotOptimize(formatter.Format(time));
+                time.mSeconds += 17 * 60;
+            }
+        };
+    });
+    arBench.Add("AttributeStream/WriteDateTime", [](std::size_t aRecords) {
+        return [aRecords]() {
+            AttributeStream s(aRecords * 7);
+            DateTime time(2024, 1, 1, 8, 0, 0);
+            for (std::size_t i = 0; i < aRecords; i++) {
+                s.DateTime(time);
+            }
+            DoNotOptimize(s.GetArray());
+        };
+    });
+}
+
+static void addGlucoseBenchmarks(Benchmark &arBench)
+{
+    arBench.Add("GlucoseMeasurement/Construct", [](std::size_t aRecords) {
+        return [&records = syntheticRecords(aRecords)]() {
+            std::vector<GlucoseServiceProfile::GlucoseMeasurement> result;
+            result.reserve(records.size());
+            for (auto &record : records) {
+                AttributeStream s(record.mMeasurement);
+                result.emplace_back(s);
+            }
+            DoNotOptimize(result.data());
+        };
+    });
+    arBench.Add("GlucoseServiceProfile/MeasurementHandler", [](std::size_t aRecords) {
+        auto device = std::make_shared<TrustedDevice>(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:0")));
+        auto gls = std::make_shared<GlucoseServiceHarness>(*device);
+        return [device, gls, &records = syntheticRecords(aRecords)]() {
+            gls->Clear();
+            for (auto &record : records) {
+                gls->measurementHandler(AttributeStream(record.mMeasurement));
+            }
+        };
+    });
+    // Contexts are joined with the measurements already received, as they arrive from the meter.
+    arBench.Add("GlucoseServiceProfile/ContextJoin", [](std::size_t aRecords) {
+        auto device = std::make_shared<TrustedDevice>(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:0")));
+        auto gls = std::make_shared<GlucoseServiceHarness>(*device);
+        return [device, gls, &records = syntheticRecords(aRecords)]() {
+            gls->Clear();
+            for (auto &record : records) {
+                gls->measurementHandler(AttributeStream(record.mMeasurement));
+                if (!record.mContext.empty()) {
+                    gls->measurementContextHandler(AttributeStream(record.mContext));
+                }
+            }
+        };
+    });
+    // Decoded records passed to several consumers, in batches shared by all of them.
+    arBench.Add("GlucoseServiceProfile/FanOut", [](std::size_t aRecords) {
+        auto device = std::make_shared<TrustedDevice>(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:0")));
+        auto gls = std::make_shared<GlucoseServiceHarness>(*device);
+        auto sum = std::make_shared<float>(0.0f);
+        gls->SetBatchSize(64);
+        for (int i = 0; i < 3; ++i) {
+            gls->Subscribe([sum](const GlucoseServiceProfile::GlucoseMeasurement &arRecord, const GlucoseServiceProfile::RecordBatch&) {
+                *sum += arRecord.mGlucoseConcentration;
+            });
+        }
+        return [device, gls, sum, &records = syntheticRecords(aRecords)]() {
+            for (auto &record : records) {
+                gls->measurementHandler(AttributeStream(record.mMeasurement));
+                if (!record.mContext.empty()) {
+                    gls->measurementContextHandler(AttributeStream(record.mContext));
+                }
+            }
+            gls->spillRecords(0);
+            DoNotOptimize(*sum);
+        };
+    });
+}
+
+static void addOutputBenchmarks(Benchmark &arBench, const std::filesystem::path &arOutputFile)
+{
+    arBench.Add("DynamicData/Build", [](std::size_t aRecords) {
+        return [records = decodedRecords(aRecords)]() {
+            DynamicData dd;
+            dd << records;
+            DoNotOptimize(dd);
+        };
+    });
+    for (std::string encoder : {"csv", "json"}) {
+        arBench.Add("Encode/" + encoder, [encoder](std::size_t aRecords) {
+            auto dd = std::make_shared<DynamicData>();
+            *dd << decodedRecords(aRecords);
+            return [dd, encoder]() {
+                NullBuffer buffer;
+                std::ostream out(&buffer);
+                RecordEncoder::Save(out, *dd, encoder);
+                DoNotOptimize(buffer.GetCount());
+            };
+        });
+        // The whole output path of the dump command, from decoded records to file.
+        arBench.Add("Write/" + encoder, [encoder, arOutputFile](std::size_t aRecords) {
+            return [records = decodedRecords(aRecords), encoder, arOutputFile]() {
+                DynamicData dd;
+                dd << records;
+                std::ofstream file;
+                file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+                file.open(arOutputFile, std::ios::out | std::ios::trunc);
+                RecordEncoder::Save(file, dd, encoder);
+            };
+        });
+    }
+}
+
+static void showHelp()
+{
+    std::cout << ""
+        "Usage: ble-dump-bench [<options>]\n"
+        "  Options:\n"
+        "    --filter=<text>                 Only run benchmarks with names containing text.\n"
+        "    --sizes=<n,...>                 Record counts to run every benchmark with.\n"
+        "                                    Defaults to 1000,100000,1000000\n"
+        "    --min-time=<ms>                 Minimum time to repeat every benchmark. Defaults to 500.\n"
+        "    --output=<filename>             Write the JSON results to file instead of stdout.\n"
+        "    --help                          Show this help information.\n"
+        << std::endl;
+}
+
+int main(int argc, const char **argv)
+try
+{
+    std::vector<std::size_t> sizes{1000, 100000, 1000000};
+    std::string filter;
+    std::chrono::milliseconds min_time(500);
+    std::string output;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.starts_with("--filter=")) {
+            filter = value;
+        }
+        else if (arg.starts_with("--sizes=")) {
+            sizes.clear();
+            std::istringstream in(value);
+            std::string size;
+            while (std::getline(in, size, ',')) {
+                sizes.push_back(std::stoul(size));
+            }
+        }
+        else if (arg.starts_with("--min-time=")) {
+            min_time = std::chrono::milliseconds(std::stoul(value));
+        }
+        else if (arg.starts_with("--output=")) {
+            output = value;
+        }
+        else {
+            showHelp();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    auto output_file = std::filesystem::temp_directory_path() / "ble-dump-bench.out";
+    Benchmark bench;
+    addAttributeStreamBenchmarks(bench);
+    addGlucoseBenchmarks(bench);
+    addOutputBenchmarks(bench, output_file);
+
+    auto results = bench.Run(sizes, filter, min_time, std::cerr);
+    std::filesystem::remove(output_file);
+
+    auto json = json::JsonEncoder(true).Encode(Benchmark::ToDynamicData(results));
+    if (output.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream file(output, std::ios::out | std::ios::trunc);
+        file << json << std::endl;
+    }
+    return 0;
+}
+catch (const std::exception &e) {
+    std::cerr << "FATAL: " << e.what() << std::endl;
+    return 1;
+}
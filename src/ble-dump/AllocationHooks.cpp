@@ -0,0 +1,43 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+/*
+ * Replacement of the global operator new and delete, reporting to AllocationStats.
+ * Part of the application only, programs using the library keep their own allocator.
+ * The array, sized and nothrow forms all end up in these by default.
+ */
+
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <AllocationStats.h>
+
+void* operator new(std::size_t aSize)
+{
+    void *p = std::malloc(aSize ? aSize : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    rsp::AllocationStats::Allocated(malloc_usable_size(p));
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p) {
+        rsp::AllocationStats::Freed(malloc_usable_size(p));
+        std::free(p);
+    }
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
@@ -0,0 +1,167 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <sys/resource.h>
+#include <AllocationStats.h>
+
+namespace rsp {
+
+namespace {
+
+struct PhaseCounters {
+    std::atomic<std::uint64_t> mAllocations{0};
+    std::atomic<std::uint64_t> mFrees{0};
+    std::atomic<std::uint64_t> mBytes{0};
+    std::atomic<std::uint64_t> mPeakRssKb{0};
+};
+
+// Phase 0 collects allocations outside of any phase.
+std::atomic_bool gEnabled = false;
+// Per thread, concurrent sessions must not attribute allocations to each others phases.
+thread_local int gCurrentPhase = 0;
+std::array<PhaseCounters, AllocationStats::cMaxPhases> gCounters{};
+std::atomic<std::int64_t> gHeapBytes = 0;
+std::atomic<std::int64_t> gPeakHeapBytes = 0;
+
+std::mutex gPhaseMutex{};
+std::array<std::string, AllocationStats::cMaxPhases> gPhaseNames{"(none)"};
+std::size_t gPhaseCount = 1;
+
+int phaseIndex(const std::string &arPhase)
+{
+    std::lock_guard<std::mutex> lock(gPhaseMutex);
+    for (std::size_t i = 0; i < gPhaseCount; ++i) {
+        if (gPhaseNames[i] == arPhase) {
+            return int(i);
+        }
+    }
+    if (gPhaseCount == gPhaseNames.size()) {
+        return 0;
+    }
+    gPhaseNames[gPhaseCount] = arPhase;
+    return int(gPhaseCount++);
+}
+
+std::uint64_t peakRssKb()
+{
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return std::uint64_t(usage.ru_maxrss);
+}
+
+} // namespace
+
+AllocationStats::PhaseScope::PhaseScope(const std::string &arPhase)
+    : mPrevious(-1),
+      mPhase(0)
+{
+    if (IsEnabled()) {
+        mPhase = phaseIndex(arPhase);
+        mPrevious = std::exchange(gCurrentPhase, mPhase);
+    }
+}
+
+AllocationStats::PhaseScope::PhaseScope(int aPhase)
+    : mPrevious(-1),
+      mPhase(aPhase)
+{
+    if (IsEnabled() && (aPhase > 0) && (aPhase < int(cMaxPhases))) {
+        mPrevious = std::exchange(gCurrentPhase, mPhase);
+    }
+}
+
+AllocationStats::PhaseScope::~PhaseScope()
+{
+    if (mPrevious < 0) {
+        return;
+    }
+    auto &peak = gCounters[std::size_t(mPhase)].mPeakRssKb;
+    peak = std::max(peak.load(), peakRssKb());
+    gCurrentPhase = mPrevious;
+}
+
+void AllocationStats::Enable(bool aEnable)
+{
+    gEnabled = aEnable;
+}
+
+bool AllocationStats::IsEnabled()
+{
+    return gEnabled.load(std::memory_order_relaxed);
+}
+
+int AllocationStats::GetCurrentPhase()
+{
+    return gCurrentPhase;
+}
+
+void AllocationStats::Allocated(std::size_t aSize) noexcept
+{
+    if (!gEnabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto &counters = gCounters[std::size_t(gCurrentPhase)];
+    counters.mAllocations.fetch_add(1, std::memory_order_relaxed);
+    counters.mBytes.fetch_add(aSize, std::memory_order_relaxed);
+    auto heap = gHeapBytes.fetch_add(std::int64_t(aSize), std::memory_order_relaxed) + std::int64_t(aSize);
+    auto peak = gPeakHeapBytes.load(std::memory_order_relaxed);
+    while ((heap > peak) && !gPeakHeapBytes.compare_exchange_weak(peak, heap, std::memory_order_relaxed)) {
+    }
+}
+
+void AllocationStats::Freed(std::size_t aSize) noexcept
+{
+    if (!gEnabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    gCounters[std::size_t(gCurrentPhase)].mFrees.fetch_add(1, std::memory_order_relaxed);
+    gHeapBytes.fetch_sub(std::int64_t(aSize), std::memory_order_relaxed);
+}
+
+std::vector<AllocationStats::Counts> AllocationStats::GetPhases()
+{
+    std::lock_guard<std::mutex> lock(gPhaseMutex);
+    std::vector<Counts> result;
+    for (std::size_t i = 0; i < gPhaseCount; ++i) {
+        auto &counters = gCounters[i];
+        result.push_back(Counts{gPhaseNames[i], counters.mAllocations, counters.mFrees, counters.mBytes, counters.mPeakRssKb});
+    }
+    return result;
+}
+
+AllocationStats::Counts AllocationStats::GetTotal()
+{
+    Counts total;
+    total.mPhase = "total";
+    for (auto &counts : GetPhases()) {
+        total.mAllocations += counts.mAllocations;
+        total.mFrees += counts.mFrees;
+        total.mBytes += counts.mBytes;
+    }
+    total.mPeakRssKb = peakRssKb();
+    return total;
+}
+
+std::uint64_t AllocationStats::GetPeakHeapBytes()
+{
+    return std::uint64_t(std::max<std::int64_t>(gPeakHeapBytes, 0));
+}
+
+std::uint64_t AllocationStats::GetPeakRssKb()
+{
+    return peakRssKb();
+}
+
+} // rsp
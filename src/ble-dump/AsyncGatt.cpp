@@ -0,0 +1,86 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <AsyncGatt.h>
+
+namespace rsp {
+
+AsyncGatt::AsyncGatt(Executor &arExecutor, TrustedDevice &arDevice)
+    : mExecutor(arExecutor),
+      mDevice(arDevice)
+{
+}
+
+AsyncGatt::~AsyncGatt()
+{
+    for (auto &[key, queue] : mSubscriptions) {
+        try {
+            mDevice.GetPeripheral().Unsubscribe(mDevice.GetServiceUuid(key.first), mDevice.GetCharacteristicUuid(key.first, key.second));
+        }
+        catch (const std::exception &e) {
+            mLogger.Warning() << "Unsubscribe from " << key.second << " failed: " << e.what();
+        }
+    }
+}
+
+Task<SimpleBLE::ByteArray> AsyncGatt::Read(uuid::Identifiers aService, uuid::Identifiers aCharacteristic)
+{
+    auto &service = mDevice.GetServiceUuid(aService);
+    auto &characteristic = mDevice.GetCharacteristicUuid(aService, aCharacteristic);
+    co_return co_await mExecutor.Offload([&]() {
+        return mDevice.GetPeripheral().Read(service, characteristic);
+    });
+}
+
+Task<void> AsyncGatt::Write(uuid::Identifiers aService, uuid::Identifiers aCharacteristic, SimpleBLE::ByteArray aValue, bool aWithResponse)
+{
+    auto &service = mDevice.GetServiceUuid(aService);
+    auto &characteristic = mDevice.GetCharacteristicUuid(aService, aCharacteristic);
+    co_await mExecutor.Offload([&]() {
+        if (aWithResponse) {
+            mDevice.GetPeripheral().WriteRequest(service, characteristic, aValue);
+        }
+        else {
+            mDevice.GetPeripheral().WriteCommand(service, characteristic, aValue);
+        }
+    });
+}
+
+Task<std::optional<SimpleBLE::ByteArray>> AsyncGatt::Notification(uuid::Identifiers aService, uuid::Identifiers aCharacteristic, std::chrono::milliseconds aTimeout)
+{
+    auto *queue = co_await subscribe(aService, aCharacteristic);
+    co_return co_await queue->Pop(mExecutor, aTimeout);
+}
+
+Task<AsyncQueue<SimpleBLE::ByteArray>*> AsyncGatt::subscribe(uuid::Identifiers aService, uuid::Identifiers aCharacteristic)
+{
+    AsyncQueue<SimpleBLE::ByteArray> *queue;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto &entry = mSubscriptions[Key(aService, aCharacteristic)];
+        if (entry) {
+            co_return entry.get();
+        }
+        entry = std::make_unique<AsyncQueue<SimpleBLE::ByteArray>>();
+        queue = entry.get();
+    }
+
+    auto &service = mDevice.GetServiceUuid(aService);
+    auto &characteristic = mDevice.GetCharacteristicUuid(aService, aCharacteristic);
+    mLogger.Debug() << "Subscribing to " << aCharacteristic;
+    co_await mExecutor.Offload([&]() {
+        mDevice.GetPeripheral().Notify(service, characteristic, [queue](SimpleBLE::ByteArray aValue) {
+            queue->Push(std::move(aValue));
+        });
+    });
+    co_return queue;
+}
+
+} // rsp
@@ -2,6 +2,7 @@
 // Created by steffen on 14-02-24.
 //
 
+#include <algorithm>
 #include <cmath>
 #include <AttributeStream.h>
 
@@ -49,7 +50,7 @@ AttributeStream &AttributeStream::MedFloat16(float aValue)
 {
     int exponent;
     int mantissa;
-    splitFloat(aValue, exponent, mantissa);
+    splitFloat(aValue, -8, 7, 0x07FD, exponent, mantissa);
     Uint16(uint16_t((exponent & 0x0F) << 12) + uint16_t(mantissa & 0x0FFF));
     return *this;
 }
@@ -58,8 +59,8 @@ AttributeStream &AttributeStream::MedFloat32(float aValue)
 {
     int exponent;
     int mantissa;
-    splitFloat(aValue, exponent, mantissa);
-    Uint16(uint32_t((exponent & 0xFF) << 24) + uint32_t(mantissa & 0x00FFFFFF));
+    splitFloat(aValue, -128, 127, 0x007FFFFD, exponent, mantissa);
+    Uint32(uint32_t((exponent & 0xFF) << 24) + uint32_t(mantissa & 0x00FFFFFF));
     return *this;
 }
 
@@ -131,18 +132,24 @@ float AttributeStream::makeFloat(int aExponent, int aMantissa)
     return float(aMantissa * magnitude);
 }
 
-void AttributeStream::splitFloat(float aValue, int &arExponent, int &arMantissa)
+void AttributeStream::splitFloat(float aValue, int aMinExponent, int aMaxExponent, int aMaxMantissa, int &arExponent, int &arMantissa)
 {
-    uint32_t ui = reinterpret_cast<uint32_t&>(aValue);
-    // TODO: std::frexp() std::ldexp()
+    // Smallest exponent where the mantissa fits gives the best precision.
+    // Start at 10^-8, values in the Bluetooth profiles do not need more.
+    for (arExponent = std::max(aMinExponent, -8); arExponent < aMaxExponent; arExponent++) {
+        if (std::abs(std::round(double(aValue) / std::pow(10.0, arExponent))) <= aMaxMantissa) {
+            break;
+        }
+    }
+    arMantissa = int(std::round(double(aValue) / std::pow(10.0, arExponent)));
 }
 
 AttributeStream &AttributeStream::DateTime(const utils::DateTime &arDt, bool aIncludeDayOfWeek, bool aIncludeFractions)
 {
     using namespace std::chrono;
     std::tm tm = arDt;
-    Uint16(tm.tm_year);
-    Uint8(tm.tm_mon);
+    Uint16(uint16_t(tm.tm_year + 1900));
+    Uint8(uint8_t(tm.tm_mon + 1));
     Uint8(tm.tm_mday);
     Uint8(tm.tm_hour);
     Uint8(tm.tm_min);
@@ -177,6 +184,17 @@ rsp::utils::DateTime AttributeStream::DateTime(bool aIncludeDayOfWeek, bool aInc
     return {y, m,d, h, i, s, msec};
 }
 
+rsp::EpochTime AttributeStream::EpochTime()
+{
+    auto y = Uint16();
+    auto m = Uint8();
+    auto d = Uint8();
+    auto h = Uint8();
+    auto i = Uint8();
+    auto s = Uint8();
+    return rsp::EpochTime::FromDateTime(y, m, d, h, i, s);
+}
+
 AttributeStream &AttributeStream::String(const std::string &arString)
 {
     mByteArray = arString;
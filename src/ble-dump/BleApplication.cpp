@@ -10,18 +10,40 @@
 
 #include <TrustedDevice.h>
 #include <application/Console.h>
+#include <AllocationStats.h>
 #include <BleApplication.h>
+#include <CgmServiceProfile.h>
+#include <DeviceCache.h>
 #include <CurrentTimeServiceProfile.h>
+#include <DaemonServer.h>
 #include <DeviceInformationServiceProfile.h>
-#include <exceptions/SignalHandler.h>
 #include <exceptions.h>
+#include <FleetScheduler.h>
 #include <GlucoseServiceProfile.h>
-#include <fstream>
 #include <json/JsonEncoder.h>
+#include <Metrics.h>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <Reactor.h>
+#include <RecordEncoder.h>
+#include <ReplayPeripheral.h>
 #include <Scanner.h>
-#include <utils/CsvEncoder.h>
+#include <SessionRecording.h>
+#include <ShmRing.h>
+#include <SimulatedMeter.h>
+#include <Timeline.h>
+#include <Trace.h>
 #include <utils/Function.h>
-#include <utils/StrUtils.h>
 #include <version.h>
 #include <version-def.h>
 
@@ -30,22 +52,130 @@ using namespace rsp::utils;
 
 namespace rsp {
 
+/*
+ * Estimated memory per buffered record while streaming: the measurement, and its
+ * DynamicData tree and encoded text while the batch is written.
+ */
+static constexpr std::size_t cBufferedRecordSize = 2048;
+
+/*
+ * Lines the watch command holds while stdout is not keeping up. The oldest are dropped
+ * beyond this, so a stalled reader never makes the process grow.
+ */
+static constexpr std::size_t cWatchBufferLines = 1000;
+
+// Longest scan of a devices request to the daemon, in milliseconds
+static constexpr std::size_t cMaxScanTimeoutMs = 300000;
+
+// Records kept in a --sink=shm:<name> ring for readers that fall behind
+static constexpr std::uint32_t cShmRingCapacity = 4096;
+// Records handed to the ring at a time during a transfer
+static constexpr std::size_t cShmRingBatch = 64;
+
+// A byte count above 0, optionally followed by K, M or G.
+static std::size_t parseSize(const std::string &arOption, const std::string &arValue)
+{
+    std::size_t value = 0;
+    auto last = arValue.data() + arValue.size();
+    auto [end, error] = std::from_chars(arValue.data(), last, value);
+    std::size_t shift = 0;
+    if (error == std::errc() && end + 1 == last) {
+        switch (std::toupper(static_cast<unsigned char>(*end))) {
+            case 'K':
+                shift = 10;
+                break;
+            case 'M':
+                shift = 20;
+                break;
+            case 'G':
+                shift = 30;
+                break;
+            default:
+                break;
+        }
+        end += (shift > 0) ? 1 : 0;
+    }
+    if (error != std::errc() || end != last || value < 1 || value > (std::numeric_limits<std::size_t>::max() >> shift)) {
+        THROW_WITH_BACKTRACE1(EInvalidOption, arOption + "=" + arValue);
+    }
+    return value << shift;
+}
+
+static std::size_t parseCount(const std::string &arOption, const std::string &arValue)
+{
+    std::size_t value = 0;
+    auto [end, error] = std::from_chars(arValue.data(), arValue.data() + arValue.size(), value);
+    if (error != std::errc() || end != arValue.data() + arValue.size() || value < 1) {
+        THROW_WITH_BACKTRACE1(EInvalidOption, arOption + "=" + arValue);
+    }
+    return value;
+}
+
+// A factor above 0, or "max" for 0, replaying without delays.
+static double parseSpeed(const std::string &arOption, const std::string &arValue)
+{
+    if (arValue == "max") {
+        return 0.0;
+    }
+    double value = 0.0;
+    auto [end, error] = std::from_chars(arValue.data(), arValue.data() + arValue.size(), value);
+    if (error != std::errc() || end != arValue.data() + arValue.size() || !std::isfinite(value) || value <= 0.0) {
+        THROW_WITH_BACKTRACE1(EInvalidOption, arOption + "=" + arValue);
+    }
+    return value;
+}
+
 BleApplication::BleApplication(int argc, const char **argv)
     : ApplicationBase(argc, argv, "ble-dump")
 {
-    SignalHandler::Register(Signals::Terminate, [this]() { Terminate(0); });
+    // Before any threads are started, so they all leave SIGTERM to the signal thread.
+    Reactor::HandleTermination([this]() {
+        mStopServer = true;
+        Terminate(0);
+    });
 }
 
 BleApplication::~BleApplication()
 {
-    SignalHandler::Unregister(Signals::Terminate);
+    Reactor::RestoreTermination();
 }
 
 void BleApplication::beforeExecute()
 {
     ApplicationBase::beforeExecute();
+    Trace::InstallCrashHandler();
+    mVerboseTrace = mCmd.HasOption("-vv");
 
-    if (!SimpleBLE::Adapter::bluetooth_enabled()) {
+    std::string simulation;
+    if (mCmd.GetOptionValue("--simulate=", simulation)) {
+        mSimulation.emplace(simulation);
+    }
+    mCmd.GetOptionValue("--replay=", mReplayFile);
+    std::string speed;
+    if (mCmd.GetOptionValue("--replay-speed=", speed)) {
+        mReplaySpeed = parseSpeed("--replay-speed", speed);
+    }
+    mCmd.GetOptionValue("--record=", mRecordFile);
+    mCmd.GetOptionValue("--metrics=", mMetricsFile);
+    if (mCmd.GetOptionValue("--trace=", mTraceFile)) {
+        Timeline::SetThreadName("main");
+        Timeline::Get().Enable();
+    }
+    mShowStats = mCmd.HasOption("--stats");
+    std::string max_memory;
+    if (mCmd.GetOptionValue("--max-memory=", max_memory)) {
+        mMemoryCeiling = parseSize("--max-memory", max_memory);
+    }
+    AllocationStats::Enable(mShowStats);
+    std::string sink;
+    if (mCmd.GetOptionValue("--sink=", sink)) {
+        if (sink.rfind("shm:", 0) != 0 || sink.size() == 4) {
+            THROW_WITH_BACKTRACE1(EInvalidSink, sink);
+        }
+        mRing = std::make_unique<ShmRingWriter>(sink.substr(4), cShmRingCapacity);
+    }
+
+    if (usesBluetooth() && !SimpleBLE::Adapter::bluetooth_enabled()) {
         mLogger.Error() << "Bluetooth is not enabled";
         THROW_WITH_BACKTRACE(ENoBlueTooth);
     }
@@ -56,10 +186,25 @@ void BleApplication::beforeExecute()
     }
 
     mCmd.GetOptionValue("--device=", mDeviceMAC);
+
+    mEncoder = "csv";
+    mCmd.GetOptionValue("--encoder=", mEncoder);
+
+    mCacheDirectory = DeviceCache::DefaultDirectory();
+    mCmd.GetOptionValue("--cache-dir=", mCacheDirectory);
+    if (mCacheDirectory == "none") {
+        mCacheDirectory.clear();
+    }
+
+    std::string scan_filter;
+    if (mCmd.GetOptionValue("--scan-filter=", scan_filter)) {
+        mScanFilter = Scanner::DiscoveryFilter(scan_filter);
+    }
 }
 
 void BleApplication::afterExecute()
 {
+    mLogger.Debug() << "Reactor wake-ups: " << Reactor::Current().GetWakeups();
     ApplicationBase::afterExecute();
 }
 
@@ -67,29 +212,74 @@ void BleApplication::showHelp()
 {
     using namespace rsp::application;
     Console::Info() << ""
-       "Usage: ble-bump <options> <command>\n"
+       "Usage: ble-bump <options> <command>[,<command>...]\n"
+       "       ble-bump <options> session <command> [<command>...]\n"
        "  Options:\n"
        "    --adapter=<adapter name>        Name of the BlueTooth adapter to use. Defaults to first.\n"
+       "    --cache-dir=<directory|none>    Directory for cached device information.\n"
+       "                                    Defaults to ~/.cache/ble-dump\n"
        "    --device=<device address>       Address of BlueTooth device to connect to.\n"
+       "    --fields=<field,...>            Device information to show with the info command, defaults to all:\n"
+       "                                    system-id,model,serial,firmware,software,manufacturer,regulatory,pnp-id\n"
        "    --filename=<filename|auto>      Name of file to store device records into. Defaults to auto.\n"
        "    --encoder=<csv|json>            Output encoder type.\n"
+       "    --socket=<path>                 UNIX socket for the serve command.\n"
+       "                                    Defaults to $XDG_RUNTIME_DIR/ble-dump.sock\n"
+       "    --simulate=<options>            Use a simulated meter instead of Bluetooth. Comma separated options:\n"
+       "                                    records:<n>, rate:<notifications/s>, loss:<probability>,\n"
+       "                                    reorder:<probability>, disconnect:<notifications>, context:<every n>,\n"
+       "                                    live:<seconds>, seed:<n>, name:<name>, address:<address>, rssi:<dBm>\n"
+       "    --record=<filename>             Record all GATT traffic of the connection to a binary file.\n"
+       "    --replay=<filename>             Use a recording made with --record instead of Bluetooth.\n"
+       "    --replay-speed=<factor|max>     Replay speed relative to the recording. Defaults to 1.\n"
+       "    --metrics=<filename>            Save phase timings, record counts, bytes and retries when done.\n"
+       "                                    Prometheus text format for .prom and .txt files, otherwise JSON.\n"
+       "    --trace=<filename>              Save a timeline of the session in the Chrome trace event format,\n"
+       "                                    for chrome://tracing or https://ui.perfetto.dev\n"
+       "    --max-memory=<bytes>[k|M|G]     Stream records to the output file while dumping, keeping only\n"
+       "                                    as many in memory as fit in the given size.\n"
+       "    --sink=shm:<name>               Publish records to a POSIX shared memory ring instead of a file,\n"
+       "                                    for readers using bg_shm_reader_open(). The watch command writes\n"
+       "                                    to both stdout and the ring.\n"
+       "    --stats                         Count heap allocations in each phase and show them, per record\n"
+       "                                    and with the peak memory use, when done.\n"
+       "    --scan-filter=<filters>         Comma separated discovery filters applied by the\n"
+       "                                    Bluetooth stack: le, bredr, auto, rssi:<dBm>, uuid:<uuid>,\n"
+       "                                    duplicates or no-duplicates to report every or only\n"
+       "                                    changed advertisements.\n"
+       "                                    E.g. --scan-filter=le,rssi:-80,uuid:1808\n"
        "    -h                              Same as --help.\n"
        "    --help                          Show this help information.\n"
+       "    --keep-connected=<address,...>  Devices the serve command keeps connected between requests.\n"
+       "    --max-connections=<n>           Concurrent connections per adapter for fleet-dump. Defaults to 1.\n"
        "    --log=<filename|syslog>         Log output to file.\n"
        "    --loglevel=<[error|info|debug]> Set the log level for file logging,\n"
        "                                    default level is info.\n"
        "    --version                       Show version.\n"
        "    -v                              Increase verbosity level to Info.\n"
-       "    -vv                             Increase verbosity level to Debug.\n"
+       "    -vv                             Increase verbosity level to Debug, and log the raw attribute\n"
+       "                                    values traced during each command.\n"
        "\n"
        "Commands:\n"
        "    attributes                      List attributes for the device\n"
+       "    cgm-stream                      Stream measurements from a continuous glucose monitor to the\n"
+       "                                    output file until stopped, reconnecting and reading the records\n"
+       "                                    missed while disconnected\n"
        "    clear                           Clear all records on the device\n"
        "    devices                         List found BlueTooth devices\n"
        "    dump                            Dump records from the device in CSV format\n"
+       "    fleet-dump                      Dump records from all matching devices, using all adapters\n"
+       "                                    or those given as --adapter=<name>,<name>...\n"
        "    info                            Show general device information\n"
+       "    link-stats                      Show notification latency and rate histograms of the record\n"
+       "                                    transfers in the session, reading all records if there were none\n"
+       "    replay                          Dump records from the --replay recording, and show the throughput\n"
+       "    serve                           Run as daemon, answering NDJSON requests on a UNIX socket\n"
+       "    session <commands>              Run several commands in order over one connection\n"
        "    sync-time                       Synchronize the device time with this host\n"
        "    time                            Show the current time in the device\n"
+       "    watch                           Stay connected, or reconnect when the device advertises, and write\n"
+       "                                    each new measurement with its context as a JSON line to stdout\n"
        << std::endl;
 
     auto adapters = SimpleBLE::Adapter::get_adapters();
@@ -120,181 +310,985 @@ void BleApplication::handleOptions()
 
 void BleApplication::execute()
 {
-    auto cmd = mCmd.GetCommands()[0];
-    if (cmd == "devices") {
-        devicesCommand();
-    }
-    else if (cmd == "dump") {
-        dumpCommand();
-    }
-    else if (cmd == "clear") {
-        clearCommand();
+    auto commands = getCommandList();
+    // All of the list is checked first, so a typo late in it does not leave the earlier commands done.
+    for (auto &cmd : commands) {
+        if (!findCommand(cmd)) {
+            showHelp();
+            THROW_WITH_BACKTRACE1(EUnknownCommand, cmd);
+        }
     }
-    else if (cmd == "attributes") {
-        attributesCommand();
+    try {
+        for (auto &cmd : commands) {
+            executeCommand(cmd);
+            if (mVerboseTrace) {
+                mLogger.Debug() << "Trace of " << cmd << ":\n" << traceSinceLastDump();
+            }
+        }
     }
-    else if (cmd == "info") {
-        infoCommand();
+    catch (...) {
+        mLogger.Info() << "Trace before failure:\n" << traceSinceLastDump();
+        closeSession();
+        Metrics::Get().Count("command_failures");
+        showAllocationStats();
+        saveMetrics();
+        saveTimeline();
+        throw;
     }
-    else if (cmd == "time") {
-        timeCommand();
+    closeSession();
+    showAllocationStats();
+    saveMetrics();
+    saveTimeline();
+    Terminate(cResultSuccess);
+}
+
+std::vector<std::string> BleApplication::getCommandList()
+{
+    // Commands can be given as "session <cmd> <cmd>..." or as a comma separated list "<cmd>,<cmd>".
+    std::vector<std::string> result;
+    for (auto &arg : mCmd.GetCommands()) {
+        auto list = splitList(arg);
+        result.insert(result.end(), list.begin(), list.end());
     }
-    else if (cmd == "sync-time") {
-        syncTimeCommand();
+    if (!result.empty() && result.front() == "session") {
+        result.erase(result.begin());
     }
-    else {
-        showHelp();
+    return result;
+}
+
+BleApplication::CommandHandler BleApplication::findCommand(const std::string &arCommand)
+{
+    static const std::map<std::string, CommandHandler> commands = {
+        {"devices", &BleApplication::devicesCommand},
+        {"dump", &BleApplication::dumpCommand},
+        {"fleet-dump", &BleApplication::fleetDumpCommand},
+        {"clear", &BleApplication::clearCommand},
+        {"attributes", &BleApplication::attributesCommand},
+        {"info", &BleApplication::infoCommand},
+        {"time", &BleApplication::timeCommand},
+        {"sync-time", &BleApplication::syncTimeCommand},
+        {"serve", &BleApplication::serveCommand},
+        {"replay", &BleApplication::replayCommand},
+        {"link-stats", &BleApplication::linkStatsCommand},
+        {"watch", &BleApplication::watchCommand},
+        {"cgm-stream", &BleApplication::cgmStreamCommand}
+    };
+    auto it = commands.find(arCommand);
+    return (it == commands.end()) ? nullptr : it->second;
+}
+
+bool BleApplication::executeCommand(const std::string &arCommand)
+{
+    auto handler = findCommand(arCommand);
+    if (!handler) {
+        return false;
     }
-    Terminate(cResultSuccess);
+    mLogger.Debug() << "Executing command: " << arCommand;
+    Metrics::SetLabel("command", arCommand);
+    auto timer = Metrics::Get().Time("command");
+    (this->*handler)();
+    return true;
 }
 
-SimpleBLE::Adapter BleApplication::getAdapter()
+SimpleBLE::Adapter& BleApplication::getAdapter()
 {
+    if (mAdapter) {
+        return *mAdapter;
+    }
+
     std::string option_value;
+    auto timer = Metrics::Get().Time("adapter_enumeration");
     auto adapters = SimpleBLE::Adapter::get_adapters();
+    timer.Stop();
+    auto it = adapters.begin();
     if (mCmd.GetOptionValue("--adapter=", option_value)) {
-        auto f = [&](SimpleBLE::Adapter &arAdapter) {
+        it = std::find_if(adapters.begin(), adapters.end(), [&](SimpleBLE::Adapter &arAdapter) {
             return ((arAdapter.address() == option_value) || (arAdapter.identifier() == option_value));
-        };
-        auto it = std::find_if(adapters.begin(), adapters.end(), f);
-        if (it != adapters.end()) {
-            return *it;
-        }
+        });
     }
-    else if (!adapters.empty()) {
-        return adapters[0];
+    if (it != adapters.end()) {
+        Metrics::SetLabel("adapter", it->identifier());
+        return mAdapter.emplace(*it);
     }
 
     showHelp();
     THROW_WITH_BACKTRACE(ENoAdapter);
 }
 
-TrustedDevice BleApplication::getDevice(SimpleBLE::Adapter &arAdapter)
+TrustedDevice& BleApplication::getDevice()
 {
-    if (mDeviceMAC.empty()) {
+    if (mDevice) {
+        return *mDevice;
+    }
+
+    mDevice = connect(mDeviceMAC);
+    return *mDevice;
+}
+
+std::unique_ptr<TrustedDevice> BleApplication::connect(const std::string &arAddress)
+{
+    if (!mReplayFile.empty()) {
+        // A replay only knows the recorded attributes, they must not end up in the cache.
+        return makeDevice(std::make_shared<ReplayPeripheral>(mReplayFile, mReplaySpeed), {});
+    }
+    if (mSimulation) {
+        return makeDevice(std::make_shared<SimulatedMeter>(*mSimulation), mCacheDirectory);
+    }
+
+    if (arAddress.empty()) {
         THROW_WITH_BACKTRACE(ENoDevice);
     }
 
-    Scanner s(arAdapter, mDeviceMAC);
+    // Devices seen by an earlier scan are connected to directly, saving the scan.
+    auto it = mKnownPeripherals.find(arAddress);
+    if (it != mKnownPeripherals.end()) {
+        try {
+            return makeDevice(std::make_shared<SimpleBlePeripheral>(it->second), mCacheDirectory);
+        }
+        catch (const std::exception &e) {
+            mLogger.Info() << "Cached peripheral " << arAddress << " failed, scanning again: " << e.what();
+            Metrics::Get().Count("connect_retries");
+            mKnownPeripherals.erase(it);
+        }
+    }
+
+    Scanner s(getAdapter(), arAddress);
+    s.SetDiscoveryFilter(mScanFilter);
     if (s.RunUntilFound(30000)) {
-        return TrustedDevice(s.GetResult().front());
+        auto peripheral = s.GetResult().front();
+        mKnownPeripherals.insert_or_assign(peripheral.address(), peripheral);
+        return makeDevice(std::make_shared<SimpleBlePeripheral>(peripheral), mCacheDirectory);
     }
 
     THROW_WITH_BACKTRACE(EDeviceNotFound);
 }
 
+std::unique_ptr<TrustedDevice> BleApplication::makeDevice(std::shared_ptr<GattPeripheral> aPeripheral, const std::string &arCacheDirectory)
+{
+    Metrics::SetLabel("device", aPeripheral->Identifier());
+    if (Timeline::IsEnabled()) {
+        aPeripheral = std::make_shared<TimelinePeripheral>(std::move(aPeripheral));
+    }
+    if (!mRecordFile.empty()) {
+        mLogger.Info() << "Recording GATT traffic to " << mRecordFile;
+        aPeripheral = std::make_shared<RecordingPeripheral>(std::move(aPeripheral), mRecordFile);
+    }
+    return std::make_unique<TrustedDevice>(std::move(aPeripheral), arCacheDirectory);
+}
+
+GlucoseServiceProfile& BleApplication::getGlucoseService()
+{
+    if (!mGlucoseService) {
+        mGlucoseService = std::make_unique<GlucoseServiceProfile>(getDevice(), &mArena);
+    }
+    return *mGlucoseService;
+}
+
+void BleApplication::closeSession()
+{
+    // Profiles unsubscribe on destruction, so they must go before the connection.
+    mGlucoseService.reset();
+    mDevice.reset();
+    mHeldDevices.clear();
+    if (mArena.GetPeakBytes()) {
+        mLogger.Debug() << "Session arena peak: " << mArena.GetPeakBytes() << " bytes";
+    }
+    mArena.Release();
+}
+
 void BleApplication::devicesCommand()
 {
-    auto adapter = getAdapter();
-    Scanner s(adapter, mDeviceMAC);
+    if (mSimulation) {
+        mLogger.Notice() << "Found device: " << mSimulation->mName << " [" << mSimulation->mAddress << "] " << mSimulation->mRssi << " dBm";
+        return;
+    }
+    Scanner s(getAdapter(), mDeviceMAC);
+    s.SetDiscoveryFilter(mScanFilter);
     s.RunFor(30000);
 }
 
 void BleApplication::dumpCommand()
 {
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    GlucoseServiceProfile gls(device);
-    mLogger.Notice() << "Reading measurement records from " << device.GetPeripheral().identifier() << " [" << device.GetPeripheral().address() << "]";
-    auto &recs = gls.ReadAllMeasurements();
-    DynamicData dd;
-    dd << recs;
+    auto &device = getDevice();
+    auto &gls = getGlucoseService();
+    mLogger.Notice() << "Reading measurement records from " << device.GetPeripheral().Identifier() << " [" << device.GetPeripheral().Address() << "]";
+    dumpRecords(gls, getFileName(device));
+}
+
+void BleApplication::fleetDumpCommand()
+{
+    std::vector<SimpleBLE::Adapter> adapters;
+    std::string option_value;
+    auto timer = Metrics::Get().Time("adapter_enumeration");
+    auto all = SimpleBLE::Adapter::get_adapters();
+    timer.Stop();
+    if (mCmd.GetOptionValue("--adapter=", option_value)) {
+        auto names = splitList(option_value);
+        std::copy_if(all.begin(), all.end(), std::back_inserter(adapters), [&](SimpleBLE::Adapter &arAdapter) {
+            return std::find_if(names.begin(), names.end(), [&](const std::string &arName) {
+                return (arAdapter.address() == arName) || (arAdapter.identifier() == arName);
+            }) != names.end();
+        });
+    }
+    else {
+        adapters = all;
+    }
+    if (adapters.empty()) {
+        showHelp();
+        THROW_WITH_BACKTRACE(ENoAdapter);
+    }
+
+    std::size_t max_connections = 1;
+    if (mCmd.GetOptionValue("--max-connections=", option_value)) {
+        max_connections = parseCount("--max-connections", option_value);
+    }
+
+    // Never connect to everything in range, default to devices advertising the Glucose service.
+    auto discovery_filter = mScanFilter;
+    if (mDeviceMAC.empty() && discovery_filter.mServiceUuids.empty()) {
+        discovery_filter.mServiceUuids.push_back(uuid::ToFullString(uuid::Identifiers::GlucoseService));
+    }
+
+    FleetScheduler scheduler(adapters, max_connections);
+    scheduler.SetAcceptFilter(splitList(mDeviceMAC)).SetDiscoveryFilter(discovery_filter);
+    auto results = scheduler.Run(30000, [this](SimpleBLE::Peripheral &arPeripheral) {
+        std::shared_ptr<GattPeripheral> peripheral = std::make_shared<SimpleBlePeripheral>(arPeripheral);
+        if (Timeline::IsEnabled()) {
+            peripheral = std::make_shared<TimelinePeripheral>(std::move(peripheral));
+        }
+        TrustedDevice device(peripheral, mCacheDirectory);
+        GlucoseServiceProfile gls(device);
+        // A single file name option would be overwritten by every device, and names need not be unique.
+        auto address = arPeripheral.address();
+        address.erase(std::remove(address.begin(), address.end(), ':'), address.end());
+        dumpRecords(gls, arPeripheral.identifier() + "-" + address + "-" + DateTime().ToString("%Y%m%d%H%M%S") + "." + mEncoder);
+    });
+
+    std::size_t failed = 0;
+    for (auto &result : results) {
+        mLogger.Notice() << (result.mSuccess ? "OK     " : "FAILED ") << result.mIdentifier << " [" << result.mAddress << "] via "
+                         << result.mAdapter << " in " << result.mDuration.count() << " ms " << result.mError;
+        failed += result.mSuccess ? 0 : 1;
+    }
+    mLogger.Notice() << "Dumped " << (results.size() - failed) << " of " << results.size() << " devices using " << adapters.size() << " adapters";
+}
+
+std::vector<std::string> BleApplication::splitList(const std::string &arList)
+{
+    std::vector<std::string> result;
+    std::istringstream in(arList);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
 
-    std::string file_name = getFileName(device);
-    mLogger.Notice() << "Writing " << recs.size() << " records to " << file_name;
+void BleApplication::dumpRecords(GlucoseServiceProfile &arGls, const std::string &arFileName)
+{
+    if (mRing) {
+        publishRecords(arGls);
+    }
+    else if (mMemoryCeiling) {
+        streamRecords(arGls, arFileName);
+    }
+    else {
+        writeRecords(arFileName, arGls.ReadAllMeasurements());
+    }
+}
+
+void BleApplication::publishRecords(GlucoseServiceProfile &arGls)
+{
+    mLogger.Notice() << "Publishing records to the shared memory ring";
+    auto before = mRing->GetWritten();
+    auto id = arGls.Subscribe([this](const GlucoseServiceProfile::GlucoseMeasurement &arRecord, const GlucoseServiceProfile::RecordBatch&) {
+        mRing->Write(arRecord);
+    });
+    arGls.SetBatchSize(cShmRingBatch);
+    try {
+        arGls.ReadAllMeasurements();
+    }
+    catch (...) {
+        arGls.Unsubscribe(id).SetBatchSize(0);
+        throw;
+    }
+    arGls.Unsubscribe(id).SetBatchSize(0);
+    Metrics::Get().Count("records_written", mRing->GetWritten() - before);
+}
+
+void BleApplication::streamRecords(GlucoseServiceProfile &arGls, const std::string &arFileName)
+{
+    auto max_records = std::max<std::size_t>(mMemoryCeiling / cBufferedRecordSize, 1);
+    mLogger.Notice() << "Streaming records to " << arFileName << ", " << max_records << " at a time";
     std::ofstream file;
     file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-    file.open(file_name, std::ios::out | std::ios::trunc);
-    if (mEncoder == "csv") {
-        saveToCsv(file, dd);
+    file.open(arFileName, std::ios::out | std::ios::trunc);
+    Metrics::Clock::duration encode{};
+    Metrics::Clock::duration io{};
+    std::uint64_t bytes = 0;
+    std::uint64_t records = 0;
+    {
+        TimedStreamBuffer buffer(*file.rdbuf(), "file_write");
+        std::ostream out(&buffer);
+        out.exceptions(std::ostream::failbit | std::ostream::badbit);
+        RecordWriter writer(out, mEncoder);
+        // The sink runs on the Bluetooth callback thread, errors are raised when the transfer is done.
+        std::exception_ptr error;
+        arGls.SetRecordSink(max_records, [&](std::span<const GlucoseServiceProfile::GlucoseMeasurement> aRecords) {
+            if (error) {
+                return;
+            }
+            auto start = Metrics::Clock::now();
+            AllocationStats::PhaseScope allocations("encode");
+            Timeline::Scope scope("Encode", "io", {{"records", std::to_string(aRecords.size())}, {"encoder", mEncoder}});
+            try {
+                for (auto &record : aRecords) {
+                    DynamicData dd;
+                    dd << record;
+                    writer.Add(dd);
+                }
+                writer.Flush();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            encode += Metrics::Clock::now() - start;
+        });
+        try {
+            arGls.ReadAllMeasurements();
+        }
+        catch (...) {
+            arGls.SetRecordSink(0, {});
+            throw;
+        }
+        arGls.SetRecordSink(0, {});
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        writer.Finish();
+        out.flush();
+        io = buffer.GetElapsed();
+        bytes = buffer.GetCount();
+        records = writer.GetCount();
     }
-    else {
-        saveToJson(file, dd);
+    file.close();
+
+    auto &metrics = Metrics::Get();
+    metrics.AddTime("encode", encode - std::min(encode, io));
+    metrics.Count("records_written", records);
+    metrics.Count("bytes_written", bytes);
+}
+
+void BleApplication::writeRecords(const std::string &arFileName, std::span<const GlucoseServiceProfile::GlucoseMeasurement> aRecords)
+{
+    auto start = Metrics::Clock::now();
+    AllocationStats::PhaseScope allocations("encode");
+    DynamicData dd;
+    dd << aRecords;
+
+    mLogger.Notice() << "Writing " << aRecords.size() << " records to " << arFileName;
+    std::ofstream file;
+    file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    file.open(arFileName, std::ios::out | std::ios::trunc);
+    Metrics::Clock::duration io{};
+    std::uint64_t bytes = 0;
+    {
+        // Encoding streams into the file, the buffer tells the time spent writing apart.
+        Timeline::Scope scope("Encode", "io", {{"records", std::to_string(aRecords.size())}, {"encoder", mEncoder}});
+        TimedStreamBuffer buffer(*file.rdbuf(), "file_write");
+        std::ostream out(&buffer);
+        out.exceptions(std::ostream::failbit | std::ostream::badbit);
+        RecordEncoder::Save(out, dd, mEncoder);
+        out.flush();
+        io = buffer.GetElapsed();
+        bytes = buffer.GetCount();
     }
     file.close();
+
+    auto &metrics = Metrics::Get();
+    metrics.AddTime("encode", Metrics::Clock::now() - start - io);
+    metrics.Count("records_written", aRecords.size());
+    metrics.Count("bytes_written", bytes);
+}
+
+void BleApplication::replayCommand()
+{
+    if (mReplayFile.empty()) {
+        THROW_WITH_BACKTRACE(ENoRecording);
+    }
+    using Clock = std::chrono::steady_clock;
+    auto replay = std::make_shared<ReplayPeripheral>(mReplayFile, mReplaySpeed);
+    // Loading the recording is not part of the throughput.
+    auto start = Clock::now();
+    auto device = makeDevice(replay, {});
+    GlucoseServiceProfile gls(*device);
+    auto &recs = gls.ReadAllMeasurements();
+    auto decoded = Clock::now();
+    writeRecords(getFileName(*device), recs);
+    auto encoded = Clock::now();
+
+    auto us = [](Clock::duration aDuration) { return std::chrono::duration_cast<std::chrono::microseconds>(aDuration).count(); };
+    mLogger.Notice() << "Replayed " << replay->GetNotificationsReplayed() << " notifications (" << replay->GetBytesReplayed() << " bytes) into "
+                     << recs.size() << " records in " << us(decoded - start) << " us, encoded in " << us(encoded - decoded) << " us";
+    mLogger.Notice() << "Throughput: " << std::uint64_t(double(recs.size()) * 1e6 / double(std::max<std::int64_t>(us(encoded - start), 1))) << " records/s";
+}
+
+void BleApplication::linkStatsCommand()
+{
+    auto &device = getDevice();
+    auto &gls = getGlucoseService();
+    if (gls.GetLinkStats().GetCompletionLatency().GetCount() == 0) {
+        mLogger.Notice() << "Reading measurement records from " << device.GetPeripheral().Identifier() << " [" << device.GetPeripheral().Address() << "]";
+        gls.ReadAllMeasurements();
+    }
+    mLogger.Notice() << gls.GetLinkStats();
+}
+
+void BleApplication::watchCommand()
+{
+    using GlucoseMeasurement = GlucoseServiceProfile::GlucoseMeasurement;
+    std::mutex mutex;
+    std::deque<std::string> lines;
+    std::uint64_t dropped = 0;
+    std::optional<std::uint16_t> last_seq_no;
+    // Sequence numbers passed on in this session. Live records may arrive in the middle of the
+    // backfill after a reconnect, or also be reported by the read of the last stored record.
+    std::set<std::uint16_t> written;
+    // Records received while the last stored record is read, until it is known which one that is
+    bool holding = false;
+    std::vector<GlucoseMeasurement> held;
+    auto &reactor = Reactor::Current();
+
+    // Called with the mutex held.
+    auto pass_on = [&](const GlucoseMeasurement &arRecord) {
+        written.insert(arRecord.mSequenceNo);
+        DynamicData dd;
+        dd << arRecord;
+        if (lines.size() >= cWatchBufferLines) {
+            lines.pop_front();
+            dropped++;
+        }
+        lines.push_back(json::JsonEncoder(false).Encode(dd));
+        if (mRing) {
+            mRing->Write(arRecord);
+        }
+        // Sequence numbers wrap around, a record is newer when less than half the range ahead.
+        if (!last_seq_no || std::int16_t(arRecord.mSequenceNo - *last_seq_no) > 0) {
+            last_seq_no = arRecord.mSequenceNo;
+        }
+    };
+
+    // Called on the Bluetooth callback thread as soon as a record and its context are complete.
+    auto sink = [&](std::span<const GlucoseMeasurement> aRecords) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &record : aRecords) {
+                if (written.contains(record.mSequenceNo)) {
+                    continue;
+                }
+                if (holding) {
+                    held.push_back(record);
+                }
+                else {
+                    pass_on(record);
+                }
+            }
+        }
+        reactor.Wake();
+    };
+    auto write_lines = [&]() {
+        std::deque<std::string> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.swap(lines);
+            if (dropped) {
+                mLogger.Warning() << "Output is not keeping up, dropped " << dropped << " measurements";
+                Metrics::Get().Count("watch_dropped", dropped);
+                dropped = 0;
+            }
+        }
+        for (auto &line : pending) {
+            std::cout << line << '\n';
+        }
+        if (!pending.empty()) {
+            std::cout.flush();
+            Metrics::Get().Count("records_written", pending.size());
+        }
+    };
+
+    bool connected = false;
+    mStopServer = false;
+    while (!mStopServer) {
+        try {
+            auto &device = getDevice();
+            auto &gls = getGlucoseService();
+            std::optional<std::uint16_t> from;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (last_seq_no) {
+                    from = std::uint16_t(*last_seq_no + 1);
+                }
+            }
+            if (!connected) {
+                std::lock_guard<std::mutex> lock(mutex);
+                holding = true;
+            }
+            // Before any read, so no measurement taken meanwhile is missed
+            gls.SetRecordSink(1, sink);
+            if (!connected) {
+                // Only measurements taken from now on are of interest, those stored are skipped.
+                // The stored one is the oldest received, those taken during the read are newer.
+                gls.ReadLastMeasurement();
+                std::lock_guard<std::mutex> lock(mutex);
+                auto stored = std::min_element(held.begin(), held.end(), [](const GlucoseMeasurement &arLeft, const GlucoseMeasurement &arRight) {
+                    return std::int16_t(arLeft.mSequenceNo - arRight.mSequenceNo) < 0;
+                });
+                last_seq_no = 0;
+                if (stored != held.end()) {
+                    last_seq_no = stored->mSequenceNo;
+                    written.insert(stored->mSequenceNo);
+                }
+                for (auto &record : held) {
+                    if (!written.contains(record.mSequenceNo)) {
+                        pass_on(record);
+                    }
+                }
+                held.clear();
+                holding = false;
+            }
+            else {
+                // Those taken while disconnected
+                gls.ReadMeasurementsFrom(*from);
+            }
+            mLogger.Notice() << "Watching for new measurements on " << device.GetPeripheral().Identifier() << " [" << device.GetPeripheral().Address() << "]";
+            connected = true;
+
+            while (!mStopServer && device.GetPeripheral().IsConnected()) {
+                reactor.WaitUntil(std::chrono::milliseconds(1000), [&]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return mStopServer || !lines.empty();
+                });
+                write_lines();
+            }
+        }
+        catch (const std::exception &e) {
+            // Setup errors are reported, later the device is waited for until it advertises again.
+            if (!connected) {
+                throw;
+            }
+            mLogger.Info() << "Waiting for device: " << e.what();
+        }
+        write_lines();
+        if (!mStopServer) {
+            mLogger.Info() << "Disconnected, reconnecting when the device advertises";
+            Metrics::Get().Count("watch_reconnects");
+            closeSession();
+            reactor.WaitUntil(std::chrono::milliseconds(1000), [this]() { return bool(mStopServer); });
+        }
+    }
+    if (mGlucoseService) {
+        mGlucoseService->SetRecordSink(0, {});
+    }
+}
+
+void BleApplication::cgmStreamCommand()
+{
+    std::mutex mutex;
+    std::ofstream file;
+    std::optional<RecordWriter> writer;
+    // Time offsets written in this session. Live records may arrive in the middle of the backfill,
+    // so records are skipped by offset rather than by being older than the last one written.
+    std::set<std::uint16_t> written;
+    // Where the backfill after a reconnect starts, only moved on by records known to be in order
+    std::optional<std::uint16_t> last_offset;
+    bool backfilling = false;
+    std::int64_t session_start = EpochTime::cUnknown;
+    std::exception_ptr error;
+
+    // Called on the Bluetooth callback thread for stored and live records alike.
+    auto on_measurement = [&](const CgmServiceProfile::Measurement &arRecord) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error || written.contains(arRecord.mTimeOffset)) {
+            return;
+        }
+        try {
+            DynamicData dd;
+            dd << arRecord;
+            writer->Add(dd);
+            writer->Flush();
+            file.flush();
+            written.insert(arRecord.mTimeOffset);
+            if (!backfilling) {
+                last_offset = arRecord.mTimeOffset;
+            }
+            Metrics::Get().Count("records_written");
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+    };
+
+    bool connected = false;
+    mStopServer = false;
+    while (!mStopServer) {
+        try {
+            auto &device = getDevice();
+            CgmServiceProfile cgm(device);
+            if (!writer) {
+                auto filename = getFileName(device);
+                mLogger.Notice() << "Streaming CGM measurements from " << device.GetPeripheral().Identifier() << " [" << device.GetPeripheral().Address() << "] to " << filename;
+                file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+                file.open(filename, std::ios::out | std::ios::trunc);
+                writer.emplace(file, mEncoder);
+            }
+
+            auto start = cgm.GetSessionStartTime();
+            std::optional<std::uint16_t> from;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                // Time offsets start over with a new session
+                if (start.UtcSeconds() != session_start) {
+                    session_start = start.UtcSeconds();
+                    written.clear();
+                    last_offset.reset();
+                }
+                if (last_offset) {
+                    from = *last_offset + 1;
+                }
+                backfilling = true;
+            }
+            mLogger.Notice() << start << ", run time " << cgm.GetSessionRunTime() << " hours";
+
+            cgm.OnMeasurement(on_measurement);
+            auto count = cgm.ReadMeasurements(from);
+            mLogger.Info() << "Read " << count << " stored records";
+            {
+                // The stored records are all in, including any the live ones overtook.
+                std::lock_guard<std::mutex> lock(mutex);
+                backfilling = false;
+                if (!written.empty()) {
+                    last_offset = *written.rbegin();
+                }
+            }
+            connected = true;
+
+            while (!mStopServer && !error && device.GetPeripheral().IsConnected()) {
+                Reactor::Current().WaitUntil(std::chrono::milliseconds(1000), [this]() { return bool(mStopServer); });
+            }
+            cgm.OnMeasurement({});
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        catch (const std::exception &e) {
+            // Only a working setup is kept running, errors before the first records are reported.
+            if (!connected || error) {
+                throw;
+            }
+            mLogger.Warning() << "CGM stream interrupted: " << e.what();
+        }
+        if (!mStopServer) {
+            mLogger.Warning() << "Connection lost, reconnecting in 5 seconds";
+            Metrics::Get().Count("cgm_reconnects");
+            closeSession();
+            Reactor::Current().WaitUntil(std::chrono::milliseconds(5000), [this]() { return bool(mStopServer); });
+        }
+    }
+
+    if (writer) {
+        writer->Finish();
+        file.close();
+        mLogger.Notice() << "Wrote " << writer->GetCount() << " CGM measurements";
+    }
 }
 
 void BleApplication::clearCommand()
 {
     using namespace rsp::application;
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    GlucoseServiceProfile gls(device);
-    auto count = gls.GetMeasurementsCount();
-    mLogger.Warning() << "Deleting " << count << " measurement records from " << device.GetPeripheral().address();
-    gls.ClearAllMeasurements();
+    auto &device = getDevice();
+    auto &gls = getGlucoseService();
+    // The RACP responses are awaited by coroutines, without holding a thread.
+    Executor executor;
+    auto count = executor.SyncWait(gls.GetMeasurementsCountAsync(executor));
+    mLogger.Warning() << "Deleting " << count << " measurement records from " << device.GetPeripheral().Address();
+    executor.SyncWait(gls.ClearAllMeasurementsAsync(executor));
 }
 
 void BleApplication::attributesCommand()
 {
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    mLogger.Notice() << device;
+    mLogger.Notice() << getDevice();
 }
 
 void BleApplication::infoCommand()
 {
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    DeviceInformationServiceProfile dis(device);
+    DeviceInformationServiceProfile dis(getDevice());
+    std::string option_value;
+    if (mCmd.GetOptionValue("--fields=", option_value)) {
+        dis.Prefetch(infoFields(option_value));
+    }
+    else {
+        dis.Prefetch();
+    }
     mLogger.Notice() << dis;
 }
 
+std::vector<uuid::Identifiers> BleApplication::infoFields(const std::string &arList)
+{
+    const struct {
+        const char *name;
+        uuid::Identifiers id;
+    } cFields[] {
+        { "system-id", uuid::Identifiers::SystemId },
+        { "model", uuid::Identifiers::ModelNumberString },
+        { "serial", uuid::Identifiers::SerialNumberString },
+        { "firmware", uuid::Identifiers::FirmwareRevisionString },
+        { "software", uuid::Identifiers::SoftwareRevisionString },
+        { "manufacturer", uuid::Identifiers::ManufacturerNameString },
+        { "regulatory", uuid::Identifiers::Ieee1107320601RegulatoryCertificationDataList },
+        { "pnp-id", uuid::Identifiers::PnpId }
+    };
+
+    std::vector<uuid::Identifiers> result;
+    for (auto &name : splitList(arList)) {
+        auto it = std::find_if(std::begin(cFields), std::end(cFields), [&name](auto &arField) { return name == arField.name; });
+        if (it == std::end(cFields)) {
+            THROW_WITH_BACKTRACE1(EInvalidOption, "--fields=" + name);
+        }
+        result.push_back(it->id);
+    }
+    return result;
+}
+
 void BleApplication::timeCommand()
 {
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    CurrentTimeServiceProfile cts(device);
+    CurrentTimeServiceProfile cts(getDevice());
     mLogger.Notice() << cts;
 }
 
 void BleApplication::syncTimeCommand()
 {
-    auto adapter = getAdapter();
-    auto device = getDevice(adapter);
-    CurrentTimeServiceProfile cts(device);
+    CurrentTimeServiceProfile cts(getDevice());
     cts.SetTime(DateTime::Now());
     mLogger.Notice() << cts;
 }
 
-std::string BleApplication::getFileName(TrustedDevice &arDevice)
+void BleApplication::serveCommand()
 {
-    std::string filename = "auto";
-    mCmd.GetOptionValue("--filename=", filename);
-    mEncoder = "csv";
-    mCmd.GetOptionValue("--encoder=", mEncoder);
+    std::string socket_path;
+    if (!mCmd.GetOptionValue("--socket=", socket_path)) {
+        const char *runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+        socket_path = std::string(runtime_dir ? runtime_dir : "/tmp") + "/ble-dump.sock";
+    }
+    std::string option_value;
+    if (mCmd.GetOptionValue("--keep-connected=", option_value)) {
+        mKeepConnected = splitList(option_value);
+    }
 
-    if(filename == "auto") {
-        filename = arDevice.GetPeripheral().identifier() + "-" + DateTime().ToString("%Y%m%d%H%M%S") + "." + mEncoder;
+    // Initialize the adapter once, it is then shared by all requests.
+    if (usesBluetooth()) {
+        getAdapter();
     }
-    return filename;
+
+    mStopServer = false;
+    DaemonServer server(socket_path);
+    server.Run([this](const DaemonServer::Request &arRequest, DaemonServer::Responder &arResponder) {
+        handleRequest(arRequest, arResponder);
+    }, mStopServer);
 }
 
-void BleApplication::saveToCsv(std::ostream &o, const DynamicData &arData)
+void BleApplication::handleRequest(const DaemonServer::Request &arRequest, DaemonServer::Responder &arResponder)
 {
-    CsvEncoder csv(true, ';');
-    csv.SetValueFormatter([](std::string &arResult, const DynamicData &arValue) -> bool {
-        if (arValue.AsString() == "HbA1c") {
-            arResult = arValue.AsString();
-            return true;
+    auto value = [&arRequest](const std::string &arKey, const std::string &arDefault = {}) {
+        return arRequest.MemberExists(arKey) ? arRequest[arKey].AsString() : arDefault;
+    };
+    auto id = value("id");
+    auto cmd = value("cmd");
+    auto address = value("device", mDeviceMAC);
+    mLogger.Info() << "Request " << id << ": " << cmd << " " << address;
+    Metrics::LabelScope labels({{"command", cmd}});
+    auto timer = Metrics::Get().Time("request");
+
+    DynamicData response;
+    response.Add("id", id);
+    try {
+        if (cmd == "devices") {
+            Scanner s(getAdapter(), "");
+            s.SetDiscoveryFilter(mScanFilter);
+            auto timeout = parseCount("timeout", value("timeout", "5000"));
+            if (timeout > cMaxScanTimeoutMs) {
+                THROW_WITH_BACKTRACE1(EInvalidOption, "timeout=" + value("timeout"));
+            }
+            s.RunFor(std::uint32_t(timeout));
+            for (auto peripheral : s.GetResult()) {
+                mKnownPeripherals.insert_or_assign(peripheral.address(), peripheral);
+                DynamicData line;
+                line.Add("id", id).Add("identifier", peripheral.identifier()).Add("address", peripheral.address()).Add("rssi", peripheral.rssi());
+                arResponder.Send(line);
+            }
         }
-        else if (arValue.GetType() == Variant::Types::Float) {
-            arResult = StrUtils::ToString(arValue.AsFloat(), 1, true);
-            return true;
+        else if (cmd == "dump" || cmd == "info" || cmd == "time" || cmd == "sync-time") {
+            std::unique_ptr<TrustedDevice> connection;
+            auto &device = requestDevice(address, value("keep") == "true", connection);
+            if (cmd == "dump") {
+                GlucoseServiceProfile gls(device);
+                auto &recs = gls.ReadAllMeasurements();
+                for (auto &rec : recs) {
+                    DynamicData record;
+                    record << rec;
+                    DynamicData line;
+                    line.Add("id", id).Add("record", record);
+                    arResponder.Send(line);
+                }
+                response.Add("count", int(recs.size()));
+            }
+            else if (cmd == "info") {
+                DeviceInformationServiceProfile dis(device);
+                auto fields = value("fields");
+                if (fields.empty()) {
+                    dis.Prefetch();
+                }
+                else {
+                    dis.Prefetch(infoFields(fields));
+                }
+                // Reuse the text presentation, one "Name: value" per line.
+                std::stringstream text;
+                text << dis;
+                DynamicData info;
+                std::string line;
+                while (std::getline(text, line)) {
+                    auto pos = line.find(": ");
+                    if (pos != std::string::npos) {
+                        info.Add(line.substr(0, pos), line.substr(pos + 2));
+                    }
+                }
+                response.Add("info", info);
+            }
+            else {
+                CurrentTimeServiceProfile cts(device);
+                if (cmd == "sync-time") {
+                    cts.SetTime(DateTime::Now());
+                }
+                response.Add("time", cts.GetTime().ToISO8601UTC());
+            }
         }
-        else if (arValue.IsNull()) {
-            arResult = "";
-            return true;
+        else {
+            THROW_WITH_BACKTRACE1(EUnknownRequest, cmd);
         }
-        arResult = arValue.AsString();
-        return false;
-    }).Encode(o, arData);
+        response.Add("status", "ok");
+    }
+    catch (const std::exception &e) {
+        mLogger.Warning() << "Request " << id << " failed: " << e.what();
+        response.Add("status", "error").Add("error", std::string(e.what()));
+    }
+    arResponder.Send(response);
+    if (mVerboseTrace) {
+        mLogger.Debug() << "Trace of request " << id << ":\n" << traceSinceLastDump();
+    }
 }
 
-void BleApplication::saveToJson(std::ostream &o, const DynamicData &arData)
+std::string BleApplication::traceSinceLastDump()
 {
-    json::JsonEncoder json(true);
-    o << json.Encode(arData);
+    std::ostringstream text;
+    mTraceDumped = Trace::Dump(text, mTraceDumped);
+    return text.str();
+}
+
+void BleApplication::saveTimeline()
+{
+    if (mTraceFile.empty()) {
+        return;
+    }
+    try {
+        Timeline::Get().Save(mTraceFile);
+    }
+    catch (const std::exception &e) {
+        mLogger.Error() << "Failed to save trace to " << mTraceFile << ": " << e.what();
+    }
+}
+
+void BleApplication::showAllocationStats()
+{
+    if (!mShowStats) {
+        return;
+    }
+    auto &metrics = Metrics::Get();
+    // Records handled by the phases that work on all records
+    std::map<std::string, std::uint64_t> records = {
+        {"racp_transfer", metrics.GetCount("records_received")},
+        {"encode", metrics.GetCount("records_written")}
+    };
+
+    std::ostringstream text;
+    text << std::left << std::setw(22) << "Phase" << std::right << std::setw(12) << "Allocations" << std::setw(12) << "Frees"
+         << std::setw(14) << "Bytes" << std::setw(12) << "Per record" << std::setw(14) << "Peak RSS kB" << "\n";
+    auto line = [&](const AllocationStats::Counts &arCounts) {
+        text << std::left << std::setw(22) << arCounts.mPhase << std::right << std::setw(12) << arCounts.mAllocations
+             << std::setw(12) << arCounts.mFrees << std::setw(14) << arCounts.mBytes << std::setw(12);
+        auto it = records.find(arCounts.mPhase);
+        if ((it != records.end()) && it->second) {
+            text << std::fixed << std::setprecision(1) << (double(arCounts.mAllocations) / double(it->second));
+        }
+        else {
+            text << "";
+        }
+        text << std::setw(14) << arCounts.mPeakRssKb << "\n";
+    };
+    for (auto &counts : AllocationStats::GetPhases()) {
+        if (counts.mAllocations == 0) {
+            continue;
+        }
+        line(counts);
+        Metrics::LabelScope labels({{"phase", counts.mPhase}});
+        metrics.Count("allocations", counts.mAllocations);
+        metrics.Count("allocated_bytes", counts.mBytes);
+    }
+    line(AllocationStats::GetTotal());
+    text << "Peak heap: " << AllocationStats::GetPeakHeapBytes() << " bytes, peak RSS: " << AllocationStats::GetPeakRssKb() << " kB";
+    mLogger.Notice() << "Heap allocations by phase:\n" << text.str();
+}
+
+void BleApplication::saveMetrics()
+{
+    if (mMetricsFile.empty()) {
+        return;
+    }
+    try {
+        Metrics::Get().Save(mMetricsFile);
+    }
+    catch (const std::exception &e) {
+        mLogger.Error() << "Failed to save metrics to " << mMetricsFile << ": " << e.what();
+    }
+}
+
+TrustedDevice& BleApplication::requestDevice(const std::string &arAddress, bool aKeep, std::unique_ptr<TrustedDevice> &arConnection)
+{
+    auto it = mHeldDevices.find(arAddress);
+    if (it != mHeldDevices.end()) {
+        if (it->second->GetPeripheral().IsConnected()) {
+            return *it->second;
+        }
+        mLogger.Info() << "Held connection to " << arAddress << " was lost";
+        mHeldDevices.erase(it);
+    }
+
+    arConnection = connect(arAddress);
+    if (aKeep || std::find(mKeepConnected.begin(), mKeepConnected.end(), arAddress) != mKeepConnected.end()) {
+        return *mHeldDevices.emplace(arAddress, std::move(arConnection)).first->second;
+    }
+    return *arConnection;
+}
+
+std::string BleApplication::getFileName(TrustedDevice &arDevice)
+{
+    std::string filename = "auto";
+    mCmd.GetOptionValue("--filename=", filename);
+
+    if(filename == "auto") {
+        filename = arDevice.GetPeripheral().Identifier() + "-" + DateTime().ToString("%Y%m%d%H%M%S") + "." + mEncoder;
+    }
+    return filename;
 }
 
 } // rsp
@@ -9,35 +9,37 @@
 */
 
 #include <chrono>
-#include <thread>
 #include <BleServiceBase.h>
-#include <exceptions.h>
 
 namespace rsp {
 
-BleServiceBase::BleServiceBase(const TrustedDevice &arDevice, uuid::Identifiers aServiceUuid)
-    : mDevice(arDevice),
-      mService(mDevice.GetServiceById(aServiceUuid))
+BleServiceBase::BleServiceBase(TrustedDevice &arDevice, uuid::Identifiers aServiceUuid)
+    : mId(aServiceUuid),
+      mDevice(arDevice),
+      mServiceUuid(mDevice.GetServiceUuid(aServiceUuid))
 {
 }
 
-SimpleBLE::Characteristic BleServiceBase::findCharacteristicByUuid(const std::string &arUUID)
+bool BleServiceBase::delay(std::uint32_t aMilliseconds, const std::atomic_bool *apDone)
 {
-    for (auto &ch : mService.characteristics()) {
-        if (ch.uuid() == arUUID) {
-            return ch;
-        }
+    auto &reactor = Reactor::Current();
+    {
+        std::lock_guard<std::mutex> lock(mWaitMutex);
+        mpWaitingReactor = &reactor;
     }
-    THROW_WITH_BACKTRACE1(ECharacteristicNotFound, uuid::ToName(uuid::FromString(arUUID)));
+    bool result = reactor.WaitUntil(std::chrono::milliseconds(aMilliseconds), [apDone]() {
+        return apDone && *apDone;
+    });
+    std::lock_guard<std::mutex> lock(mWaitMutex);
+    mpWaitingReactor = nullptr;
+    return result;
 }
 
-void BleServiceBase::delay(std::uint32_t aMilliseconds, volatile const bool *apAbort)
+void BleServiceBase::wake()
 {
-    for (int i = 0; i < aMilliseconds; i++) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        if (apAbort && *apAbort) {
-            break;
-        }
+    std::lock_guard<std::mutex> lock(mWaitMutex);
+    if (mpWaitingReactor) {
+        mpWaitingReactor->Wake();
     }
 }
 
@@ -0,0 +1,177 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <bluetooth-glucose.h>
+#include <exceptions.h>
+#include <GlucoseServiceProfile.h>
+#include <Scanner.h>
+#include <ShmRing.h>
+#include <TrustedDevice.h>
+
+using namespace rsp;
+
+struct bg_shm_reader {
+    std::unique_ptr<ShmRingReader> mReader{};
+};
+
+struct bg_meter {
+    std::unique_ptr<TrustedDevice> mDevice{};
+    std::unique_ptr<GlucoseServiceProfile> mGlucoseService{};
+};
+
+static thread_local std::string tlsLastError;
+
+template <class F>
+static auto guarded(F aFunction, decltype(aFunction()) aFailure) noexcept -> decltype(aFunction())
+{
+    try {
+        return aFunction();
+    }
+    catch (const std::exception &e) {
+        tlsLastError = e.what();
+    }
+    catch (...) {
+        tlsLastError = "Unknown error";
+    }
+    return aFailure;
+}
+
+template <class T>
+static T& handle(T *apHandle)
+{
+    if (!apHandle) {
+        throw std::invalid_argument("NULL handle");
+    }
+    return *apHandle;
+}
+
+extern "C" {
+
+bg_meter* bg_meter_open(const char *adapter, const char *address, uint32_t timeout_ms, const char *cache_dir)
+{
+    return guarded([&]() -> bg_meter* {
+        if (!address || !*address) {
+            THROW_WITH_BACKTRACE(ENoDevice);
+        }
+        auto adapters = SimpleBLE::Adapter::get_adapters();
+        auto it = adapters.begin();
+        if (adapter) {
+            it = std::find_if(adapters.begin(), adapters.end(), [adapter](SimpleBLE::Adapter &arAdapter) {
+                return (arAdapter.address() == adapter) || (arAdapter.identifier() == adapter);
+            });
+        }
+        if (it == adapters.end()) {
+            THROW_WITH_BACKTRACE(ENoAdapter);
+        }
+
+        Scanner s(*it, std::string(address));
+        if (!s.RunUntilFound(timeout_ms)) {
+            THROW_WITH_BACKTRACE(EDeviceNotFound);
+        }
+        auto meter = std::make_unique<bg_meter>();
+        meter->mDevice = std::make_unique<TrustedDevice>(s.GetResult().front(), cache_dir ? cache_dir : "");
+        meter->mGlucoseService = std::make_unique<GlucoseServiceProfile>(*meter->mDevice);
+        return meter.release();
+    }, nullptr);
+}
+
+void bg_meter_close(bg_meter *meter)
+{
+    // The handle is freed even if disconnecting fails.
+    std::unique_ptr<bg_meter> owner(meter);
+    guarded([meter]() {
+        if (meter) {
+            // Profiles unsubscribe on destruction, so they must go before the connection.
+            meter->mGlucoseService.reset();
+            meter->mDevice.reset();
+        }
+        return 0;
+    }, -1);
+}
+
+int bg_meter_record_count(bg_meter *meter)
+{
+    return guarded([meter]() {
+        return int(handle(meter).mGlucoseService->GetMeasurementsCount());
+    }, -1);
+}
+
+int bg_meter_read_all(bg_meter *meter, bg_measurement_callback callback, void *user_data)
+{
+    return guarded([&]() {
+        auto &recs = handle(meter).mGlucoseService->ReadAllMeasurements();
+        if (callback) {
+            for (auto &rec : recs) {
+                auto r = ToCRecord(rec);
+                callback(&r, user_data);
+            }
+        }
+        return int(recs.size());
+    }, -1);
+}
+
+int bg_meter_clear(bg_meter *meter)
+{
+    return guarded([meter]() {
+        handle(meter).mGlucoseService->ClearAllMeasurements();
+        return 0;
+    }, -1);
+}
+
+bg_shm_reader* bg_shm_reader_open(const char *name, int from_oldest)
+{
+    return guarded([&]() -> bg_shm_reader* {
+        auto reader = std::make_unique<bg_shm_reader>();
+        reader->mReader = std::make_unique<ShmRingReader>(name ? name : "", from_oldest != 0);
+        return reader.release();
+    }, nullptr);
+}
+
+void bg_shm_reader_close(bg_shm_reader *reader)
+{
+    delete reader;
+}
+
+int bg_shm_reader_read(bg_shm_reader *reader, int32_t timeout_ms, bg_measurement_callback callback, void *user_data)
+{
+    return guarded([&]() {
+        std::optional<std::chrono::milliseconds> timeout;
+        if (timeout_ms >= 0) {
+            timeout = std::chrono::milliseconds(timeout_ms);
+        }
+        return int(handle(reader).mReader->Read([&](const bg_glucose_measurement &arRecord) {
+            if (callback) {
+                callback(&arRecord, user_data);
+            }
+        }, timeout));
+    }, -1);
+}
+
+uint64_t bg_shm_reader_lost(const bg_shm_reader *reader)
+{
+    if (!reader) {
+        tlsLastError = "NULL handle";
+        return 0;
+    }
+    return reader->mReader->GetLost();
+}
+
+const char* bg_last_error(void)
+{
+    return tlsLastError.c_str();
+}
+
+} // extern "C"
@@ -0,0 +1,410 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <bit>
+#include <CgmServiceProfile.h>
+#include <exceptions.h>
+#include <magic_enum.hpp>
+#include <Metrics.h>
+#include <Trace.h>
+
+template <>
+struct magic_enum::customize::enum_range<rsp::CgmServiceProfile::SensorStatus> {
+    static constexpr bool is_flags = true;
+};
+
+using namespace rsp::utils;
+
+namespace rsp {
+
+// Size, flags, glucose concentration and time offset
+static constexpr std::size_t cMinRecordSize = 6;
+
+static bool crcValid(const SimpleBLE::ByteArray &arValue)
+{
+    if (arValue.size() < 2) {
+        return false;
+    }
+    auto size = arValue.size() - 2;
+    auto crc = std::uint16_t(std::uint8_t(arValue[size]) | (std::uint8_t(arValue[size + 1]) << 8));
+    return CgmServiceProfile::Crc(arValue.data(), size) == crc;
+}
+
+utils::DynamicData& operator<<(utils::DynamicData &o, const CgmServiceProfile::Measurement &arMeasurement)
+{
+    thread_local Iso8601Formatter formatter;
+    auto capture_time = formatter.Format(arMeasurement.mCaptureTime);
+    o
+        .Add("TimeOffset", arMeasurement.mTimeOffset)
+        .Add("CaptureTime", capture_time.empty() ? DynamicData() : DynamicData(std::string(capture_time)))
+        .Add("GlucoseConcentration", arMeasurement.mGlucoseConcentration)
+        .Add("Unit", "mg/dl")
+        .Add("Trend", DynamicData())
+        .Add("Quality", DynamicData())
+        .Add("SensorStatus", DynamicData());
+
+    if (arMeasurement.mFlags & CgmServiceProfile::Measurement::Flags::TrendInformationPresent) {
+        o["Trend"] = arMeasurement.mTrend;
+    }
+    if (arMeasurement.mFlags & CgmServiceProfile::Measurement::Flags::QualityPresent) {
+        o["Quality"] = arMeasurement.mQuality;
+    }
+    if (arMeasurement.mSensorStatus != CgmServiceProfile::SensorStatus::None) {
+        o["SensorStatus"] = magic_enum::enum_flags_name(arMeasurement.mSensorStatus);
+    }
+    return o;
+}
+
+std::ostream& operator<<(std::ostream &o, const CgmServiceProfile::SessionStartTime &arStart)
+{
+    Iso8601Formatter formatter;
+    auto local = formatter.Format(arStart.mLocalTime);
+    o << "Session start: " << (local.empty() ? std::string_view("unknown") : local.substr(0, 19));
+    if (arStart.mTimeZone != CgmServiceProfile::SessionStartTime::cTimeZoneUnknown) {
+        auto minutes = int(arStart.mTimeZone) * 15;
+        o << " UTC" << ((minutes < 0) ? "-" : "+") << (std::abs(minutes) / 60) << ":" << (std::abs(minutes) % 60 < 10 ? "0" : "") << (std::abs(minutes) % 60);
+    }
+    if (arStart.mDstOffset != CgmServiceProfile::SessionStartTime::cDstOffsetUnknown && arStart.mDstOffset != 0) {
+        o << " DST +" << (int(arStart.mDstOffset) * 15) << " min";
+    }
+    return o;
+}
+
+CgmServiceProfile::Measurement::Measurement(const SimpleBLE::ByteArray &arRecord, bool aCheckCrc)
+{
+    if (arRecord.size() < cMinRecordSize || std::uint8_t(arRecord[0]) != arRecord.size()) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, "record size");
+    }
+    AttributeStream s(arRecord);
+    s.Uint8(); // Size
+    mFlags = Flags(s.Uint8());
+    mGlucoseConcentration = s.MedFloat16();
+    mTimeOffset = s.Uint16();
+
+    auto expected = cMinRecordSize + std::size_t(std::popcount(std::uint8_t(mFlags & 0xE0)))
+                    + ((mFlags & Flags::TrendInformationPresent) ? 2 : 0)
+                    + ((mFlags & Flags::QualityPresent) ? 2 : 0)
+                    + (aCheckCrc ? 2 : 0);
+    if (arRecord.size() < expected) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, "record too short for its flags");
+    }
+    if (aCheckCrc && !crcValid(arRecord)) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, "E2E-CRC mismatch");
+    }
+
+    // The octets are sent Warning first, in the order of their flags
+    std::uint32_t status = 0;
+    if (mFlags & Flags::WarningOctetPresent) {
+        status |= std::uint32_t(s.Uint8()) << 16;
+    }
+    if (mFlags & Flags::CalTempOctetPresent) {
+        status |= std::uint32_t(s.Uint8()) << 8;
+    }
+    if (mFlags & Flags::StatusOctetPresent) {
+        status |= s.Uint8();
+    }
+    mSensorStatus = SensorStatus(status);
+    if (mFlags & Flags::TrendInformationPresent) {
+        mTrend = s.MedFloat16();
+    }
+    if (mFlags & Flags::QualityPresent) {
+        mQuality = s.MedFloat16();
+    }
+}
+
+std::int64_t CgmServiceProfile::SessionStartTime::UtcSeconds() const
+{
+    if (!mLocalTime.IsKnown() || mTimeZone == cTimeZoneUnknown) {
+        return mLocalTime.mSeconds;
+    }
+    auto quarters = std::int64_t(mTimeZone) + ((mDstOffset == cDstOffsetUnknown) ? 0 : mDstOffset);
+    return mLocalTime.mSeconds - quarters * 15 * 60;
+}
+
+std::uint16_t CgmServiceProfile::Crc(const char *apData, std::size_t aSize)
+{
+    std::uint16_t crc = 0xFFFF;
+    for (std::size_t i = 0; i < aSize; ++i) {
+        crc ^= std::uint8_t(apData[i]);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? std::uint16_t((crc >> 1) ^ 0x8408) : std::uint16_t(crc >> 1);
+        }
+    }
+    return crc;
+}
+
+CgmServiceProfile::CgmServiceProfile(TrustedDevice &arDevice)
+    : BleService<CgmServiceProfile>(arDevice, uuid::Identifiers::ContinuousGlucoseMonitoringService),
+      mMeasurementUuid(characteristicUuid(uuid::Identifiers::CgmMeasurement)),
+      mFeatureUuid(characteristicUuid(uuid::Identifiers::CgmFeature)),
+      mSessionStartTimeUuid(characteristicUuid(uuid::Identifiers::CgmSessionStartTime)),
+      mSessionRunTimeUuid(characteristicUuid(uuid::Identifiers::CgmSessionRunTime)),
+      mRACP(characteristicUuid(uuid::Identifiers::RecordAccessControlPoint)),
+      mOpsControlPoint(characteristicUuid(uuid::Identifiers::CgmSpecificOpsControlPoint))
+{
+    auto timer = Metrics::Get().Time("subscribe");
+    // The CRC of CGM Feature is always there, 0xFFFF when E2E-CRC is not supported.
+    AttributeStream feature(mDevice.GetPeripheral().Read(mServiceUuid, mFeatureUuid));
+    if (feature.GetArray().size() < 6) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, "CGM Feature");
+    }
+    mFeatures = Features(feature.Uint16() | (std::uint32_t(feature.Uint8()) << 16));
+    if (hasCrc() && !crcValid(feature.GetArray())) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, "CGM Feature E2E-CRC mismatch");
+    }
+    mLogger.Debug() << "CGM features: " << std::hex << std::uint32_t(mFeatures) << std::dec;
+    GetSessionStartTime();
+
+    mLogger.Debug() << "Listening on CGM measurement: " << mMeasurementUuid;
+    mDevice.GetPeripheral().Notify(mServiceUuid, mMeasurementUuid, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
+        measurementHandler(arValue);
+    });
+
+    mLogger.Debug() << "Listening on record access control point: " << mRACP;
+    mDevice.GetPeripheral().Notify(mServiceUuid, mRACP, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
+        racpHandler(AttributeStream(arValue));
+    });
+
+    mLogger.Debug() << "Listening on CGM specific ops control point: " << mOpsControlPoint;
+    mDevice.GetPeripheral().Notify(mServiceUuid, mOpsControlPoint, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
+        opsHandler(AttributeStream(arValue));
+    });
+}
+
+CgmServiceProfile::~CgmServiceProfile()
+{
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mOpsControlPoint);
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mRACP);
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mMeasurementUuid);
+}
+
+CgmServiceProfile::SessionStartTime CgmServiceProfile::GetSessionStartTime()
+{
+    auto s = read(mSessionStartTimeUuid, 9);
+    SessionStartTime result;
+    result.mLocalTime = s.EpochTime();
+    result.mTimeZone = std::int8_t(s.Uint8());
+    result.mDstOffset = s.Uint8();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSessionStart = result.UtcSeconds();
+    return result;
+}
+
+std::uint16_t CgmServiceProfile::GetSessionRunTime()
+{
+    return read(mSessionRunTimeUuid, 2).Uint16();
+}
+
+std::uint8_t CgmServiceProfile::GetCommunicationInterval()
+{
+    opsCommand(cOpsGetCommunicationInterval, {});
+    return mInterval;
+}
+
+CgmServiceProfile& CgmServiceProfile::SetCommunicationInterval(std::uint8_t aMinutes)
+{
+    opsCommand(cOpsSetCommunicationInterval, aMinutes);
+    return *this;
+}
+
+CgmServiceProfile& CgmServiceProfile::StartSession()
+{
+    mLogger.Info() << "Starting CGM session";
+    opsCommand(cOpsStartSession, {});
+    GetSessionStartTime();
+    return *this;
+}
+
+CgmServiceProfile& CgmServiceProfile::StopSession()
+{
+    mLogger.Info() << "Stopping CGM session";
+    opsCommand(cOpsStopSession, {});
+    return *this;
+}
+
+std::size_t CgmServiceProfile::GetMeasurementsCount(std::optional<std::uint16_t> aFromTimeOffset)
+{
+    mLogger.Info() << "Requesting record count";
+    mRecordCount = 0;
+    racpCommand(aFromTimeOffset ? cRacpReportNumberOfRecordsFrom : cRacpReportNumberOfRecords, aFromTimeOffset, 2000);
+    return mRecordCount;
+}
+
+std::size_t CgmServiceProfile::ReadMeasurements(std::optional<std::uint16_t> aFromTimeOffset)
+{
+    if (aFromTimeOffset) {
+        mLogger.Info() << "Requesting records from time offset " << *aFromTimeOffset;
+    }
+    else {
+        mLogger.Info() << "Requesting all records";
+    }
+    auto before = mReceived.load();
+    racpCommand(aFromTimeOffset ? cRacpReportRecordsFrom : cRacpReportRecords, aFromTimeOffset, 20000);
+    return std::size_t(mReceived - before);
+}
+
+CgmServiceProfile& CgmServiceProfile::OnMeasurement(MeasurementCallback aCallback)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCallback = std::move(aCallback);
+    return *this;
+}
+
+AttributeStream CgmServiceProfile::read(const std::string &arCharacteristic, std::size_t aSize)
+{
+    auto value = mDevice.GetPeripheral().Read(mServiceUuid, arCharacteristic);
+    if (value.size() < aSize + (hasCrc() ? 2 : 0)) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, std::string(uuid::ToName(uuid::FromString(arCharacteristic))));
+    }
+    if (hasCrc() && !crcValid(value)) {
+        THROW_WITH_BACKTRACE1(ECgmArgument, std::string(uuid::ToName(uuid::FromString(arCharacteristic))) + " E2E-CRC mismatch");
+    }
+    return {value};
+}
+
+void CgmServiceProfile::racpCommand(std::uint16_t aCommand, std::optional<std::uint16_t> aFromTimeOffset, int aTimeoutMs)
+{
+    auto timer = Metrics::Get().Time((aCommand & 0xFF) == 0x01 ? "racp_transfer" : "racp_count");
+    CallbackPhaseScope callback_phase(*this);
+    mCommandDone = false;
+    AttributeStream command(aFromTimeOffset ? 5 : 2);
+    command.Uint16(aCommand);
+    if (aFromTimeOffset) {
+        command.Uint8(cRacpFilterTimeOffset).Uint16(*aFromTimeOffset);
+    }
+    mDevice.GetPeripheral().WriteRequest(mServiceUuid, mRACP, command.GetArray());
+    if (!delay(std::uint32_t(aTimeoutMs), &mCommandDone)) {
+        Metrics::Get().Count("racp_timeouts");
+    }
+}
+
+void CgmServiceProfile::opsCommand(std::uint8_t aOpCode, std::optional<std::uint8_t> aOperand)
+{
+    mCommandDone = false;
+    mOpsResult = 0;
+    AttributeStream command((aOperand ? 2 : 1) + (hasCrc() ? 2 : 0));
+    command.Uint8(aOpCode);
+    if (aOperand) {
+        command.Uint8(*aOperand);
+    }
+    if (hasCrc()) {
+        command.Uint16(Crc(command.GetArray().data(), aOperand ? 2 : 1));
+    }
+    mDevice.GetPeripheral().WriteRequest(mServiceUuid, mOpsControlPoint, command.GetArray());
+    if (!delay(5000, &mCommandDone)) {
+        THROW_WITH_BACKTRACE1(ECgmOperationFailed, "no response to op code " + std::to_string(aOpCode));
+    }
+    if (mOpsResult != cOpsSuccess) {
+        THROW_WITH_BACKTRACE1(ECgmOperationFailed, "op code " + std::to_string(aOpCode) + " response " + std::to_string(mOpsResult));
+    }
+}
+
+void CgmServiceProfile::measurementHandler(const SimpleBLE::ByteArray &arValue)
+{
+    Trace::Record(Trace::Events::CgmMeasurement, arValue);
+    auto &metrics = Metrics::Get();
+    metrics.Count("notification_bytes", arValue.size());
+    MeasurementCallback callback;
+    std::int64_t session_start;
+    {
+        // Called unlocked, the callback may use the profile
+        std::lock_guard<std::mutex> lock(mMutex);
+        callback = mCallback;
+        session_start = mSessionStart;
+    }
+    // Each record starts with its own size, so records with unknown trailing fields are skipped correctly.
+    std::size_t pos = 0;
+    while (pos < arValue.size()) {
+        auto size = std::size_t(std::uint8_t(arValue[pos]));
+        if (size < cMinRecordSize || (pos + size) > arValue.size()) {
+            mLogger.Error() << "Invalid CGM measurement record size " << size << " at " << pos << ": " << AttributeStream(arValue);
+            metrics.Count("cgm_record_errors");
+            return;
+        }
+        try {
+            Measurement record(arValue.substr(pos, size), hasCrc());
+            if (session_start != EpochTime::cUnknown) {
+                record.mCaptureTime.mSeconds = session_start + std::int64_t(record.mTimeOffset) * 60;
+            }
+            mReceived++;
+            metrics.Count("records_received");
+            if (callback) {
+                callback(record);
+            }
+        }
+        catch (const ECgmArgument &e) {
+            mLogger.Error() << e.what() << ": " << AttributeStream(arValue.substr(pos, size));
+            metrics.Count("cgm_record_errors");
+        }
+        pos += size;
+    }
+}
+
+void CgmServiceProfile::racpHandler(AttributeStream aStream)
+{
+    Trace::Record(Trace::Events::RacpResponse, aStream.GetArray());
+    bool error = false;
+    std::uint8_t opcode = 0;
+    if (aStream.GetArray().size() != 4) {
+        error = true;
+    }
+    else {
+        opcode = aStream.Uint8();
+        aStream.Uint8(); // Operator, always null in responses
+        switch (opcode) {
+            case cRacpNumberOfRecordsResponse:
+                mRecordCount = aStream.Uint16();
+                break;
+            case cRacpResponseCode: {
+                aStream.Uint8(); // Request op code
+                auto code = aStream.Uint8();
+                error = (code != cRacpSuccess) && (code != cRacpNoRecordsFound);
+                break;
+            }
+            default:
+                error = true;
+                break;
+        }
+    }
+    if (error) {
+        mLogger.Error() << "Unexpected result from RACP (" << int(opcode) << "): " << aStream;
+        Metrics::Get().Count("racp_errors");
+    }
+    mCommandDone = true;
+    wake();
+}
+
+void CgmServiceProfile::opsHandler(AttributeStream aStream)
+{
+    Trace::Record(Trace::Events::CgmOpsResponse, aStream.GetArray());
+    auto size = aStream.GetArray().size() - (hasCrc() ? 2 : 0);
+    if (size >= 2 && (!hasCrc() || crcValid(aStream.GetArray()))) {
+        auto opcode = aStream.Uint8();
+        if (opcode == cOpsCommunicationIntervalResponse) {
+            mInterval = aStream.Uint8();
+            mOpsResult = cOpsSuccess;
+        }
+        else if (opcode == cOpsResponseCode && size >= 3) {
+            aStream.Uint8(); // Request op code
+            mOpsResult = aStream.Uint8();
+        }
+    }
+    else {
+        mLogger.Error() << "Invalid CGM specific ops control point response: " << aStream;
+    }
+    mCommandDone = true;
+    wake();
+}
+
+} // rsp
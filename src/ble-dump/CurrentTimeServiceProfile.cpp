@@ -25,15 +25,16 @@ std::ostream& operator<<(std::ostream &o, CurrentTimeServiceProfile &arService)
     return o;
 }
 
-CurrentTimeServiceProfile::CurrentTimeServiceProfile(const TrustedDevice &arDevice)
-    : BleService<CurrentTimeServiceProfile>(arDevice, uuid::Identifiers::CurrentTimeService)
+CurrentTimeServiceProfile::CurrentTimeServiceProfile(TrustedDevice &arDevice)
+    : BleService<CurrentTimeServiceProfile>(arDevice, uuid::Identifiers::CurrentTimeService),
+      mCurrentTime(characteristicUuid(uuid::Identifiers::CurrentTime)),
+      mClientConfiguration(uuid::ToFullString(uuid::Identifiers::ClientCharacteristicConfiguration))
 {
-    mRootUuid = mService.uuid().substr(8);
 }
 
 utils::DateTime CurrentTimeServiceProfile::GetTime()
 {
-    AttributeStream s(mDevice.GetPeripheral().read(mService.uuid(), ToString(uuid::Identifiers::CurrentTime) + mRootUuid));
+    AttributeStream s(mDevice.GetPeripheral().Read(mServiceUuid, mCurrentTime));
     auto result = s.DateTime(true, true);
     mAdjustReason = AdjustReason(s.Uint8());
     return result;
@@ -44,7 +45,7 @@ CurrentTimeServiceProfile& CurrentTimeServiceProfile::SetTime(const utils::DateT
     AttributeStream s(10);
     s.DateTime(arDT, true, true);
     s.Uint8(uint8_t(AdjustReason::ManualTimeUpdate));
-    mDevice.GetPeripheral().write(mService.uuid(), ToString(uuid::Identifiers::CurrentTime) + mRootUuid, ToString(uuid::Identifiers::ClientCharacteristicConfiguration) + mRootUuid, s.GetArray());
+    mDevice.GetPeripheral().WriteDescriptor(mServiceUuid, mCurrentTime, mClientConfiguration, s.GetArray());
     return *this;
 }
 
@@ -0,0 +1,198 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <DaemonServer.h>
+#include <json/JsonDecoder.h>
+#include <json/JsonEncoder.h>
+#include <Reactor.h>
+
+namespace rsp {
+
+// Longest request line accepted, a client sending more without a newline is disconnected.
+static constexpr std::size_t cMaxRequestSize = 64 * 1024;
+// A client not reading its responses for this long is disconnected.
+static constexpr int cSendTimeoutSeconds = 5;
+
+void DaemonServer::Responder::Send(const utils::DynamicData &arResponse)
+{
+    if (mFailed) {
+        throw std::system_error(EPIPE, std::generic_category(), "send");
+    }
+    std::string line = json::JsonEncoder(false).Encode(arResponse);
+    line += '\n';
+    const char *p = line.data();
+    std::size_t remaining = line.size();
+    while (remaining > 0) {
+        auto n = ::send(mFd, p, remaining, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            mFailed = true;
+            throw std::system_error(errno, std::generic_category(), "send");
+        }
+        p += n;
+        remaining -= std::size_t(n);
+    }
+}
+
+DaemonServer::DaemonServer(std::string aSocketPath)
+    : mSocketPath(std::move(aSocketPath))
+{
+    sockaddr_un addr{};
+    if (mSocketPath.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("Socket path too long: " + mSocketPath);
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, mSocketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    mListenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (mListenFd < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+    ::unlink(mSocketPath.c_str());
+    if (::bind(mListenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(mListenFd, 16) < 0) {
+        auto err = errno;
+        ::close(mListenFd);
+        throw std::system_error(err, std::generic_category(), "bind " + mSocketPath);
+    }
+    mLogger.Notice() << "Listening on " << mSocketPath;
+}
+
+DaemonServer::~DaemonServer()
+{
+    if (mListenFd >= 0) {
+        ::close(mListenFd);
+        ::unlink(mSocketPath.c_str());
+    }
+}
+
+void DaemonServer::Run(const Handler &arHandler, const std::atomic_bool &arStop)
+{
+    auto &reactor = Reactor::Current();
+    bool pending = false;
+    reactor.Add(mListenFd, EPOLLIN, [&pending](std::uint32_t) { pending = true; });
+    while (!arStop) {
+        reactor.WaitUntil(std::nullopt, [&]() { return pending || arStop; });
+        if (!pending) {
+            continue;
+        }
+        pending = false;
+        int fd = ::accept4(mListenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        timeval timeout{cSendTimeoutSeconds, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(mClientsMutex);
+            mClients++;
+        }
+        std::thread([this, fd, &arHandler, &arStop]() {
+            serveClient(fd, arHandler, arStop);
+            ::close(fd);
+            std::lock_guard<std::mutex> lock(mClientsMutex);
+            mClients--;
+            mClientsDone.notify_all();
+        }).detach();
+    }
+    reactor.Remove(mListenFd);
+
+    // Let clients finish their current request before the handler goes out of scope.
+    std::unique_lock<std::mutex> lock(mClientsMutex);
+    mClientsDone.wait(lock, [this]() { return mClients == 0; });
+}
+
+void DaemonServer::serveClient(int aFd, const Handler &arHandler, const std::atomic_bool &arStop)
+{
+    Responder responder(aFd);
+    std::string buffer;
+    char chunk[1024];
+    auto &reactor = Reactor::Current();
+    bool readable = false;
+    reactor.Add(aFd, EPOLLIN | EPOLLRDHUP, [&readable](std::uint32_t) { readable = true; });
+    struct Guard {
+        Reactor &mReactor;
+        int mFd;
+        ~Guard() { mReactor.Remove(mFd); }
+    } guard{reactor, aFd};
+
+    // Responses, including errors, fail with std::system_error once the client is gone or stalled.
+    try {
+        while (!arStop) {
+            if (!reactor.WaitUntil(std::nullopt, [&]() { return readable || arStop; }) || arStop) {
+                return;
+            }
+            readable = false;
+            auto n = ::recv(aFd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return;
+            }
+            buffer.append(chunk, std::size_t(n));
+            if (buffer.find('\n') == std::string::npos && buffer.size() > cMaxRequestSize) {
+                mLogger.Warning() << "Disconnecting client, request exceeds " << cMaxRequestSize << " bytes";
+                utils::DynamicData error;
+                error.Add("status", "error").Add("error", "Request too large");
+                responder.Send(error);
+                return;
+            }
+
+            std::size_t pos;
+            while ((pos = buffer.find('\n')) != std::string::npos) {
+                auto line = buffer.substr(0, pos);
+                buffer.erase(0, pos + 1);
+                if (line.empty()) {
+                    continue;
+                }
+                Request request;
+                try {
+                    request = ParseRequest(line);
+                }
+                catch (const std::invalid_argument &e) {
+                    utils::DynamicData error;
+                    error.Add("status", "error").Add("error", std::string("Malformed request: ") + e.what());
+                    responder.Send(error);
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mHandlerMutex);
+                arHandler(request, responder);
+            }
+        }
+    }
+    catch (const std::system_error &e) {
+        mLogger.Info() << "Client went away: " << e.what();
+    }
+}
+
+DaemonServer::Request DaemonServer::ParseRequest(std::string_view aLine)
+{
+    Request result;
+    try {
+        result = json::JsonDecoder(std::string(aLine)).Decode();
+    }
+    catch (const std::exception &e) {
+        throw std::invalid_argument(e.what());
+    }
+    if (!result.IsObject()) {
+        throw std::invalid_argument("not a JSON object");
+    }
+    return result;
+}
+
+} // rsp
@@ -0,0 +1,90 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <DeviceCache.h>
+
+namespace rsp {
+
+DeviceCache::DeviceCache(std::string aDirectory)
+    : mDirectory(std::move(aDirectory))
+{
+}
+
+std::string DeviceCache::DefaultDirectory()
+{
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/ble-dump";
+    }
+    const char *home = std::getenv("HOME");
+    if (home && *home) {
+        return std::string(home) + "/.cache/ble-dump";
+    }
+    return {};
+}
+
+std::string DeviceCache::MakeKey(const std::string &arAddress, const std::string &arRevision, const std::string &arName)
+{
+    std::string key = arAddress + "-" + arRevision + "-" + arName;
+    for (auto &chr : key) {
+        if (!std::isalnum(static_cast<unsigned char>(chr)) && chr != '-' && chr != '.') {
+            chr = '_';
+        }
+    }
+    return key;
+}
+
+bool DeviceCache::Load(const std::string &arKey, std::vector<std::string> &arLines)
+{
+    if (!IsEnabled()) {
+        return false;
+    }
+    std::ifstream file(mDirectory / arKey);
+    if (!file.is_open()) {
+        return false;
+    }
+    arLines.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        arLines.push_back(line);
+    }
+    mLogger.Debug() << "Loaded " << arLines.size() << " lines from cache " << arKey;
+    return true;
+}
+
+void DeviceCache::Save(const std::string &arKey, const std::vector<std::string> &arLines)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(mDirectory, ec);
+    // Write to temporary file and rename, so concurrent readers never see a partial file.
+    auto tmp = mDirectory / (arKey + ".tmp");
+    {
+        std::ofstream file(tmp, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            mLogger.Warning() << "Could not write cache file " << tmp.string();
+            return;
+        }
+        for (auto &line : arLines) {
+            file << line << "\n";
+        }
+    }
+    std::filesystem::rename(tmp, mDirectory / arKey, ec);
+    if (ec) {
+        mLogger.Warning() << "Could not store cache file " << arKey << ": " << ec.message();
+    }
+}
+
+} // rsp
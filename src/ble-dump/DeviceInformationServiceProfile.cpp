@@ -9,22 +9,42 @@
 */
 
 #include <DeviceInformationServiceProfile.h>
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <future>
 #include <iomanip>
+#include <sstream>
 #include <magic_enum.hpp>
+#include <Trace.h>
 
 namespace rsp {
 
 std::ostream& operator<<(std::ostream &o, const DeviceInformationServiceProfile &arDeviceInformation)
 {
-    o
-        << "System Id: 0x" << std::hex << arDeviceInformation.mSystemId << std::dec << "\n"
-        << "Model Number: " << arDeviceInformation.mModelNumber << "\n"
-        << "Serial Number: " << arDeviceInformation.mSerialNumber << "\n"
-        << "Firmware Revision: " << arDeviceInformation.mFirmwareRevision << "\n"
-        << "Software Revision: " << arDeviceInformation.mSoftwareRevision << "\n"
-        << "Manufacturer Name: " << arDeviceInformation.mManufacturerName << "\n"
-        << "Regulatory Cert. Data List: " << arDeviceInformation.mRegulatoryCertDataList << "\n"
-        << arDeviceInformation.mPnPID;
+    using uuid::Identifiers;
+    // Only values already read are shown, use Prefetch() to select what to read.
+    for (auto id : DeviceInformationServiceProfile::cAllFields) {
+        auto it = arDeviceInformation.mValues.find(id);
+        if (it == arDeviceInformation.mValues.end() || !it->second) {
+            continue;
+        }
+        AttributeStream stream(*it->second);
+        switch (id) {
+            case Identifiers::SystemId:
+                o << "System Id: 0x" << std::hex << stream.Uint64() << std::dec << "\n";
+                break;
+            case Identifiers::Ieee1107320601RegulatoryCertificationDataList:
+                o << "Regulatory Cert. Data List: " << stream << std::dec << "\n";
+                break;
+            case Identifiers::PnpId:
+                o << DeviceInformationServiceProfile::PnPID(AttributeStream(*it->second));
+                break;
+            default:
+                o << uuid::ToName(id) << ": " << stream.String() << "\n";
+                break;
+        }
+    }
     return o;
 }
 
@@ -46,28 +66,187 @@ DeviceInformationServiceProfile::PnPID::PnPID(AttributeStream aStream)
     mProductVersion = aStream.Uint16();
 }
 
-DeviceInformationServiceProfile::DeviceInformationServiceProfile(const rsp::TrustedDevice &arDevice)
+DeviceInformationServiceProfile::DeviceInformationServiceProfile(rsp::TrustedDevice &arDevice)
     : BleService<DeviceInformationServiceProfile>(arDevice, uuid::Identifiers::DeviceInformationService)
 {
-    mRootUuid = mService.uuid().substr(8);
-
-    mSystemId = read(uuid::Identifiers::SystemID).Uint64();
-    mModelNumber = read(uuid::Identifiers::ModelNumberString).String();
-    mSerialNumber = read(uuid::Identifiers::SerialNumberString).String();
-    mFirmwareRevision = read(uuid::Identifiers::FirmwareRevisionString).String();
-    mSoftwareRevision = read(uuid::Identifiers::SoftwareRevisionString).String();
-    mManufacturerName = read(uuid::Identifiers::ManufacturerNameString).String();
-    mRegulatoryCertDataList = read(uuid::Identifiers::IEEE_11073_20601_RegulatoryCertDataList);
-    mPnPID = PnPID(read(uuid::Identifiers::PnPID));
 }
 
-AttributeStream DeviceInformationServiceProfile::read(uuid::Identifiers aIdentifier)
+DeviceInformationServiceProfile::~DeviceInformationServiceProfile()
+{
+    try {
+        saveCache();
+    }
+    catch (const std::exception &e) {
+        mLogger.Warning() << "Could not save device information cache: " << e.what();
+    }
+}
+
+DeviceInformationServiceProfile& DeviceInformationServiceProfile::Prefetch(const std::vector<uuid::Identifiers> &arFields)
+{
+    loadCache();
+    // Issue all reads at once, so the D-Bus round trips overlap and BlueZ can queue the ATT requests back to back.
+    std::vector<std::pair<uuid::Identifiers, std::future<Value>>> pending;
+    for (auto id : arFields) {
+        if (!mValues.contains(id)) {
+            pending.emplace_back(id, std::async(std::launch::async, [this, id]() { return read(id); }));
+        }
+    }
+    // Values read successfully are kept, the first failure is rethrown when all reads are done.
+    std::exception_ptr error;
+    for (auto &[id, result] : pending) {
+        try {
+            mValues[id] = result.get();
+            mCacheDirty = true;
+        }
+        catch (const std::exception &e) {
+            mLogger.Warning() << "Could not read " << ToName(id) << ": " << e.what();
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return *this;
+}
+
+std::optional<uint64_t> DeviceInformationServiceProfile::GetSystemId()
+{
+    auto &v = value(uuid::Identifiers::SystemId);
+    if (!v) {
+        return std::nullopt;
+    }
+    return AttributeStream(*v).Uint64();
+}
+
+std::optional<AttributeStream> DeviceInformationServiceProfile::GetRegulatoryCertDataList()
+{
+    auto &v = value(uuid::Identifiers::Ieee1107320601RegulatoryCertificationDataList);
+    if (!v) {
+        return std::nullopt;
+    }
+    return AttributeStream(*v);
+}
+
+std::optional<DeviceInformationServiceProfile::PnPID> DeviceInformationServiceProfile::GetPnPID()
 {
-    AttributeStream stream(mDevice.GetPeripheral().read(mService.uuid(), ToString(aIdentifier) + mRootUuid));
+    auto &v = value(uuid::Identifiers::PnpId);
+    if (!v) {
+        return std::nullopt;
+    }
+    return PnPID(AttributeStream(*v));
+}
 
-    mLogger.Info() << "Read from " << ToName(aIdentifier) << ": " << stream;
+std::optional<std::string> DeviceInformationServiceProfile::getString(uuid::Identifiers aIdentifier)
+{
+    auto &v = value(aIdentifier);
+    if (!v) {
+        return std::nullopt;
+    }
+    return AttributeStream(*v).String();
+}
 
-    return stream;
+const DeviceInformationServiceProfile::Value& DeviceInformationServiceProfile::value(uuid::Identifiers aIdentifier)
+{
+    loadCache();
+    auto it = mValues.find(aIdentifier);
+    if (it == mValues.end()) {
+        it = mValues.emplace(aIdentifier, read(aIdentifier)).first;
+        mCacheDirty = true;
+    }
+    return it->second;
+}
+
+DeviceInformationServiceProfile::Value DeviceInformationServiceProfile::read(uuid::Identifiers aIdentifier)
+{
+    if (!hasCharacteristic(aIdentifier)) {
+        mLogger.Debug() << ToName(aIdentifier) << " is not present on the device";
+        return std::nullopt;
+    }
+    // A failed read is passed on, so it is neither taken for nor cached as an absent characteristic.
+    auto value = mDevice.GetPeripheral().Read(mServiceUuid, characteristicUuid(aIdentifier));
+    Trace::Record(Trace::Events::CharacteristicRead, value, std::uint32_t(aIdentifier));
+    return value;
+}
+
+/*
+ * The cache file holds one characteristic per line: "<assigned number> <hex bytes>",
+ * or "<assigned number> -" for characteristics not present on the device.
+ */
+void DeviceInformationServiceProfile::loadCache()
+{
+    if (mCacheLoaded) {
+        return;
+    }
+    mCacheLoaded = true;
+    // The firmware revision is part of the key, so it is read from the device with the first value.
+    Value firmware;
+    try {
+        firmware = read(uuid::Identifiers::FirmwareRevisionString);
+    }
+    catch (const std::exception &e) {
+        mLogger.Warning() << "No firmware revision, device information is not cached: " << e.what();
+        return;
+    }
+    mValues[uuid::Identifiers::FirmwareRevisionString] = firmware;
+    mCacheDirty = true;
+    if (!firmware || firmware->empty()) {
+        return;
+    }
+    mCacheKey = DeviceCache::MakeKey(mDevice.GetPeripheral().Address(), *firmware, "dis");
+    std::vector<std::string> lines;
+    if (!mDevice.GetCache().Load(mCacheKey, lines)) {
+        return;
+    }
+    std::map<uuid::Identifiers, Value> values;
+    for (auto &line : lines) {
+        std::istringstream in(line);
+        uint32_t id;
+        std::string hex;
+        if (!(in >> std::hex >> id >> hex)) {
+            continue;
+        }
+        if (hex == "-") {
+            values[uuid::Identifiers(id)] = std::nullopt;
+            continue;
+        }
+        SimpleBLE::ByteArray bytes;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            std::uint8_t byte = 0;
+            auto [end, error] = std::from_chars(hex.data() + i, hex.data() + std::min(i + 2, hex.size()), byte, 16);
+            if (error != std::errc() || end != hex.data() + i + 2) {
+                // A damaged file is treated as missing, and replaced by what is read from the device.
+                mLogger.Warning() << "Ignoring damaged device information cache: " << line;
+                return;
+            }
+            bytes += char(byte);
+        }
+        values[uuid::Identifiers(id)] = bytes;
+    }
+    mValues.merge(values);
+    mCacheDirty = false;
+}
+
+void DeviceInformationServiceProfile::saveCache()
+{
+    if (!mCacheDirty || mCacheKey.empty()) {
+        return;
+    }
+    std::vector<std::string> lines;
+    for (auto &[id, v] : mValues) {
+        std::ostringstream out;
+        out << std::hex << uint32_t(id) << " ";
+        if (!v) {
+            out << "-";
+        }
+        for (char byte : v.value_or(SimpleBLE::ByteArray())) {
+            out << std::setfill('0') << std::setw(2) << uint32_t(uint8_t(byte));
+        }
+        lines.push_back(out.str());
+    }
+    mDevice.GetCache().Save(mCacheKey, lines);
+    mCacheDirty = false;
 }
 
 } // rsp
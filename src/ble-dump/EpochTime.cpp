@@ -0,0 +1,45 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <EpochTime.h>
+
+namespace rsp {
+
+static void putDigits(char *apDest, unsigned aValue, int aDigits)
+{
+    for (int i = aDigits - 1; i >= 0; --i) {
+        apDest[i] = char('0' + (aValue % 10));
+        aValue /= 10;
+    }
+}
+
+std::string_view Iso8601Formatter::Format(std::int64_t aSeconds)
+{
+    using namespace std::chrono;
+    if (aSeconds == EpochTime::cUnknown) {
+        return {};
+    }
+    // Floor division, so times before 1970 count back from the start of their day.
+    auto day_number = (aSeconds >= 0) ? aSeconds / 86400 : -((-aSeconds + 86399) / 86400);
+    auto second_of_day = unsigned(aSeconds - day_number * 86400);
+    if (day_number != mDay) {
+        year_month_day ymd{sys_days(days(day_number))};
+        putDigits(mBuffer, unsigned(int(ymd.year())), 4);
+        putDigits(mBuffer + 5, unsigned(ymd.month()), 2);
+        putDigits(mBuffer + 8, unsigned(ymd.day()), 2);
+        mDay = day_number;
+    }
+    putDigits(mBuffer + 11, second_of_day / 3600, 2);
+    putDigits(mBuffer + 14, (second_of_day / 60) % 60, 2);
+    putDigits(mBuffer + 17, second_of_day % 60, 2);
+    return {mBuffer, cLength};
+}
+
+} // rsp
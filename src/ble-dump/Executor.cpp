@@ -0,0 +1,125 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <Coroutine.h>
+
+namespace rsp {
+
+Executor::Executor(std::size_t aThreads, std::size_t aBlockingThreads)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(aThreads, 1); i++) {
+        mThreads.emplace_back([this]() { run(); });
+    }
+    for (std::size_t i = 0; i < std::max<std::size_t>(aBlockingThreads, 1); i++) {
+        mThreads.emplace_back([this]() { runBlocking(); });
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        std::scoped_lock lock(mMutex, mBlockingMutex);
+        mStop = true;
+    }
+    mCondition.notify_all();
+    mBlockingCondition.notify_all();
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void Executor::Post(std::function<void()> aWork)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReady.push_back(std::move(aWork));
+    }
+    mCondition.notify_one();
+}
+
+void Executor::PostAt(Clock::time_point aDeadline, std::function<void()> aWork)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTimers.push(Timer{aDeadline, mTimerSequence++, std::move(aWork)});
+    }
+    // Wake a thread so it can shorten its wait, if this is the earliest timer.
+    mCondition.notify_one();
+}
+
+void Executor::PostBlocking(std::function<void()> aWork)
+{
+    {
+        std::lock_guard<std::mutex> lock(mBlockingMutex);
+        mBlocking.push_back(std::move(aWork));
+    }
+    mBlockingCondition.notify_one();
+}
+
+void Executor::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStop) {
+        auto now = Clock::now();
+        while (!mTimers.empty() && mTimers.top().mDeadline <= now) {
+            mReady.push_back(std::move(const_cast<Timer&>(mTimers.top()).mWork));
+            mTimers.pop();
+        }
+        if (mReady.empty()) {
+            if (mTimers.empty()) {
+                mCondition.wait(lock);
+            }
+            else {
+                auto deadline = mTimers.top().mDeadline; // The queue changes while waiting
+                mCondition.wait_until(lock, deadline);
+            }
+            continue;
+        }
+        auto work = std::move(mReady.front());
+        mReady.pop_front();
+        lock.unlock();
+        try {
+            work();
+        }
+        catch (const std::exception &e) {
+            mLogger.Error() << "Unhandled exception in executor: " << e.what();
+        }
+        lock.lock();
+    }
+}
+
+void Executor::runBlocking()
+{
+    std::unique_lock<std::mutex> lock(mBlockingMutex);
+    while (!mStop) {
+        if (mBlocking.empty()) {
+            mBlockingCondition.wait(lock);
+            continue;
+        }
+        auto work = std::move(mBlocking.front());
+        mBlocking.pop_front();
+        lock.unlock();
+        work();
+        lock.lock();
+    }
+}
+
+detail::Detached Executor::spawn(Executor &arExecutor, Task<void> aTask)
+{
+    co_await arExecutor.Schedule();
+    try {
+        co_await aTask;
+    }
+    catch (const std::exception &e) {
+        arExecutor.mLogger.Error() << "Spawned task failed: " << e.what();
+    }
+}
+
+} // namespace rsp
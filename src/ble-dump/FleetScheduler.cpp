@@ -0,0 +1,153 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <FleetScheduler.h>
+#include <Metrics.h>
+#include <Timeline.h>
+
+namespace rsp {
+
+FleetScheduler::FleetScheduler(std::vector<SimpleBLE::Adapter> aAdapters, std::size_t aMaxConnections)
+    : mMaxConnections(std::max<std::size_t>(aMaxConnections, 1))
+{
+    for (auto &adapter : aAdapters) {
+        mWorkers.push_back(Worker{adapter});
+    }
+}
+
+std::vector<FleetScheduler::Result> FleetScheduler::Run(std::uint32_t aScanMilliseconds, const Job &arJob)
+{
+    mResults.clear();
+    assign(scan(aScanMilliseconds));
+
+    std::vector<std::thread> threads;
+    for (auto &worker : mWorkers) {
+        threads.emplace_back([this, &worker, &arJob]() { runWorker(worker, arJob); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return mResults;
+}
+
+std::vector<FleetScheduler::Sighting> FleetScheduler::scan(std::uint32_t aScanMilliseconds)
+{
+    std::vector<std::vector<SimpleBLE::Peripheral>> found(mWorkers.size());
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < mWorkers.size(); ++i) {
+        threads.emplace_back([this, i, aScanMilliseconds, &found]() {
+            Scanner s(mWorkers[i].mAdapter, mAcceptFilter);
+            s.SetDiscoveryFilter(mDiscoveryFilter);
+            found[i] = s.RunFor(aScanMilliseconds);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<Sighting> result;
+    for (std::size_t i = 0; i < found.size(); ++i) {
+        for (auto &peripheral : found[i]) {
+            result.push_back(Sighting{peripheral, peripheral.address(), i, peripheral.rssi()});
+        }
+    }
+    return result;
+}
+
+void FleetScheduler::assign(const std::vector<Sighting> &arSightings)
+{
+    std::map<std::string, std::vector<const Sighting*>> devices;
+    for (auto &sighting : arSightings) {
+        devices[sighting.mAddress].push_back(&sighting);
+    }
+
+    // Place the most constrained devices first, those seen by the fewest adapters.
+    std::vector<std::vector<const Sighting*>*> order;
+    for (auto &[address, sightings] : devices) {
+        order.push_back(&sightings);
+    }
+    std::stable_sort(order.begin(), order.end(), [](auto *a, auto *b) { return a->size() < b->size(); });
+
+    for (auto *sightings : order) {
+        const Sighting *best = nullptr;
+        int best_score = 0;
+        for (auto *sighting : *sightings) {
+            int load = int(mWorkers[sighting->mAdapterIndex].mQueue.size());
+            int score = sighting->mRssi - (load * cLoadPenaltyDbm);
+            if (!best || score > best_score) {
+                best = sighting;
+                best_score = score;
+            }
+        }
+        auto &worker = mWorkers[best->mAdapterIndex];
+        worker.mQueue.push_back(best->mPeripheral);
+        mLogger.Info() << "Assigned " << worker.mQueue.back().address() << " (" << best->mRssi << " dBm) to "
+                       << worker.mAdapter.identifier();
+    }
+}
+
+void FleetScheduler::runWorker(Worker &arWorker, const Job &arJob)
+{
+    std::mutex queue_mutex;
+    auto connection = [&]() {
+        for (;;) {
+            SimpleBLE::Peripheral peripheral;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                if (arWorker.mQueue.empty()) {
+                    return;
+                }
+                peripheral = arWorker.mQueue.front();
+                arWorker.mQueue.pop_front();
+            }
+            runJob(arWorker, peripheral, arJob);
+        }
+    };
+
+    std::vector<std::thread> connections;
+    auto count = std::min(mMaxConnections, arWorker.mQueue.size());
+    for (std::size_t i = 1; i < count; ++i) {
+        connections.emplace_back(connection);
+    }
+    connection();
+    for (auto &thread : connections) {
+        thread.join();
+    }
+}
+
+void FleetScheduler::runJob(Worker &arWorker, SimpleBLE::Peripheral &arPeripheral, const Job &arJob)
+{
+    Result result;
+    result.mIdentifier = arPeripheral.identifier();
+    result.mAddress = arPeripheral.address();
+    result.mAdapter = arWorker.mAdapter.identifier();
+    Metrics::LabelScope labels({{"adapter", result.mAdapter}, {"device", result.mIdentifier}});
+    Timeline::SetThreadName(result.mAdapter + " connection");
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        arJob(arPeripheral);
+        result.mSuccess = true;
+    }
+    catch (const std::exception &e) {
+        result.mError = e.what();
+        Metrics::Get().Count("sessions_failed");
+        mLogger.Error() << "Failed on " << result.mAddress << " via " << result.mAdapter << ": " << result.mError;
+    }
+    result.mDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResults.push_back(result);
+}
+
+} // rsp
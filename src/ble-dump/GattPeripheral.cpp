@@ -0,0 +1,34 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <GattPeripheral.h>
+#include <UUID.h>
+
+namespace rsp {
+
+std::vector<GattPeripheral::Service> SimpleBlePeripheral::Services()
+{
+    std::vector<Service> result;
+    for (auto &service : mPeripheral.services()) {
+        auto &entry = result.emplace_back();
+        entry.mUuid = service.uuid();
+        for (auto &characteristic : service.characteristics()) {
+            entry.mCharacteristics.push_back(characteristic.uuid());
+        }
+    }
+    return result;
+}
+
+void SimpleBlePeripheral::Print(std::ostream &o)
+{
+    o << mPeripheral;
+}
+
+} // rsp
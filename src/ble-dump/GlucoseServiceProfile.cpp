@@ -8,11 +8,15 @@
 * \author      steffen
 */
 
+#include <algorithm>
 #include <cctype>
 #include <GlucoseServiceProfile.h>
 #include <exceptions.h>
 #include <AttributeStream.h>
 #include <magic_enum.hpp>
+#include <Metrics.h>
+#include <Timeline.h>
+#include <Trace.h>
 #include <utils/Rounding.h>
 
 using namespace rsp::utils;
@@ -24,6 +28,22 @@ struct magic_enum::customize::enum_range<rsp::GlucoseServiceProfile::SensorStatu
 
 namespace rsp {
 
+static std::string racpPhase(std::uint16_t aCommand)
+{
+    switch (aCommand) {
+        case GlucoseServiceProfile::cRacpReportAllRecords:
+        case GlucoseServiceProfile::cRacpReportRecordsFrom:
+        case GlucoseServiceProfile::cRacpReportLastRecord:
+            return "racp_transfer";
+        case GlucoseServiceProfile::cRacpReportNumberOfRecords:
+            return "racp_count";
+        case GlucoseServiceProfile::cRacpDeleteAllRecords:
+            return "racp_delete";
+        default:
+            return "racp";
+    }
+}
+
 static std::string tr(std::string_view aString)
 {
     if (aString == "NotAvailable") {
@@ -51,10 +71,9 @@ GlucoseServiceProfile::GlucoseMeasurement::GlucoseMeasurement(AttributeStream &s
     mFlags = Flags(s.Uint8());
     mUnit = (mFlags & Flags::GlucoseInMMol) ? GlucoseUnits::mmol_L : GlucoseUnits::mg_dL;
     mSequenceNo = s.Uint16();
-    mCaptureTime = s.DateTime();
+    mCaptureTime = s.EpochTime();
     if (mFlags & Flags::TimeOffsetPresent) {
-        auto offset = int16_t(s.Uint16());
-        mCaptureTime += std::chrono::minutes(offset);
+        mCaptureTime.mOffsetMinutes = int16_t(s.Uint16());
     }
     if (mFlags & Flags::GlucoseConcentrationPresent) {
         mGlucoseConcentration = s.MedFloat16() * 1000.0f;
@@ -104,9 +123,12 @@ void GlucoseServiceProfile::GlucoseMeasurementContext::Populate(Flags flags, Att
 
 utils::DynamicData& operator<<(utils::DynamicData &o, const GlucoseServiceProfile::GlucoseMeasurement &arGM)
 {
+    // One per thread, the date part is reused by the following records of the same day.
+    thread_local Iso8601Formatter formatter;
+    auto capture_time = formatter.Format(arGM.mCaptureTime);
     o
         .Add("SequenceNo", arGM.mSequenceNo)
-        .Add("CaptureTime", arGM.mCaptureTime.ToISO8601UTC())
+        .Add("CaptureTime", capture_time.empty() ? utils::DynamicData() : utils::DynamicData(std::string(capture_time)))
         .Add("GlucoseConcentration", utils::DynamicData())
         .Add("Unit", utils::DynamicData())
         .Add("Type", utils::DynamicData())
@@ -178,9 +200,9 @@ utils::DynamicData& operator<<(utils::DynamicData &o, const GlucoseServiceProfil
     return o;
 }
 
-utils::DynamicData& operator<<(utils::DynamicData &o, const std::vector<GlucoseServiceProfile::GlucoseMeasurement> &arList)
+utils::DynamicData& operator<<(utils::DynamicData &o, std::span<const GlucoseServiceProfile::GlucoseMeasurement> aList)
 {
-    for (auto &row : arList) {
+    for (auto &row : aList) {
         DynamicData dd_row;
         dd_row << row;
         o.Add(dd_row);
@@ -188,114 +210,358 @@ utils::DynamicData& operator<<(utils::DynamicData &o, const std::vector<GlucoseS
     return o;
 }
 
-GlucoseServiceProfile::GlucoseServiceProfile(const TrustedDevice &arDevice)
-    : BleService<GlucoseServiceProfile>(arDevice, uuid::Identifiers::GlucoseService)
+GlucoseServiceProfile::GlucoseServiceProfile(TrustedDevice &arDevice, std::pmr::memory_resource *apResource)
+    : BleService<GlucoseServiceProfile>(arDevice, uuid::Identifiers::GlucoseService),
+      mRACP(characteristicUuid(uuid::Identifiers::RecordAccessControlPoint)),
+      mGlucoseMeasurement(characteristicUuid(uuid::Identifiers::GlucoseMeasurement)),
+      mGlucoseMeasurementContext(characteristicUuid(uuid::Identifiers::GlucoseMeasurementContext)),
+      mMeasurements(apResource),
+      mDelivery(apResource),
+      mLabels(Metrics::GetLabels())
 {
-    std::string root_uuid = mService.uuid().substr(8);
-
-    mGlucoseMeasurement = ToString(uuid::Identifiers::GlucoseMeasurement) + root_uuid;
+    auto timer = Metrics::Get().Time("subscribe");
     mLogger.Debug() << "Listening on glucose measurement: " << mGlucoseMeasurement;
-    mDevice.GetPeripheral().notify(mService.uuid(), mGlucoseMeasurement, [&](const SimpleBLE::ByteArray &arValue) {
+    mDevice.GetPeripheral().Notify(mServiceUuid, mGlucoseMeasurement, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
+        mLinkStats.Notification("Glucose Measurement");
         measurementHandler(AttributeStream(arValue));
     });
 
-    mGlucoseMeasurementContext = ToString(uuid::Identifiers::GlucoseMeasurementContext) + root_uuid;
     mLogger.Debug() << "Listening on glucose measurement context: " << mGlucoseMeasurementContext;
-    mDevice.GetPeripheral().notify(mService.uuid(), mGlucoseMeasurementContext, [&](const SimpleBLE::ByteArray &arValue) {
+    mDevice.GetPeripheral().Notify(mServiceUuid, mGlucoseMeasurementContext, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
+        mLinkStats.Notification("Glucose Measurement Context");
         measurementContextHandler(AttributeStream(arValue));
     });
 
-    mRACP = ToString(uuid::Identifiers::RecordAccessControlPoint) + root_uuid;
     mLogger.Debug() << "Listening on record access control point: " << mRACP;
-    mDevice.GetPeripheral().notify(mService.uuid(), mRACP, [&](const SimpleBLE::ByteArray &arValue) {
+    mDevice.GetPeripheral().Notify(mServiceUuid, mRACP, [&](const SimpleBLE::ByteArray &arValue) {
+        AllocationStats::PhaseScope allocations(mCallbackPhase.load());
         racpHandler(AttributeStream(arValue));
     });
 }
 
 GlucoseServiceProfile::~GlucoseServiceProfile()
 {
-    mDevice.GetPeripheral().unsubscribe(mService.uuid(), mRACP);
-    mDevice.GetPeripheral().unsubscribe(mService.uuid(), mGlucoseMeasurementContext);
-    mDevice.GetPeripheral().unsubscribe(mService.uuid(), mGlucoseMeasurement);
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mRACP);
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mGlucoseMeasurementContext);
+    mDevice.GetPeripheral().Unsubscribe(mServiceUuid, mGlucoseMeasurement);
 }
 
 size_t GlucoseServiceProfile::GetMeasurementsCount()
 {
     mLogger.Info() << "Requesting record count";
     mRecordCount = 0;
-    sendCommand(0x0401, 2000);
+    sendCommand(cRacpReportNumberOfRecords, 2000);
     return mRecordCount;
 }
 
-const std::vector<GlucoseServiceProfile::GlucoseMeasurement>& GlucoseServiceProfile::ReadAllMeasurements()
+const GlucoseServiceProfile::Measurements& GlucoseServiceProfile::ReadAllMeasurements()
 {
     mLogger.Info() << "Requesting all records";
-    sendCommand(0x0101, 20000);
+    return readMeasurements(cRacpReportAllRecords);
+}
+
+const GlucoseServiceProfile::Measurements& GlucoseServiceProfile::ReadMeasurementsFrom(std::uint16_t aSequenceNo)
+{
+    mLogger.Info() << "Requesting records from sequence number " << aSequenceNo;
+    return readMeasurements(cRacpReportRecordsFrom, aSequenceNo);
+}
+
+const GlucoseServiceProfile::Measurements& GlucoseServiceProfile::ReadLastMeasurement()
+{
+    mLogger.Info() << "Requesting last record";
+    return readMeasurements(cRacpReportLastRecord);
+}
+
+const GlucoseServiceProfile::Measurements& GlucoseServiceProfile::readMeasurements(std::uint16_t aCommand, std::optional<std::uint16_t> aFromSequenceNo)
+{
+    clearMeasurements();
+    sendCommand(aCommand, 20000, aFromSequenceNo);
+    countReceived();
+    spillRecords(0);
+    mLogger.Info() << mLinkStats;
     return mMeasurements;
 }
 
 GlucoseServiceProfile& GlucoseServiceProfile::ClearAllMeasurements()
 {
     mLogger.Info() << "Deleting all records";
-    sendCommand(0x0201, 20000);
+    sendCommand(cRacpDeleteAllRecords, 20000);
     return *this;
 }
 
-void GlucoseServiceProfile::sendCommand(std::uint16_t aCommand, int aTimeoutMs)
+GlucoseServiceProfile& GlucoseServiceProfile::SetRecordSink(std::size_t aMaxRecords, RecordSink aSink)
 {
+    std::lock_guard<std::mutex> lock(mConsumerMutex);
+    auto consumers = std::make_shared<Consumers>(*mpConsumers);
+    consumers->mRecordSink = std::move(aSink);
+    // Records are not buffered while there are subscribers
+    if (consumers->mRecordSink || consumers->mSubscribers.empty()) {
+        setBatchSize(consumers->mRecordSink ? std::max<std::size_t>(aMaxRecords, 1) : 0);
+    }
+    mpConsumers = std::move(consumers);
+    return *this;
+}
+
+GlucoseServiceProfile::SubscriptionId GlucoseServiceProfile::Subscribe(Subscriber aSubscriber)
+{
+    std::lock_guard<std::mutex> lock(mConsumerMutex);
+    auto id = mNextSubscriptionId++;
+    auto consumers = std::make_shared<Consumers>(*mpConsumers);
+    consumers->mSubscribers.emplace_back(id, std::move(aSubscriber));
+    mpConsumers = std::move(consumers);
+    return id;
+}
+
+GlucoseServiceProfile& GlucoseServiceProfile::Unsubscribe(SubscriptionId aId)
+{
+    // Waits for a batch being passed on, which may still call the subscriber.
+    std::scoped_lock lock(mDeliverMutex, mConsumerMutex);
+    auto consumers = std::make_shared<Consumers>(*mpConsumers);
+    std::erase_if(consumers->mSubscribers, [aId](const auto &arEntry) { return arEntry.first == aId; });
+    mpConsumers = std::move(consumers);
+    return *this;
+}
+
+GlucoseServiceProfile& GlucoseServiceProfile::SetBatchSize(std::size_t aMaxRecords)
+{
+    // Notifications may already arrive, e.g. when watching a connected meter.
+    std::lock_guard<std::mutex> lock(mConsumerMutex);
+    setBatchSize(aMaxRecords);
+    return *this;
+}
+
+void GlucoseServiceProfile::setBatchSize(std::size_t aMaxRecords)
+{
+    mMaxRecords = aMaxRecords;
+    if (aMaxRecords) {
+        // Allocated once, so the buffer never grows during a transfer.
+        mMeasurements.clear();
+        mMeasurements.reserve(aMaxRecords + 1);
+    }
+}
+
+void GlucoseServiceProfile::clearMeasurements()
+{
+    std::lock_guard<std::mutex> lock(mConsumerMutex);
+    mMeasurements.clear();
+    mRecordsSpilled = 0;
+}
+
+Task<std::size_t> GlucoseServiceProfile::GetMeasurementsCountAsync(Executor &arExecutor)
+{
+    mLogger.Info() << "Requesting record count";
+    mRecordCount = 0;
+    co_await racp(arExecutor, cRacpReportNumberOfRecords, std::chrono::milliseconds(2000));
+    co_return mRecordCount;
+}
+
+Task<std::vector<GlucoseServiceProfile::GlucoseMeasurement>> GlucoseServiceProfile::ReadAllMeasurementsAsync(Executor &arExecutor)
+{
+    mLogger.Info() << "Requesting all records";
+    clearMeasurements();
+    // Awaited into a local, GCC 12 never starts the coroutine when co_await is part of the condition.
+    bool done = co_await racp(arExecutor, cRacpReportAllRecords, std::chrono::milliseconds(20000));
+    if (!done) {
+        mLogger.Warning() << "Timeout reading records, got " << (mMeasurements.size() + mRecordsSpilled);
+    }
+    {
+        Metrics::LabelScope labels(mLabels);
+        countReceived();
+        spillRecords(0);
+    }
+    mLogger.Info() << mLinkStats;
+    co_return std::vector<GlucoseMeasurement>(mMeasurements.begin(), mMeasurements.end());
+}
+
+Task<void> GlucoseServiceProfile::ClearAllMeasurementsAsync(Executor &arExecutor)
+{
+    mLogger.Info() << "Deleting all records";
+    co_await racp(arExecutor, cRacpDeleteAllRecords, std::chrono::milliseconds(20000));
+}
+
+Task<bool> GlucoseServiceProfile::racp(Executor &arExecutor, std::uint16_t aCommand, std::chrono::milliseconds aTimeout)
+{
+    // A Metrics::Timer would enter its phase on one executor thread and leave it on another.
+    auto start = Metrics::Clock::now();
     mCommandDone = false;
+    mRacpDone.Reset();
     AttributeStream command(2);
     command.Uint16(aCommand);
-    mDevice.GetPeripheral().write_command(mService.uuid(), mRACP, command.GetArray());
-    delay(aTimeoutMs, &mCommandDone);
+    auto value = command.GetArray();
+    if (aCommand == cRacpReportAllRecords) {
+        mLinkStats.CommandSent();
+    }
+    co_await arExecutor.Offload([&]() {
+        mDevice.GetPeripheral().WriteCommand(mServiceUuid, mRACP, value);
+    });
+    bool done = co_await mRacpDone.Wait(arExecutor, aTimeout);
+    {
+        Metrics::LabelScope labels(mLabels);
+        Metrics::Get().AddTime(racpPhase(aCommand), Metrics::Clock::now() - start);
+        if (!done) {
+            Metrics::Get().Count("racp_timeouts");
+        }
+    }
+    co_return done;
+}
+
+void GlucoseServiceProfile::sendCommand(std::uint16_t aCommand, int aTimeoutMs, std::optional<std::uint16_t> aFromSequenceNo)
+{
+    auto timer = Metrics::Get().Time(racpPhase(aCommand));
+    CallbackPhaseScope callback_phase(*this);
+    mCommandDone = false;
+    AttributeStream command(aFromSequenceNo ? 5 : 2);
+    command.Uint16(aCommand);
+    if (aFromSequenceNo) {
+        command.Uint8(cRacpFilterSequenceNumber).Uint16(*aFromSequenceNo);
+    }
+    if ((aCommand & 0xFF) == (cRacpReportAllRecords & 0xFF)) {
+        mLinkStats.CommandSent();
+    }
+    mDevice.GetPeripheral().WriteCommand(mServiceUuid, mRACP, command.GetArray());
+    if (!delay(aTimeoutMs, &mCommandDone)) {
+        Metrics::Get().Count("racp_timeouts");
+    }
+}
+
+void GlucoseServiceProfile::countReceived()
+{
+    auto &metrics = Metrics::Get();
+    metrics.Count("records_received", mMeasurements.size() + mRecordsSpilled);
+    metrics.Count("contexts_received", mContextsReceived.exchange(0));
+    metrics.Count("notification_bytes", mNotificationBytes.exchange(0));
+}
+
+void GlucoseServiceProfile::spillRecords(std::size_t aKeep)
+{
+    std::lock_guard<std::mutex> deliver_lock(mDeliverMutex);
+    std::shared_ptr<const Consumers> consumers;
+    RecordBatch batch;
+    {
+        // Only the batch is taken out here, consumers are called without mConsumerMutex.
+        std::lock_guard<std::mutex> lock(mConsumerMutex);
+        consumers = mpConsumers;
+        if ((!consumers->mRecordSink && consumers->mSubscribers.empty()) || (mMeasurements.size() <= aKeep)) {
+            return;
+        }
+        auto count = mMeasurements.size() - aKeep;
+        auto first = mMeasurements.begin();
+        auto last = first + std::ptrdiff_t(count);
+        if (consumers->mSubscribers.empty()) {
+            // Reuses the capacity of earlier batches
+            mDelivery.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+        }
+        else {
+            // Moved once into a batch, however many subscribers there are.
+            batch = std::make_shared<const std::vector<GlucoseMeasurement>>(std::make_move_iterator(first), std::make_move_iterator(last));
+        }
+        mMeasurements.erase(first, last);
+        mRecordsSpilled += count;
+    }
+
+    if (!batch) {
+        consumers->mRecordSink(std::span<const GlucoseMeasurement>(mDelivery));
+        return;
+    }
+    if (consumers->mRecordSink) {
+        consumers->mRecordSink(std::span<const GlucoseMeasurement>(*batch));
+    }
+    for (auto &[id, subscriber] : consumers->mSubscribers) {
+        for (auto &record : *batch) {
+            subscriber(record, batch);
+        }
+    }
 }
 
 void GlucoseServiceProfile::racpHandler(AttributeStream aStream)
 {
+    mLinkStats.CommandCompleted();
+    Trace::Record(Trace::Events::RacpResponse, aStream.GetArray());
     bool error = false;
-    uint16_t opcode;
+    uint16_t opcode = 0;
     if (aStream.GetArray().size() != 4) {
         error = true;
     }
     else {
         opcode = aStream.Uint16();
         switch (opcode) {
-            case 0x0004:
+            case cRacpNumberOfRecordsResponse:
                 mRecordCount = aStream.Uint16();
                 break;
-            case 0x0006:
-                if (aStream.Uint16() == 0x0101) {
+            case cRacpResponseCode: {
+                // An empty meter, or no records matching the filter, completes with zero records.
+                auto code = std::uint8_t(aStream.Uint16() >> 8);
+                if (code == cRacpSuccess || code == cRacpNoRecordsFound) {
                     break;
                 }
+                error = true;
+                break;
+            }
             default:
                 error = true;
                 break;
         }
     }
+    Timeline::Get().Instant("RACP response", "racp", {{"opcode", std::to_string(opcode)}, {"error", error ? "true" : "false"}});
     if (error) {
         mLogger.Error() << "Unexpected result from RACP (" << opcode << ")";
         mLogger.Info() << "Record: " << aStream;
+        Metrics::Get().Count("racp_errors");
     }
     mCommandDone = true;
+    wake();
+    mRacpDone.Set();
 }
 
 void GlucoseServiceProfile::measurementHandler(AttributeStream aStream)
 {
-    mLogger.Info() << "Measurement: " << aStream;
-    mMeasurements.emplace_back(aStream);
+    Trace::Record(Trace::Events::Measurement, aStream.GetArray());
+    mNotificationBytes += aStream.GetArray().size();
+    std::size_t keep;
+    {
+        std::lock_guard<std::mutex> lock(mConsumerMutex);
+        auto &record = mMeasurements.emplace_back(aStream);
+        auto max_records = mMaxRecords.load();
+        if (!max_records) {
+            return;
+        }
+        if (mMeasurements.size() >= max_records && !(record.mFlags & GlucoseMeasurement::Flags::ContextInformationFollows)) {
+            keep = 0;
+        }
+        else if (mMeasurements.size() > max_records) {
+            // The newest record stays, its context is still to follow.
+            keep = 1;
+        }
+        else {
+            return;
+        }
+    }
+    spillRecords(keep);
 }
 
 void GlucoseServiceProfile::measurementContextHandler(AttributeStream aStream)
 {
-    mLogger.Info() << "Context: " << aStream;
+    Trace::Record(Trace::Events::MeasurementContext, aStream.GetArray());
+    mNotificationBytes += aStream.GetArray().size();
+    mContextsReceived++;
     auto flags = GlucoseMeasurementContext::Flags(aStream.Uint8());
     auto seq_no = aStream.Uint16();
-    for (auto &mes : mMeasurements) {
-        if (mes.mSequenceNo == seq_no) {
-            mes.mContext.Populate(flags, aStream);
-            break;
+    {
+        std::lock_guard<std::mutex> lock(mConsumerMutex);
+        for (auto &mes : mMeasurements) {
+            if (mes.mSequenceNo == seq_no) {
+                mes.mContext.Populate(flags, aStream);
+                break;
+            }
+        }
+        auto max_records = mMaxRecords.load();
+        if (!max_records || (mMeasurements.size() < max_records) || (mMeasurements.back().mSequenceNo != seq_no)) {
+            return;
         }
     }
+    spillRecords(0);
 }
 
 } // namespace rsp
@@ -0,0 +1,115 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <Histogram.h>
+
+namespace rsp {
+
+void Histogram::Record(std::uint64_t aValue, std::uint64_t aCount)
+{
+    if (aCount == 0) {
+        return;
+    }
+    auto index = indexOf(aValue);
+    if (index >= mBuckets.size()) {
+        mBuckets.resize(index + 1);
+    }
+    mBuckets[index] += aCount;
+    mMin = mCount ? std::min(mMin, aValue) : aValue;
+    mMax = std::max(mMax, aValue);
+    mCount += aCount;
+    mSum += aValue * aCount;
+}
+
+void Histogram::Merge(const Histogram &arOther)
+{
+    if (arOther.mCount == 0) {
+        return;
+    }
+    if (arOther.mBuckets.size() > mBuckets.size()) {
+        mBuckets.resize(arOther.mBuckets.size());
+    }
+    for (std::size_t i = 0; i < arOther.mBuckets.size(); ++i) {
+        mBuckets[i] += arOther.mBuckets[i];
+    }
+    mMin = mCount ? std::min(mMin, arOther.mMin) : arOther.mMin;
+    mMax = std::max(mMax, arOther.mMax);
+    mCount += arOther.mCount;
+    mSum += arOther.mSum;
+}
+
+void Histogram::Clear()
+{
+    mBuckets.clear();
+    mCount = 0;
+    mSum = 0;
+    mMin = 0;
+    mMax = 0;
+}
+
+std::uint64_t Histogram::ValueAtPercentile(double aPercentile) const
+{
+    if (mCount == 0) {
+        return 0;
+    }
+    auto rank = std::uint64_t(std::ceil(std::clamp(aPercentile, 0.0, 100.0) / 100.0 * double(mCount)));
+    rank = std::max<std::uint64_t>(rank, 1);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < mBuckets.size(); ++i) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            return std::clamp(highestValueAt(i), mMin, mMax);
+        }
+    }
+    return mMax;
+}
+
+/*
+ * Values below 2 * cSubBuckets have a bucket each. Larger values are shifted down to the range
+ * [cSubBuckets, 2 * cSubBuckets), and the shift selects the group of cSubBuckets buckets.
+ */
+std::size_t Histogram::indexOf(std::uint64_t aValue)
+{
+    if (aValue < 2 * cSubBuckets) {
+        return std::size_t(aValue);
+    }
+    auto shift = unsigned(std::bit_width(aValue)) - 1 - cSubBucketBits;
+    auto sub = aValue >> shift;
+    return std::size_t(cSubBuckets * shift + sub);
+}
+
+std::uint64_t Histogram::highestValueAt(std::size_t aIndex)
+{
+    if (aIndex < 2 * cSubBuckets) {
+        return aIndex;
+    }
+    auto shift = unsigned(aIndex / cSubBuckets) - 1;
+    auto sub = aIndex % cSubBuckets + cSubBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+std::ostream& operator<<(std::ostream &o, const Histogram &arHistogram)
+{
+    o << "count " << arHistogram.GetCount();
+    if (arHistogram.GetCount()) {
+        o << ", min " << arHistogram.GetMin()
+          << ", mean " << std::uint64_t(std::llround(arHistogram.GetMean()))
+          << ", p50 " << arHistogram.ValueAtPercentile(50.0)
+          << ", p90 " << arHistogram.ValueAtPercentile(90.0)
+          << ", p99 " << arHistogram.ValueAtPercentile(99.0)
+          << ", max " << arHistogram.GetMax();
+    }
+    return o;
+}
+
+} // rsp
@@ -0,0 +1,131 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <LinkStats.h>
+
+namespace rsp {
+
+using namespace std::chrono_literals;
+
+// The last second of a transfer is only counted if it is long enough to give a meaningful rate.
+static constexpr auto cMinPartialWindow = 250ms;
+
+void LinkStats::CommandSent(Clock::time_point aTime)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCommandTime = aTime;
+    mLastNotification.reset();
+}
+
+void LinkStats::CommandCompleted(Clock::time_point aTime)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCommandTime) {
+        mCompletion.Record(microseconds(aTime - *mCommandTime));
+        mCommandTime.reset();
+    }
+    for (auto &[name, window] : mRates) {
+        if (!window.mStart) {
+            continue;
+        }
+        auto elapsed = aTime - *window.mStart;
+        if (elapsed >= cMinPartialWindow) {
+            window.mRate.Record(std::uint64_t(double(window.mCount) / std::chrono::duration<double>(std::min<Clock::duration>(elapsed, 1s)).count()));
+        }
+        window.mStart.reset();
+        window.mCount = 0;
+    }
+}
+
+void LinkStats::Notification(const std::string &arCharacteristic, Clock::time_point aTime)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mLastNotification) {
+        mInterArrival.Record(microseconds(aTime - *mLastNotification));
+    }
+    else if (mCommandTime) {
+        mFirstNotification.Record(microseconds(aTime - *mCommandTime));
+    }
+    mLastNotification = aTime;
+
+    auto &window = mRates[arCharacteristic];
+    if (!window.mStart) {
+        window.mStart = aTime;
+    }
+    auto seconds = std::uint64_t((aTime - *window.mStart) / 1s);
+    if (seconds > 0) {
+        // Seconds without notifications, in the middle of a transfer, are counted as zero.
+        window.mRate.Record(window.mCount);
+        window.mRate.Record(0, seconds - 1);
+        *window.mStart += seconds * 1s;
+        window.mCount = 0;
+    }
+    window.mCount++;
+}
+
+void LinkStats::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCommandTime.reset();
+    mLastNotification.reset();
+    mInterArrival.Clear();
+    mFirstNotification.Clear();
+    mCompletion.Clear();
+    mRates.clear();
+}
+
+Histogram LinkStats::GetInterArrival() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mInterArrival;
+}
+
+Histogram LinkStats::GetFirstNotificationLatency() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFirstNotification;
+}
+
+Histogram LinkStats::GetCompletionLatency() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCompletion;
+}
+
+std::map<std::string, Histogram> LinkStats::GetNotificationRates() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::map<std::string, Histogram> result;
+    for (auto &[name, window] : mRates) {
+        result[name] = window.mRate;
+    }
+    return result;
+}
+
+std::uint64_t LinkStats::microseconds(Clock::duration aDuration)
+{
+    return std::uint64_t(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(aDuration).count(), 0));
+}
+
+std::ostream& operator<<(std::ostream &o, const LinkStats &arStats)
+{
+    std::lock_guard<std::mutex> lock(arStats.mMutex);
+    o << "Link statistics:\n"
+      << "  Notification inter-arrival (us): " << arStats.mInterArrival << "\n"
+      << "  RACP to first notification (us): " << arStats.mFirstNotification << "\n"
+      << "  RACP to completion (us): " << arStats.mCompletion;
+    for (auto &[name, window] : arStats.mRates) {
+        o << "\n  " << name << " (notifications/s): " << window.mRate;
+    }
+    return o;
+}
+
+} // rsp
@@ -0,0 +1,292 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <json/JsonEncoder.h>
+#include <Metrics.h>
+#include <Timeline.h>
+#include <utils/DateTime.h>
+
+using namespace rsp::utils;
+
+namespace rsp {
+
+static thread_local Metrics::Labels tLabels{};
+
+static double seconds(Metrics::Clock::duration aDuration)
+{
+    return std::chrono::duration<double>(aDuration).count();
+}
+
+static DynamicData labelsToDynamicData(const Metrics::Labels &arLabels)
+{
+    DynamicData result;
+    for (auto &[name, value] : arLabels) {
+        result.Add(name, value);
+    }
+    return result;
+}
+
+static void writeLabels(std::ostream &o, const Metrics::Labels &arLabels, const std::string &arFirst = {}, const std::string &arValue = {})
+{
+    auto escaped = [](const std::string &arValue) {
+        std::string result;
+        for (char c : arValue) {
+            if (c == '\\' || c == '"') {
+                result += '\\';
+            }
+            result += (c == '\n') ? std::string("\\n") : std::string(1, c);
+        }
+        return result;
+    };
+
+    bool first = true;
+    auto label = [&](const std::string &arName, const std::string &arLabel) {
+        o << (first ? "{" : ",") << arName << "=\"" << escaped(arLabel) << "\"";
+        first = false;
+    };
+    if (!arFirst.empty()) {
+        label(arFirst, arValue);
+    }
+    for (auto &[name, value] : arLabels) {
+        label(name, value);
+    }
+    if (!first) {
+        o << "}";
+    }
+}
+
+Metrics::Timer::Timer(Metrics &arMetrics, std::string aPhase)
+    : mpMetrics(&arMetrics),
+      mPhase(std::move(aPhase)),
+      mStart(Clock::now())
+{
+    mAllocations.emplace(mPhase);
+}
+
+Metrics::Timer::~Timer()
+{
+    Stop();
+}
+
+void Metrics::Timer::Stop()
+{
+    if (mpMetrics) {
+        auto end = Clock::now();
+        mpMetrics->AddTime(mPhase, end - mStart);
+        mpMetrics = nullptr;
+        mAllocations.reset();
+        if (Timeline::IsEnabled()) {
+            Timeline::Get().Complete(mPhase, "phase", mStart, end, tLabels);
+        }
+    }
+}
+
+Metrics::LabelScope::LabelScope(const Labels &arLabels)
+    : mPrevious(tLabels)
+{
+    for (auto &[name, value] : arLabels) {
+        tLabels[name] = value;
+    }
+}
+
+Metrics::LabelScope::~LabelScope()
+{
+    tLabels = std::move(mPrevious);
+}
+
+Metrics& Metrics::Get()
+{
+    static Metrics instance;
+    return instance;
+}
+
+void Metrics::SetLabel(const std::string &arName, const std::string &arValue)
+{
+    tLabels[arName] = arValue;
+}
+
+Metrics::Labels Metrics::GetLabels()
+{
+    return tLabels;
+}
+
+void Metrics::AddTime(const std::string &arPhase, Clock::duration aDuration)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &phase = mPhases[Key(arPhase, tLabels)];
+    phase.mCount++;
+    phase.mTotal += aDuration;
+    phase.mMax = std::max(phase.mMax, aDuration);
+}
+
+void Metrics::Count(const std::string &arName, std::uint64_t aValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCounters[Key(arName, tLabels)] += aValue;
+}
+
+std::uint64_t Metrics::GetCount(const std::string &arName) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::uint64_t result = 0;
+    for (auto &[key, value] : mCounters) {
+        if (key.first == arName) {
+            result += value;
+        }
+    }
+    return result;
+}
+
+void Metrics::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPhases.clear();
+    mCounters.clear();
+}
+
+DynamicData Metrics::ToDynamicData() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    DynamicData phases;
+    for (auto &[key, phase] : mPhases) {
+        DynamicData entry;
+        entry.Add("phase", key.first)
+             .Add("labels", labelsToDynamicData(key.second))
+             .Add("count", phase.mCount)
+             .Add("seconds", seconds(phase.mTotal))
+             .Add("max_seconds", seconds(phase.mMax));
+        phases.Add(entry);
+    }
+
+    DynamicData counters;
+    for (auto &[key, value] : mCounters) {
+        DynamicData entry;
+        entry.Add("name", key.first)
+             .Add("labels", labelsToDynamicData(key.second))
+             .Add("value", value);
+        counters.Add(entry);
+    }
+
+    DynamicData result;
+    result.Add("time", DateTime::Now().ToISO8601UTC()).Add("phases", phases).Add("counters", counters);
+    return result;
+}
+
+void Metrics::WritePrometheus(std::ostream &o) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mPhases.empty()) {
+        o << "# HELP ble_dump_phase_seconds Time spent in each phase of a session.\n"
+             "# TYPE ble_dump_phase_seconds summary\n";
+        for (auto &[key, phase] : mPhases) {
+            o << "ble_dump_phase_seconds_sum";
+            writeLabels(o, key.second, "phase", key.first);
+            o << " " << seconds(phase.mTotal) << "\n";
+            o << "ble_dump_phase_seconds_count";
+            writeLabels(o, key.second, "phase", key.first);
+            o << " " << phase.mCount << "\n";
+        }
+        o << "# HELP ble_dump_phase_max_seconds Longest single run of each phase.\n"
+             "# TYPE ble_dump_phase_max_seconds gauge\n";
+        for (auto &[key, phase] : mPhases) {
+            o << "ble_dump_phase_max_seconds";
+            writeLabels(o, key.second, "phase", key.first);
+            o << " " << seconds(phase.mMax) << "\n";
+        }
+    }
+
+    // All samples of a metric must follow its TYPE line.
+    std::set<std::string> names;
+    for (auto &[key, value] : mCounters) {
+        names.insert(key.first);
+    }
+    for (auto &name : names) {
+        o << "# TYPE ble_dump_" << name << "_total counter\n";
+        for (auto &[key, value] : mCounters) {
+            if (key.first == name) {
+                o << "ble_dump_" << name << "_total";
+                writeLabels(o, key.second);
+                o << " " << value << "\n";
+            }
+        }
+    }
+}
+
+void Metrics::Save(const std::string &arFileName) const
+{
+    std::filesystem::path path(arFileName);
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file;
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        file.open(temporary, std::ios::out | std::ios::trunc);
+        auto extension = path.extension();
+        if (extension == ".prom" || extension == ".txt") {
+            WritePrometheus(file);
+        }
+        else {
+            file << json::JsonEncoder(true).Encode(ToDynamicData()) << std::endl;
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+TimedStreamBuffer::TimedStreamBuffer(std::streambuf &arTarget, std::string aPhase)
+    : mrTarget(arTarget),
+      mPhase(std::move(aPhase))
+{
+    setp(mBuffer.data(), mBuffer.data() + mBuffer.size());
+}
+
+TimedStreamBuffer::~TimedStreamBuffer()
+{
+    sync();
+    Metrics::Get().AddTime(mPhase, mElapsed);
+}
+
+int TimedStreamBuffer::overflow(int aChar)
+{
+    if (!flush()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(aChar, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(aChar);
+        pbump(1);
+    }
+    return traits_type::not_eof(aChar);
+}
+
+int TimedStreamBuffer::sync()
+{
+    return flush() ? 0 : -1;
+}
+
+bool TimedStreamBuffer::flush()
+{
+    auto size = pptr() - pbase();
+    if (size == 0) {
+        return true;
+    }
+    auto start = Metrics::Clock::now();
+    bool result = (mrTarget.sputn(pbase(), size) == size) && (mrTarget.pubsync() == 0);
+    auto end = Metrics::Clock::now();
+    mElapsed += end - start;
+    Timeline::Get().Complete("Write", "io", start, end, {{"bytes", std::to_string(size)}});
+    mCount += std::uint64_t(size);
+    setp(mBuffer.data(), mBuffer.data() + mBuffer.size());
+    return result;
+}
+
+} // rsp
@@ -0,0 +1,245 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <cerrno>
+#include <csignal>
+#include <system_error>
+#include <thread>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <Reactor.h>
+
+namespace rsp {
+
+static int checked(int aResult, const char *apWhat)
+{
+    if (aResult < 0) {
+        throw std::system_error(errno, std::generic_category(), apWhat);
+    }
+    return aResult;
+}
+
+// Process wide termination state, shared by the reactors of all threads.
+static std::atomic_bool sTerminated = false;
+static int sSignalFd = -1;
+static int sStopFd = -1;
+static std::function<void()> sOnTerminate{};
+// Stopped at exit as well, in case RestoreTermination() was never called.
+static struct SignalThread {
+    std::thread mThread{};
+    ~SignalThread() { Reactor::RestoreTermination(); }
+} sSignalThread{};
+
+// Never read, so it stays readable and wakes every reactor once terminated.
+static int shutdownFd()
+{
+    static int fd = checked(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK), "eventfd");
+    return fd;
+}
+
+static sigset_t terminationMask()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    return mask;
+}
+
+Reactor& Reactor::Current()
+{
+    thread_local Reactor reactor;
+    return reactor;
+}
+
+void Reactor::HandleTermination(std::function<void()> aCallback)
+{
+    sOnTerminate = std::move(aCallback);
+    if (sSignalThread.mThread.joinable()) {
+        return;
+    }
+    auto mask = terminationMask();
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    sSignalFd = checked(::signalfd(-1, &mask, SFD_CLOEXEC), "signalfd");
+    sStopFd = checked(::eventfd(0, EFD_CLOEXEC), "eventfd");
+    shutdownFd();
+    // A dedicated thread, so SIGTERM is handled even while no thread waits in a reactor,
+    // e.g. during a blocking scan or connect.
+    sSignalThread.mThread = std::thread(signalThread);
+}
+
+void Reactor::RestoreTermination()
+{
+    if (!sSignalThread.mThread.joinable()) {
+        return;
+    }
+    std::uint64_t one = 1;
+    (void)::write(sStopFd, &one, sizeof(one));
+    sSignalThread.mThread.join();
+    ::close(sStopFd);
+    ::close(sSignalFd);
+    sStopFd = sSignalFd = -1;
+    auto mask = terminationMask();
+    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+    sOnTerminate = nullptr;
+}
+
+bool Reactor::IsTerminated()
+{
+    return sTerminated;
+}
+
+Reactor::Reactor()
+{
+    mEpollFd = checked(::epoll_create1(EPOLL_CLOEXEC), "epoll_create1");
+    mEventFd = checked(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK), "eventfd");
+    mTimerFd = checked(::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK), "timerfd_create");
+    watch(mEventFd, EPOLLIN);
+    watch(mTimerFd, EPOLLIN);
+    watch(shutdownFd(), EPOLLIN);
+}
+
+Reactor::~Reactor()
+{
+    ::close(mTimerFd);
+    ::close(mEventFd);
+    ::close(mEpollFd);
+}
+
+void Reactor::Add(int aFd, std::uint32_t aEvents, Handler aHandler)
+{
+    mHandlers[aFd] = std::move(aHandler);
+    watch(aFd, aEvents);
+}
+
+void Reactor::Remove(int aFd)
+{
+    ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, aFd, nullptr);
+    mHandlers.erase(aFd);
+}
+
+void Reactor::Wake()
+{
+    std::uint64_t one = 1;
+    (void)::write(mEventFd, &one, sizeof(one));
+}
+
+bool Reactor::WaitUntil(std::optional<std::chrono::milliseconds> aTimeout, const std::function<bool()> &arDone)
+{
+    if (arDone()) {
+        return true;
+    }
+    if (aTimeout) {
+        setTimer(std::chrono::steady_clock::now() + *aTimeout);
+    }
+
+    bool timed_out = false;
+    while (!arDone()) {
+        if (timed_out || sTerminated) {
+            break;
+        }
+        epoll_event events[8];
+        int n = ::epoll_wait(mEpollFd, events, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            setTimer(std::nullopt);
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+        }
+        mWakeups++;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            std::uint64_t value;
+            if (fd == mEventFd) {
+                (void)::read(mEventFd, &value, sizeof(value));
+            }
+            else if (fd == mTimerFd) {
+                (void)::read(mTimerFd, &value, sizeof(value));
+                timed_out = true;
+            }
+            else if (fd != shutdownFd()) {
+                auto it = mHandlers.find(fd);
+                if (it != mHandlers.end()) {
+                    it->second(events[i].events);
+                }
+            }
+        }
+    }
+    if (aTimeout) {
+        setTimer(std::nullopt);
+    }
+    return arDone();
+}
+
+void Reactor::setTimer(std::optional<std::chrono::steady_clock::time_point> aDeadline)
+{
+    using namespace std::chrono;
+    // steady_clock is CLOCK_MONOTONIC, so the deadline can be armed as an absolute time.
+    itimerspec spec{};
+    if (aDeadline) {
+        auto ns = duration_cast<nanoseconds>(aDeadline->time_since_epoch()).count();
+        spec.it_value.tv_sec = time_t(ns / 1000000000);
+        spec.it_value.tv_nsec = long(ns % 1000000000);
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1; // Zero would disarm the timer
+        }
+    }
+    checked(::timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr), "timerfd_settime");
+    if (!aDeadline) {
+        std::uint64_t value;
+        (void)::read(mTimerFd, &value, sizeof(value)); // Discard an expiry not yet seen
+    }
+}
+
+void Reactor::watch(int aFd, std::uint32_t aEvents)
+{
+    epoll_event ev{};
+    ev.events = aEvents;
+    ev.data.fd = aFd;
+    if (::epoll_ctl(mEpollFd, EPOLL_CTL_ADD, aFd, &ev) < 0) {
+        if (errno != EEXIST) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+        checked(::epoll_ctl(mEpollFd, EPOLL_CTL_MOD, aFd, &ev), "epoll_ctl");
+    }
+}
+
+void Reactor::signalThread()
+{
+    pollfd fds[2] = {{sSignalFd, POLLIN, 0}, {sStopFd, POLLIN, 0}};
+    while (true) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        signalfd_siginfo info{};
+        if (::read(sSignalFd, &info, sizeof(info)) != sizeof(info) || sTerminated.exchange(true)) {
+            continue;
+        }
+        if (sOnTerminate) {
+            sOnTerminate();
+        }
+        // Wakes every reactor, their WaitUntil() returns once terminated.
+        std::uint64_t one = 1;
+        (void)::write(shutdownFd(), &one, sizeof(one));
+    }
+}
+
+} // rsp
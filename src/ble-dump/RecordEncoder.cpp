@@ -0,0 +1,107 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <json/JsonEncoder.h>
+#include <RecordEncoder.h>
+#include <utils/CsvEncoder.h>
+#include <utils/StrUtils.h>
+
+using namespace rsp::utils;
+
+namespace rsp {
+
+void RecordEncoder::Save(std::ostream &o, const DynamicData &arData, const std::string &arEncoder)
+{
+    if (arEncoder == "csv") {
+        SaveToCsv(o, arData);
+    }
+    else {
+        SaveToJson(o, arData);
+    }
+}
+
+void RecordEncoder::SaveToCsv(std::ostream &o, const DynamicData &arData)
+{
+    saveToCsv(o, arData, true);
+}
+
+void RecordEncoder::saveToCsv(std::ostream &o, const DynamicData &arData, bool aHeader)
+{
+    CsvEncoder csv(aHeader, ';');
+    csv.SetValueFormatter([](std::string &arResult, const DynamicData &arValue) -> bool {
+        if (arValue.AsString() == "HbA1c") {
+            arResult = arValue.AsString();
+            return true;
+        }
+        else if (arValue.GetType() == Variant::Types::Float) {
+            arResult = StrUtils::ToString(arValue.AsFloat(), 1, true);
+            return true;
+        }
+        else if (arValue.IsNull()) {
+            arResult = "";
+            return true;
+        }
+        arResult = arValue.AsString();
+        return false;
+    }).Encode(o, arData);
+}
+
+void RecordEncoder::SaveToJson(std::ostream &o, const DynamicData &arData)
+{
+    json::JsonEncoder json(true);
+    o << json.Encode(arData);
+}
+
+RecordWriter::RecordWriter(std::ostream &o, std::string aEncoder)
+    : mrOut(o),
+      mEncoder(std::move(aEncoder))
+{
+}
+
+RecordWriter& RecordWriter::Add(const DynamicData &arRecord)
+{
+    if (mEncoder == "csv") {
+        mBatch.Add(arRecord);
+    }
+    else {
+        // JSON records are encoded one by one into the array, so there is no batch to keep.
+        mrOut << ((mCount == 0) ? "[\n" : ",\n") << json::JsonEncoder(true).Encode(arRecord);
+    }
+    mBatchSize++;
+    mCount++;
+    return *this;
+}
+
+void RecordWriter::Flush()
+{
+    if (mBatchSize == 0) {
+        return;
+    }
+    if (mEncoder == "csv") {
+        // Only the first batch has the header line
+        RecordEncoder::saveToCsv(mrOut, mBatch, mCount == mBatchSize);
+        mBatch = DynamicData();
+    }
+    mBatchSize = 0;
+}
+
+void RecordWriter::Finish()
+{
+    if (mFinished) {
+        return;
+    }
+    Flush();
+    if (mEncoder != "csv") {
+        mrOut << ((mCount == 0) ? "[]\n" : "\n]\n");
+    }
+    mFinished = true;
+}
+
+} // rsp
@@ -0,0 +1,203 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <ReplayPeripheral.h>
+
+namespace rsp {
+
+using Types = SessionEvent::Types;
+
+ReplayPeripheral::ReplayPeripheral(const std::string &arFileName, double aSpeed)
+    : mSpeed(aSpeed)
+{
+    SessionReader reader(arFileName);
+    mIdentifier = reader.GetIdentifier();
+    mAddress = reader.GetAddress();
+    mRssi = reader.GetRssi();
+    SessionEvent event;
+    while (reader.Next(event)) {
+        mEvents.push_back(std::move(event));
+    }
+    mLogger.Info() << "Loaded " << mEvents.size() << " events recorded from " << mIdentifier << " [" << mAddress << "]";
+}
+
+ReplayPeripheral::~ReplayPeripheral()
+{
+    Disconnect();
+}
+
+void ReplayPeripheral::Disconnect()
+{
+    mConnected = false;
+    stopWorker();
+}
+
+std::vector<GattPeripheral::Service> ReplayPeripheral::Services()
+{
+    // Only the characteristics used in the recording are known.
+    std::vector<Service> result;
+    for (auto &event : mEvents) {
+        auto service = std::find_if(result.begin(), result.end(), [&](const Service &arService) {
+            return arService.mUuid == event.mService;
+        });
+        if (service == result.end()) {
+            service = result.insert(result.end(), Service{event.mService, {}});
+        }
+        auto &list = service->mCharacteristics;
+        if (std::find(list.begin(), list.end(), event.mCharacteristic) == list.end()) {
+            list.push_back(event.mCharacteristic);
+        }
+    }
+    return result;
+}
+
+GattPeripheral::ByteArray ReplayPeripheral::Read(const std::string &, const std::string &arCharacteristic)
+{
+    if (!mConnected) {
+        throw std::runtime_error("Replay is not connected");
+    }
+    auto is_read = [&](const SessionEvent &arEvent) {
+        return (arEvent.mType == Types::Read) && (arEvent.mCharacteristic == arCharacteristic);
+    };
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find_if(mEvents.begin() + std::ptrdiff_t(mPosition), mEvents.end(), is_read);
+    if (it != mEvents.end()) {
+        mPosition = std::size_t(it - mEvents.begin()) + 1;
+        return it->mValue;
+    }
+    // Read again after the recorded session, e.g. a cached attribute
+    it = std::find_if(mEvents.begin(), mEvents.end(), is_read);
+    if (it != mEvents.end()) {
+        return it->mValue;
+    }
+    throw std::runtime_error("Characteristic was not read in the recording: " + arCharacteristic);
+}
+
+void ReplayPeripheral::WriteRequest(const std::string &, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    write(arCharacteristic, {}, arValue);
+}
+
+void ReplayPeripheral::WriteCommand(const std::string &, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    write(arCharacteristic, {}, arValue);
+}
+
+void ReplayPeripheral::WriteDescriptor(const std::string &, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue)
+{
+    write(arCharacteristic, arDescriptor, arValue);
+}
+
+void ReplayPeripheral::Notify(const std::string &, const std::string &arCharacteristic, Callback aCallback)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSubscriptions[arCharacteristic] = std::move(aCallback);
+}
+
+void ReplayPeripheral::Unsubscribe(const std::string &, const std::string &arCharacteristic)
+{
+    // Wait for a notification being delivered, the subscriber may be destroyed once we return
+    std::scoped_lock lock(mDeliverMutex, mMutex);
+    mSubscriptions.erase(arCharacteristic);
+}
+
+void ReplayPeripheral::Print(std::ostream &o)
+{
+    o << "Replay of " << mIdentifier << " [" << mAddress << "] " << mEvents.size() << " events\n";
+    for (auto &service : Services()) {
+        o << "  Service: " << service.mUuid << "\n";
+        for (auto &characteristic : service.mCharacteristics) {
+            o << "    Characteristic: " << characteristic << "\n";
+        }
+    }
+}
+
+void ReplayPeripheral::write(const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue)
+{
+    if (!mConnected) {
+        throw std::runtime_error("Replay is not connected");
+    }
+    stopWorker();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Descriptor writes only match descriptor writes, recordings from before version 2 have no descriptor.
+    auto it = std::find_if(mEvents.begin() + std::ptrdiff_t(mPosition), mEvents.end(), [&](const SessionEvent &arEvent) {
+        return arEvent.IsWrite() && (arEvent.mCharacteristic == arCharacteristic)
+            && ((arEvent.mType == Types::WriteDescriptor) == !arDescriptor.empty())
+            && (arEvent.mDescriptor.empty() || (arEvent.mDescriptor == arDescriptor));
+    });
+    if (it == mEvents.end()) {
+        mLogger.Warning() << "No more writes to " << arCharacteristic << " in the recording";
+        return;
+    }
+    if (it->mValue != arValue) {
+        mLogger.Info() << "Write to " << arCharacteristic << " differs from the recording, replaying the recorded response";
+    }
+    // The response is every notification up to the next operation initiated by the client.
+    auto first = std::size_t(it - mEvents.begin()) + 1;
+    auto end = std::size_t(std::find_if(it + 1, mEvents.end(), [](const SessionEvent &arEvent) {
+        return arEvent.IsWrite() || (arEvent.mType == Types::Read);
+    }) - mEvents.begin());
+    mPosition = end;
+    mAbort = false;
+    mWorker = std::thread([this, first, end]() { replay(first, end); });
+}
+
+void ReplayPeripheral::replay(std::size_t aFirst, std::size_t aEnd)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto origin = mEvents[aFirst - 1].mTime;
+    for (std::size_t i = aFirst; i < aEnd; i++) {
+        auto &event = mEvents[i];
+        if (event.mType != Types::Notification) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mSpeed > 0.0) {
+            auto offset = std::chrono::duration_cast<std::chrono::steady_clock::duration>((event.mTime - origin) / mSpeed);
+            mAbortCondition.wait_until(lock, start + offset, [this]() { return mAbort.load(); });
+        }
+        if (mAbort || !mConnected) {
+            return;
+        }
+        lock.unlock();
+
+        // Held while calling, so Unsubscribe() can wait for the delivery to finish
+        std::lock_guard<std::mutex> deliver_lock(mDeliverMutex);
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> subscriptions_lock(mMutex);
+            auto it = mSubscriptions.find(event.mCharacteristic);
+            if (it == mSubscriptions.end()) {
+                continue;
+            }
+            callback = it->second;
+        }
+        callback(event.mValue);
+        mNotificationsReplayed++;
+        mBytesReplayed += event.mValue.size();
+    }
+}
+
+void ReplayPeripheral::stopWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mAbort = true;
+    }
+    mAbortCondition.notify_all();
+    if (mWorker.joinable() && (mWorker.get_id() != std::this_thread::get_id())) {
+        mWorker.join();
+    }
+}
+
+} // rsp
@@ -8,9 +8,15 @@
 * \author      steffen
 */
 
+#include <charconv>
 #include <chrono>
-#include <thread>
+#include <sstream>
+#include <exceptions.h>
+#include <Metrics.h>
+#include <Reactor.h>
 #include <Scanner.h>
+#include <Timeline.h>
+#include <UUID.h>
 #ifdef __linux__
 #include <simplebluez/Bluez.h>
 #endif
@@ -18,6 +24,51 @@
 
 namespace rsp {
 
+Scanner::DiscoveryFilter::DiscoveryFilter(const std::string &arOptions)
+{
+    std::istringstream in(arOptions);
+    std::string option;
+    while (std::getline(in, option, ',')) {
+        if (option.empty()) {
+            continue;
+        }
+        try {
+            if (option == "le") {
+                mTransport = Transport::LE;
+            }
+            else if (option == "bredr") {
+                mTransport = Transport::BrEdr;
+            }
+            else if (option == "auto") {
+                mTransport = Transport::Auto;
+            }
+            else if (option == "duplicates") {
+                mDuplicateData = true;
+            }
+            else if (option == "no-duplicates") {
+                mDuplicateData = false;
+            }
+            else if (utils::StrUtils::StartsWith(option, "rssi:")) {
+                std::int16_t rssi = 0;
+                auto [end, error] = std::from_chars(option.data() + 5, option.data() + option.size(), rssi);
+                if (error != std::errc() || end != option.data() + option.size()) {
+                    THROW_WITH_BACKTRACE1(EInvalidScanFilter, option);
+                }
+                mMinRssi = rssi;
+            }
+            else if (utils::StrUtils::StartsWith(option, "uuid:")) {
+                mServiceUuids.push_back(uuid::Uuid(option.substr(5)).ToString());
+            }
+            else {
+                THROW_WITH_BACKTRACE1(EInvalidScanFilter, option);
+            }
+        }
+        catch (const std::logic_error&) {
+            THROW_WITH_BACKTRACE1(EInvalidScanFilter, option);
+        }
+    }
+}
+
 Scanner::Scanner(const SimpleBLE::Adapter &arAdapter, std::vector<std::string> aAddressList)
     : mAdapter(arAdapter),
       mAcceptFilter(std::move(aAddressList))
@@ -46,24 +97,22 @@ bool Scanner::RunUntilFound(std::uint32_t aTimeoutMilliseconds)
 
 void Scanner::execute(std::uint32_t aMilliseconds, bool aStopWhenFound)
 {
-#ifdef __linux__
-    // It seems like default discovery filter is not set to Auto on Linux.
-    // Found no way to set the discovery filter in the SimpleBLE API, so this is a SimpleBluez solution only.
-    SimpleBluez::Adapter::DiscoveryFilter filter;
-//    filter.Transport = SimpleBluez::Adapter::DiscoveryFilter::TransportType::LE;
-    filter.Transport = SimpleBluez::Adapter::DiscoveryFilter::TransportType::AUTO;
-    static_cast<SimpleBluez::Adapter*>(mAdapter.underlying())->discovery_filter(filter);
-#endif
+    Metrics::LabelScope labels({{"adapter", mAdapter.identifier()}});
+    auto timer = Metrics::Get().Time("scan");
+    applyDiscoveryFilter();
 
-    mAdapter.set_callback_on_scan_found([this](SimpleBLE::Peripheral aPeripheral) {
-        if (!addressAccepted(aPeripheral)) {
+    auto &reactor = Reactor::Current();
+    mAdapter.set_callback_on_scan_found([this, &reactor](SimpleBLE::Peripheral aPeripheral) {
+        if (!rssiAccepted(aPeripheral) || !addressAccepted(aPeripheral)) {
             return;
         }
         mLogger.Notice() << "Found device: " << aPeripheral.identifier()
                        << " [" << aPeripheral.address() << "] "
                        << aPeripheral.rssi() << " dBm";
+        Timeline::Get().Instant("Found " + aPeripheral.identifier(), "scan", {{"address", aPeripheral.address()}, {"rssi", std::to_string(aPeripheral.rssi())}});
         mScanResult.push_back(aPeripheral);
         mFoundDevice = true;
+        reactor.Wake();
     });
 //    mAdapter.set_callback_on_scan_updated([this](SimpleBLE::Peripheral aPeripheral) {
 //        mLogger.Info() << "Updated device: " << aPeripheral.identifier()
@@ -72,22 +121,71 @@ void Scanner::execute(std::uint32_t aMilliseconds, bool aStopWhenFound)
 //    });
     mAdapter.set_callback_on_scan_start([this]() {
         mLogger.Notice() << "Scanning for Bluetooth devices...";
+        Timeline::Get().Instant("Scan start", "scan", {{"adapter", mAdapter.identifier()}});
     });
     mAdapter.set_callback_on_scan_stop([this]() {
         mLogger.Notice() << "Scan complete.";
+        Timeline::Get().Instant("Scan stop", "scan", {{"adapter", mAdapter.identifier()}});
     });
 
     mScanResult.clear();
     mFoundDevice = false;
-    mAdapter.scan_start();
-    aMilliseconds = (aMilliseconds / 100) + 1;
-    for (int i = 0 ; i < aMilliseconds ; ++i) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        if (aStopWhenFound && mFoundDevice) {
+    try {
+        mAdapter.scan_start();
+        reactor.WaitUntil(std::chrono::milliseconds(aMilliseconds), [this, aStopWhenFound]() {
+            return aStopWhenFound && mFoundDevice;
+        });
+        mAdapter.scan_stop();
+    }
+    catch (...) {
+        clearCallbacks();
+        throw;
+    }
+    clearCallbacks();
+    Metrics::Get().Count("devices_found", mScanResult.size());
+}
+
+void Scanner::clearCallbacks()
+{
+    // The adapter is shared and outlives the scanner, and the callbacks refer to this scanner and the reactor of this thread.
+    mAdapter.set_callback_on_scan_found({});
+    mAdapter.set_callback_on_scan_start({});
+    mAdapter.set_callback_on_scan_stop({});
+}
+
+void Scanner::applyDiscoveryFilter()
+{
+#ifdef __linux__
+    // It seems like default discovery filter is not set to Auto on Linux.
+    // Found no way to set the discovery filter in the SimpleBLE API, so this is a SimpleBluez solution only.
+    using TransportType = SimpleBluez::Adapter::DiscoveryFilter::TransportType;
+    SimpleBluez::Adapter::DiscoveryFilter filter;
+    switch (mDiscoveryFilter.mTransport) {
+        case DiscoveryFilter::Transport::LE:
+            filter.Transport = TransportType::LE;
             break;
-        }
+        case DiscoveryFilter::Transport::BrEdr:
+            filter.Transport = TransportType::BREDR;
+            break;
+        default:
+            filter.Transport = TransportType::AUTO;
+            break;
+    }
+    if (mDiscoveryFilter.mMinRssi) {
+        filter.RSSI = *mDiscoveryFilter.mMinRssi;
     }
-    mAdapter.scan_stop();
+    filter.UUIDs = mDiscoveryFilter.mServiceUuids;
+    if (mDiscoveryFilter.mDuplicateData) {
+        filter.DuplicateData = *mDiscoveryFilter.mDuplicateData;
+    }
+    static_cast<SimpleBluez::Adapter*>(mAdapter.underlying())->discovery_filter(filter);
+#endif
+}
+
+bool Scanner::rssiAccepted(SimpleBLE::Peripheral &arPeripheral) const
+{
+    // Backends without a native discovery filter still deliver everything, so check it here as well.
+    return !mDiscoveryFilter.mMinRssi || (arPeripheral.rssi() >= *mDiscoveryFilter.mMinRssi);
 }
 
 bool Scanner::addressAccepted(SimpleBLE::Peripheral &arPeripheral) const
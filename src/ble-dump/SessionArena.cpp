@@ -0,0 +1,47 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <SessionArena.h>
+
+namespace rsp {
+
+SessionArena::SessionArena(std::pmr::memory_resource *apUpstream)
+    : mPool(apUpstream)
+{
+}
+
+void SessionArena::Release()
+{
+    mPool.release();
+    mBytesInUse = 0;
+}
+
+void* SessionArena::do_allocate(std::size_t aBytes, std::size_t aAlignment)
+{
+    void *p = mPool.allocate(aBytes, aAlignment);
+    auto in_use = mBytesInUse.fetch_add(aBytes) + aBytes;
+    auto peak = mPeakBytes.load();
+    while ((in_use > peak) && !mPeakBytes.compare_exchange_weak(peak, in_use)) {
+    }
+    return p;
+}
+
+void SessionArena::do_deallocate(void *p, std::size_t aBytes, std::size_t aAlignment)
+{
+    mPool.deallocate(p, aBytes, aAlignment);
+    mBytesInUse -= aBytes;
+}
+
+bool SessionArena::do_is_equal(const std::pmr::memory_resource &arOther) const noexcept
+{
+    return this == &arOther;
+}
+
+} // rsp
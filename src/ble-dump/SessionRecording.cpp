@@ -0,0 +1,203 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <AttributeStream.h>
+#include <exceptions.h>
+#include <SessionRecording.h>
+
+namespace rsp {
+
+static constexpr char cMagic[] = "BGSR";
+static constexpr std::uint8_t cVersion = 2;
+// Recordings without the descriptor UUID in WriteDescriptor events are still read
+static constexpr std::uint8_t cMinVersion = 1;
+static constexpr std::size_t cEventHeaderSize = 9;
+
+SessionWriter::SessionWriter(const std::string &arFileName, GattPeripheral &arPeripheral)
+    : mLastEvent(std::chrono::steady_clock::now())
+{
+    mFile.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    mFile.open(arFileName, std::ios::out | std::ios::trunc | std::ios::binary);
+
+    auto identifier = arPeripheral.Identifier().substr(0, 255);
+    auto address = arPeripheral.Address().substr(0, 255);
+    AttributeStream rssi(2);
+    rssi.Uint16(std::uint16_t(arPeripheral.Rssi()));
+    std::string header(cMagic, 4);
+    header += char(cVersion);
+    header += char(identifier.size()) + identifier;
+    header += char(address.size()) + address;
+    header += rssi.GetArray();
+    mFile.write(header.data(), std::streamsize(header.size()));
+    mFile.flush();
+}
+
+void SessionWriter::Write(SessionEvent::Types aType, const std::string &arService, const std::string &arCharacteristic, const GattPeripheral::ByteArray &arValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFailed) {
+        return;
+    }
+    try {
+        auto key = std::make_pair(arService, arCharacteristic);
+        auto it = mIndex.find(key);
+        if (it == mIndex.end()) {
+            it = mIndex.emplace(key, std::uint16_t(mIndex.size())).first;
+            writeEvent(SessionEvent::Types::Characteristic, it->second, 0, arService + " " + arCharacteristic);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - mLastEvent).count();
+        mLastEvent = now;
+        writeEvent(aType, it->second, std::uint32_t(std::min<std::int64_t>(delta, UINT32_MAX)), arValue);
+        // Flushed per event, the recording is most interesting when the application does not end well.
+        mFile.flush();
+    }
+    catch (const std::ios_base::failure &e) {
+        // The recording is still readable up to the last complete event.
+        mFailed = true;
+        mLogger.Error() << "Recording stopped after " << mEvents << " events, write failed: " << e.what();
+    }
+}
+
+void SessionWriter::WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const GattPeripheral::ByteArray &arValue)
+{
+    auto descriptor = arDescriptor.substr(0, 255);
+    Write(SessionEvent::Types::WriteDescriptor, arService, arCharacteristic, char(descriptor.size()) + descriptor + arValue);
+}
+
+void SessionWriter::writeEvent(SessionEvent::Types aType, std::uint16_t aIndex, std::uint32_t aDelta, const GattPeripheral::ByteArray &arValue)
+{
+    auto size = std::uint16_t(std::min<std::size_t>(arValue.size(), UINT16_MAX));
+    AttributeStream header(cEventHeaderSize);
+    header.Uint8(std::uint8_t(aType)).Uint16(aIndex).Uint32(aDelta).Uint16(size);
+    mFile.write(header.GetArray().data(), cEventHeaderSize);
+    mFile.write(arValue.data(), size);
+    mEvents++;
+}
+
+SessionReader::SessionReader(const std::string &arFileName)
+    : mFileName(arFileName)
+{
+    mFile.open(arFileName, std::ios::in | std::ios::binary);
+    GattPeripheral::ByteArray magic;
+    GattPeripheral::ByteArray bytes;
+    if (!readBytes(4, magic) || (magic != std::string(cMagic, 4)) || !readBytes(2, bytes)
+        || (std::uint8_t(bytes[0]) < cMinVersion) || (std::uint8_t(bytes[0]) > cVersion)) {
+        THROW_WITH_BACKTRACE1(EInvalidRecording, arFileName);
+    }
+    mVersion = std::uint8_t(bytes[0]);
+    if (!readBytes(std::uint8_t(bytes[1]), mIdentifier) || !readBytes(1, bytes) || !readBytes(std::uint8_t(bytes[0]), mAddress)
+        || !readBytes(2, bytes)) {
+        THROW_WITH_BACKTRACE1(EInvalidRecording, arFileName);
+    }
+    mRssi = std::int16_t(AttributeStream(bytes).Uint16());
+}
+
+bool SessionReader::Next(SessionEvent &arEvent)
+{
+    GattPeripheral::ByteArray bytes;
+    GattPeripheral::ByteArray value;
+    // A recording cut short by a crash is still good up to the last complete event.
+    while (readBytes(cEventHeaderSize, bytes)) {
+        AttributeStream header(std::move(bytes));
+        auto type = SessionEvent::Types(header.Uint8());
+        auto index = header.Uint16();
+        mTime += std::chrono::microseconds(header.Uint32());
+        if (!readBytes(header.Uint16(), value)) {
+            break;
+        }
+
+        if (type == SessionEvent::Types::Characteristic) {
+            auto pos = value.find(' ');
+            if ((pos == std::string::npos) || (index != mCharacteristics.size())) {
+                THROW_WITH_BACKTRACE1(EInvalidRecording, mFileName);
+            }
+            mCharacteristics.emplace_back(value.substr(0, pos), value.substr(pos + 1));
+            continue;
+        }
+        if ((index >= mCharacteristics.size()) || (type > SessionEvent::Types::Unsubscribe)) {
+            THROW_WITH_BACKTRACE1(EInvalidRecording, mFileName);
+        }
+        arEvent.mType = type;
+        arEvent.mService = mCharacteristics[index].first;
+        arEvent.mCharacteristic = mCharacteristics[index].second;
+        arEvent.mTime = mTime;
+        arEvent.mDescriptor.clear();
+        if ((type == SessionEvent::Types::WriteDescriptor) && (mVersion >= 2)) {
+            auto size = value.empty() ? 0 : std::size_t(std::uint8_t(value[0]));
+            if (value.empty() || (value.size() < 1 + size)) {
+                THROW_WITH_BACKTRACE1(EInvalidRecording, mFileName);
+            }
+            arEvent.mDescriptor = value.substr(1, size);
+            value.erase(0, 1 + size);
+        }
+        arEvent.mValue = std::move(value);
+        return true;
+    }
+    return false;
+}
+
+bool SessionReader::readBytes(std::size_t aSize, GattPeripheral::ByteArray &arResult)
+{
+    arResult.resize(aSize);
+    mFile.read(arResult.data(), std::streamsize(aSize));
+    return mFile && (std::size_t(mFile.gcount()) == aSize);
+}
+
+RecordingPeripheral::RecordingPeripheral(std::shared_ptr<GattPeripheral> aPeripheral, const std::string &arFileName)
+    : mPeripheral(std::move(aPeripheral)),
+      mpWriter(std::make_shared<SessionWriter>(arFileName, *mPeripheral))
+{
+}
+
+GattPeripheral::ByteArray RecordingPeripheral::Read(const std::string &arService, const std::string &arCharacteristic)
+{
+    auto value = mPeripheral->Read(arService, arCharacteristic);
+    mpWriter->Write(SessionEvent::Types::Read, arService, arCharacteristic, value);
+    return value;
+}
+
+// Writes are recorded before they are sent, so the notifications they cause always come after them.
+void RecordingPeripheral::WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    mpWriter->Write(SessionEvent::Types::WriteRequest, arService, arCharacteristic, arValue);
+    mPeripheral->WriteRequest(arService, arCharacteristic, arValue);
+}
+
+void RecordingPeripheral::WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    mpWriter->Write(SessionEvent::Types::WriteCommand, arService, arCharacteristic, arValue);
+    mPeripheral->WriteCommand(arService, arCharacteristic, arValue);
+}
+
+void RecordingPeripheral::WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue)
+{
+    mpWriter->WriteDescriptor(arService, arCharacteristic, arDescriptor, arValue);
+    mPeripheral->WriteDescriptor(arService, arCharacteristic, arDescriptor, arValue);
+}
+
+void RecordingPeripheral::Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback)
+{
+    mpWriter->Write(SessionEvent::Types::Subscribe, arService, arCharacteristic);
+    mPeripheral->Notify(arService, arCharacteristic, [writer = mpWriter, arService, arCharacteristic, callback = std::move(aCallback)](ByteArray aValue) {
+        writer->Write(SessionEvent::Types::Notification, arService, arCharacteristic, aValue);
+        callback(std::move(aValue));
+    });
+}
+
+void RecordingPeripheral::Unsubscribe(const std::string &arService, const std::string &arCharacteristic)
+{
+    mpWriter->Write(SessionEvent::Types::Unsubscribe, arService, arCharacteristic);
+    mPeripheral->Unsubscribe(arService, arCharacteristic);
+}
+
+} // rsp
@@ -0,0 +1,313 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <exceptions.h>
+#include <ShmRing.h>
+
+namespace rsp {
+
+// Longest sleep of a reader that could not join the full waiter count, and may not be woken.
+static constexpr std::chrono::milliseconds cUncountedPoll{10};
+
+// Readers map the ring writable for the futex and need O_RDWR, so they must be the owner or in its group.
+static constexpr mode_t cMode = 0660;
+
+static int checked(int aResult, const std::string &arWhat)
+{
+    if (aResult < 0) {
+        throw std::system_error(errno, std::generic_category(), arWhat);
+    }
+    return aResult;
+}
+
+static std::string objectName(const std::string &arName)
+{
+    return (!arName.empty() && arName[0] == '/') ? arName : "/" + arName;
+}
+
+static void* map(int aFd, std::size_t aSize, const std::string &arName)
+{
+    void *p = ::mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, aFd, 0);
+    if (p == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "mmap " + arName);
+    }
+    return p;
+}
+
+// Shared, not private, futex operations, as the waiters are in other processes.
+static void futexWait(std::atomic<std::uint32_t> &arWord, std::uint32_t aValue, const timespec *apTimeout)
+{
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&arWord), FUTEX_WAIT, aValue, apTimeout, nullptr, 0);
+}
+
+// Returns the number of waiters woken
+static long futexWakeAll(std::atomic<std::uint32_t> &arWord)
+{
+    return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&arWord), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bg_glucose_measurement ToCRecord(const GlucoseServiceProfile::GlucoseMeasurement &arGM)
+{
+    bg_glucose_measurement r{};
+    r.flags = arGM.mFlags;
+    r.sequence_number = arGM.mSequenceNo;
+    r.capture_time_ms = arGM.mCaptureTime.IsKnown() ? arGM.mCaptureTime.UserFacing() * 1000 : 0;
+    r.concentration = arGM.mGlucoseConcentration;
+    r.unit = uint8_t(arGM.mUnit);
+    r.type = uint8_t(arGM.mType);
+    r.location = uint8_t(arGM.mLocation);
+    r.sensor_status = uint16_t(arGM.mSensorStatus);
+
+    auto &ctx = arGM.mContext;
+    r.context_flags = ctx.mFlags;
+    r.carbohydrate_id = uint8_t(ctx.mCarbohydrateID);
+    r.carbohydrate = ctx.mCarbohydrate;
+    r.meal = uint8_t(ctx.mMeal);
+    r.tester = uint8_t(ctx.mTester);
+    r.health = uint8_t(ctx.mHealth);
+    r.exercise_duration_seconds = ctx.mExerciseDurationSeconds;
+    r.exercise_intensity = ctx.mExerciseIntensity;
+    r.medication_id = uint8_t(ctx.mMedicationID);
+    r.medication = ctx.mMedication;
+    r.medication_unit = uint8_t(ctx.mMedicationUnit);
+    r.hba1c = ctx.mHbA1c;
+    return r;
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &arName, std::uint32_t aCapacity)
+    : mName(objectName(arName))
+{
+    auto capacity = std::bit_ceil(std::max<std::uint32_t>(aCapacity, 2));
+    mSize = ShmRingLayout::Size(capacity);
+    mFd = checked(::shm_open(mName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, cMode), "shm_open " + mName);
+    try {
+        if (::flock(mFd, LOCK_EX | LOCK_NB) < 0) {
+            THROW_WITH_BACKTRACE1(EInvalidShmRing, mName + " already has a writer");
+        }
+        struct stat st{};
+        checked(::fstat(mFd, &st), "fstat " + mName);
+        auto existing = std::size_t(st.st_size);
+        if (existing == 0) {
+            // Just created, the mode given to shm_open() is limited by the umask
+            checked(::fchmod(mFd, cMode), "fchmod " + mName);
+        }
+        // Never shrunk, readers of an earlier, larger ring would fault on the slots beyond the end.
+        if (existing < mSize) {
+            checked(::ftruncate(mFd, off_t(mSize)), "ftruncate " + mName);
+        }
+        mpHeader = static_cast<ShmRingLayout::Header*>(map(mFd, mSize, mName));
+        mpSlots = reinterpret_cast<ShmRingLayout::Slot*>(mpHeader + 1);
+    }
+    catch (...) {
+        ::close(mFd);
+        throw;
+    }
+
+    // A ring left by an earlier writer is continued, so its readers keep their place.
+    auto &h = *mpHeader;
+    if (h.mMagic != ShmRingLayout::cMagic || h.mVersion != ShmRingLayout::cVersion
+        || h.mRecordSize != sizeof(bg_glucose_measurement) || h.mCapacity != capacity) {
+        h.mMagic = 0;
+        std::memset(static_cast<void*>(mpSlots), 0, std::size_t(capacity) * sizeof(ShmRingLayout::Slot));
+        h.mVersion = ShmRingLayout::cVersion;
+        h.mRecordSize = sizeof(bg_glucose_measurement);
+        h.mCapacity = capacity;
+        h.mWritten.store(0, std::memory_order_relaxed);
+        // A new generation, so readers still waiting on the old ring do not take themselves off the new count
+        auto generation = (h.mWaiters.load(std::memory_order_relaxed) >> ShmRingLayout::cWaiterGenerationShift) + 1;
+        h.mWaiters.store(generation << ShmRingLayout::cWaiterGenerationShift, std::memory_order_relaxed);
+        // Readers check the magic before anything else
+        std::atomic_ref<std::uint32_t>(h.mMagic).store(ShmRingLayout::cMagic, std::memory_order_release);
+        // Readers asleep on the old ring start over with this one
+        h.mSignal.fetch_add(1, std::memory_order_seq_cst);
+        futexWakeAll(h.mSignal);
+    }
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    ::munmap(mpHeader, mSize);
+    ::close(mFd);
+}
+
+void ShmRingWriter::Write(const GlucoseServiceProfile::GlucoseMeasurement &arRecord)
+{
+    Write(ToCRecord(arRecord));
+}
+
+void ShmRingWriter::Write(const bg_glucose_measurement &arRecord)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &h = *mpHeader;
+    auto n = h.mWritten.load(std::memory_order_relaxed);
+    auto &slot = mpSlots[n & (h.mCapacity - 1)];
+
+    slot.mSequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(static_cast<void*>(&slot.mRecord), &arRecord, sizeof(arRecord));
+    slot.mSequence.store(n + 1, std::memory_order_release);
+    h.mWritten.store(n + 1, std::memory_order_release);
+
+    // Readers announce themselves before checking mSignal, so either they see the new
+    // value, or the writer sees them waiting.
+    h.mSignal.fetch_add(1, std::memory_order_seq_cst);
+    auto waiters = h.mWaiters.load(std::memory_order_seq_cst);
+    if ((waiters & ShmRingLayout::cWaiterMask) && futexWakeAll(h.mSignal) == 0) {
+        // Nobody was asleep, so the count includes readers that went away while waiting. Readers
+        // still about to sleep see the new mSignal value and do not.
+        auto generation = (waiters >> ShmRingLayout::cWaiterGenerationShift) + 1;
+        h.mWaiters.compare_exchange_strong(waiters, generation << ShmRingLayout::cWaiterGenerationShift, std::memory_order_seq_cst);
+    }
+}
+
+ShmRingReader::ShmRingReader(const std::string &arName, bool aFromOldest)
+    : mName(objectName(arName))
+{
+    mFd = checked(::shm_open(mName.c_str(), O_RDWR | O_CLOEXEC, 0), "shm_open " + mName);
+    try {
+        mapRing();
+    }
+    catch (...) {
+        ::close(mFd);
+        throw;
+    }
+    auto written = mpHeader->mWritten.load(std::memory_order_acquire);
+    mNext = aFromOldest ? written - std::min<std::uint64_t>(written, mCapacity) : written;
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    ::munmap(mpHeader, mSize);
+    ::close(mFd);
+}
+
+std::size_t ShmRingReader::Read(const Callback &arCallback, std::optional<std::chrono::milliseconds> aTimeout)
+{
+    auto written = mpHeader->mWritten.load(std::memory_order_acquire);
+    if (written == mNext) {
+        if (!wait(aTimeout)) {
+            return 0;
+        }
+        written = mpHeader->mWritten.load(std::memory_order_acquire);
+    }
+    if (written < mNext || mpHeader->mCapacity != mCapacity) {
+        // A new writer reinitialized the ring, e.g. with another capacity, all its records are new.
+        mapRing();
+        mNext = 0;
+        written = mpHeader->mWritten.load(std::memory_order_acquire);
+    }
+    if (written - mNext > mCapacity) {
+        mLost += written - mCapacity - mNext;
+        mNext = written - mCapacity;
+    }
+
+    std::size_t count = 0;
+    bg_glucose_measurement record;
+    for (; mNext < written; ++mNext) {
+        auto &slot = mpSlots[mNext & (mCapacity - 1)];
+        auto before = slot.mSequence.load(std::memory_order_acquire);
+        std::memcpy(&record, &slot.mRecord, sizeof(record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (before != mNext + 1 || slot.mSequence.load(std::memory_order_relaxed) != before) {
+            mLost++; // Overwritten by the writer, which is a lap ahead
+            continue;
+        }
+        arCallback(record);
+        count++;
+    }
+    return count;
+}
+
+void ShmRingReader::mapRing()
+{
+    struct stat st{};
+    checked(::fstat(mFd, &st), "fstat " + mName);
+    auto size = std::size_t(st.st_size);
+    if (size < sizeof(ShmRingLayout::Header)) {
+        THROW_WITH_BACKTRACE1(EInvalidShmRing, mName);
+    }
+    auto header = static_cast<ShmRingLayout::Header*>(map(mFd, size, mName));
+    auto &h = *header;
+    if (std::atomic_ref<std::uint32_t>(h.mMagic).load(std::memory_order_acquire) != ShmRingLayout::cMagic
+        || h.mVersion != ShmRingLayout::cVersion || h.mRecordSize != sizeof(bg_glucose_measurement)
+        || !std::has_single_bit(h.mCapacity) || ShmRingLayout::Size(h.mCapacity) > size) {
+        ::munmap(header, size);
+        THROW_WITH_BACKTRACE1(EInvalidShmRing, mName);
+    }
+    // Replaces an earlier mapping only once the new one is known to be good
+    if (mpHeader) {
+        ::munmap(mpHeader, mSize);
+    }
+    mpHeader = header;
+    mSize = size;
+    mCapacity = h.mCapacity;
+    mpSlots = reinterpret_cast<const ShmRingLayout::Slot*>(mpHeader + 1);
+}
+
+bool ShmRingReader::wait(std::optional<std::chrono::milliseconds> aTimeout)
+{
+    using namespace std::chrono_literals;
+    auto &h = *mpHeader;
+    auto deadline = std::chrono::steady_clock::now() + aTimeout.value_or(0ms);
+    while (true) {
+        // Join the count, unless it is full, in which case the writer may not wake this reader.
+        auto waiters = h.mWaiters.load(std::memory_order_seq_cst);
+        bool counted = false;
+        while (!counted && (waiters & ShmRingLayout::cWaiterMask) != ShmRingLayout::cWaiterMask) {
+            counted = h.mWaiters.compare_exchange_weak(waiters, waiters + 1, std::memory_order_seq_cst);
+        }
+        auto generation = waiters >> ShmRingLayout::cWaiterGenerationShift;
+        auto leave = [&h, counted, generation]() {
+            auto value = h.mWaiters.load(std::memory_order_relaxed);
+            while (counted && (value >> ShmRingLayout::cWaiterGenerationShift) == generation && (value & ShmRingLayout::cWaiterMask)
+                   && !h.mWaiters.compare_exchange_weak(value, value - 1, std::memory_order_relaxed)) {
+            }
+        };
+
+        auto signal = h.mSignal.load(std::memory_order_seq_cst);
+        if (h.mWritten.load(std::memory_order_acquire) != mNext) {
+            leave();
+            return true;
+        }
+        std::optional<std::chrono::nanoseconds> left;
+        if (aTimeout) {
+            left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+            if (left->count() <= 0) {
+                leave();
+                return false;
+            }
+        }
+        if (!counted) {
+            left = std::min<std::chrono::nanoseconds>(left.value_or(cUncountedPoll), cUncountedPoll);
+        }
+        timespec timeout{};
+        if (left) {
+            timeout.tv_sec = time_t(left->count() / 1000000000);
+            timeout.tv_nsec = long(left->count() % 1000000000);
+        }
+        futexWait(h.mSignal, signal, left ? &timeout : nullptr);
+        leave();
+    }
+}
+
+} // rsp
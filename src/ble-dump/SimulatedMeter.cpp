@@ -0,0 +1,505 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <chrono>
+#include <sstream>
+#include <AttributeStream.h>
+#include <exceptions.h>
+#include <SimulatedMeter.h>
+#include <UUID.h>
+#include <utils/DateTime.h>
+#include <utils/StrUtils.h>
+
+namespace rsp {
+
+using uuid::Identifiers;
+
+// Record Access Control Point op codes and response values, see the Glucose Service specification.
+static constexpr std::uint8_t cOpReportRecords = 0x01;
+static constexpr std::uint8_t cOpDeleteRecords = 0x02;
+static constexpr std::uint8_t cOpAbort = 0x03;
+static constexpr std::uint8_t cOpReportNumberOfRecords = 0x04;
+static constexpr std::uint8_t cOpNumberOfRecordsResponse = 0x05;
+static constexpr std::uint8_t cOpResponseCode = 0x06;
+static constexpr std::uint8_t cOperatorAll = 0x01;
+static constexpr std::uint8_t cOperatorGreaterOrEqual = 0x03;
+static constexpr std::uint8_t cOperatorFirst = 0x05;
+static constexpr std::uint8_t cOperatorLast = 0x06;
+static constexpr std::uint8_t cFilterSequenceNumber = 0x01;
+static constexpr std::uint8_t cSuccess = 0x01;
+static constexpr std::uint8_t cOpCodeNotSupported = 0x02;
+static constexpr std::uint8_t cOperatorNotSupported = 0x04;
+static constexpr std::uint8_t cOperandNotSupported = 0x09;
+static constexpr std::uint8_t cNoRecordsFound = 0x06;
+
+SimulatedMeter::Config::Config(const std::string &arOptions)
+{
+    std::istringstream in(arOptions);
+    std::string option;
+    while (std::getline(in, option, ',')) {
+        if (option.empty()) {
+            continue;
+        }
+        auto pos = option.find(':');
+        if (pos == std::string::npos) {
+            THROW_WITH_BACKTRACE1(EInvalidSimulation, option);
+        }
+        auto name = option.substr(0, pos);
+        auto value = option.substr(pos + 1);
+        try {
+            if (name == "name") {
+                mName = value;
+            }
+            else if (name == "address") {
+                mAddress = value;
+            }
+            else if (name == "rssi") {
+                mRssi = std::int16_t(std::stoi(value));
+            }
+            else if (name == "records") {
+                mRecords = std::stoul(value);
+            }
+            else if (name == "rate") {
+                mRate = std::stod(value);
+            }
+            else if (name == "loss") {
+                mLoss = std::stod(value);
+            }
+            else if (name == "reorder") {
+                mReorder = std::stod(value);
+            }
+            else if (name == "disconnect") {
+                mDisconnectAfter = std::stoul(value);
+            }
+            else if (name == "context") {
+                mContextEvery = std::stoul(value);
+            }
+            else if (name == "live") {
+                mLiveInterval = std::stod(value);
+            }
+            else if (name == "seed") {
+                mSeed = std::uint32_t(std::stoul(value));
+            }
+            else {
+                THROW_WITH_BACKTRACE1(EInvalidSimulation, option);
+            }
+        }
+        catch (const std::logic_error&) {
+            THROW_WITH_BACKTRACE1(EInvalidSimulation, option);
+        }
+    }
+}
+
+SimulatedMeter::SimulatedMeter()
+    : SimulatedMeter(Config())
+{
+}
+
+SimulatedMeter::SimulatedMeter(Config aConfig)
+    : mConfig(std::move(aConfig)),
+      mRandom(mConfig.mSeed)
+{
+    auto text = [](const std::string &arText) { return ByteArray(arText); };
+    mValues[uuid::ToFullString(Identifiers::ModelNumberString)] = text("SIM-1");
+    mValues[uuid::ToFullString(Identifiers::SerialNumberString)] = text("SIM" + std::to_string(mConfig.mSeed));
+    mValues[uuid::ToFullString(Identifiers::FirmwareRevisionString)] = text("1.0.0");
+    mValues[uuid::ToFullString(Identifiers::SoftwareRevisionString)] = text("1.0.0");
+    mValues[uuid::ToFullString(Identifiers::ManufacturerNameString)] = text("RSP Systems");
+    AttributeStream system_id(8);
+    system_id.Uint64(0x0000005E005301ull + mConfig.mSeed);
+    mValues[uuid::ToFullString(Identifiers::SystemId)] = system_id.GetArray();
+    AttributeStream pnp_id(7);
+    pnp_id.Uint8(1).Uint16(0xFFFF).Uint16(0x0001).Uint16(0x0100);
+    mValues[uuid::ToFullString(Identifiers::PnpId)] = pnp_id.GetArray();
+    AttributeStream features(2);
+    features.Uint16(0x0000);
+    mValues[uuid::ToFullString(Identifiers::GlucoseFeature)] = features.GetArray();
+
+    generateRecords();
+}
+
+SimulatedMeter::~SimulatedMeter()
+{
+    mAbort = true;
+    stopWorker();
+    stopLive();
+}
+
+void SimulatedMeter::Connect()
+{
+    mAbort = false;
+    // The disconnect option counts from each connect, like a flaky link would drop every connection.
+    mNotificationsSent = 0;
+    mConnected = true;
+    mLogger.Info() << "Simulated connection to " << mConfig.mName << " [" << mConfig.mAddress << "]";
+    if ((mConfig.mLiveInterval > 0.0) && !mLive.joinable()) {
+        mLive = std::thread([this]() { takeMeasurements(); });
+    }
+}
+
+void SimulatedMeter::Disconnect()
+{
+    mAbort = true;
+    stopWorker();
+    stopLive();
+}
+
+std::vector<GattPeripheral::Service> SimulatedMeter::Services()
+{
+    auto s = [](Identifiers aId) { return uuid::ToFullString(aId); };
+    return {
+        { s(Identifiers::GlucoseService), {
+            s(Identifiers::GlucoseMeasurement),
+            s(Identifiers::GlucoseMeasurementContext),
+            s(Identifiers::GlucoseFeature),
+            s(Identifiers::RecordAccessControlPoint) }},
+        { s(Identifiers::DeviceInformationService), {
+            s(Identifiers::SystemId),
+            s(Identifiers::ModelNumberString),
+            s(Identifiers::SerialNumberString),
+            s(Identifiers::FirmwareRevisionString),
+            s(Identifiers::SoftwareRevisionString),
+            s(Identifiers::ManufacturerNameString),
+            s(Identifiers::PnpId) }},
+        { s(Identifiers::CurrentTimeService), {
+            s(Identifiers::CurrentTime) }}
+    };
+}
+
+GattPeripheral::ByteArray SimulatedMeter::Read(const std::string &, const std::string &arCharacteristic)
+{
+    if (!mConnected) {
+        throw std::runtime_error("Simulated meter is not connected");
+    }
+    if (arCharacteristic == uuid::ToFullString(Identifiers::CurrentTime)) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        AttributeStream s(10);
+        s.DateTime(utils::DateTime(std::chrono::system_clock::now() + mClockOffset), true, true).Uint8(mAdjustReason);
+        return s.GetArray();
+    }
+    auto it = mValues.find(arCharacteristic);
+    if (it == mValues.end()) {
+        throw std::runtime_error("Characteristic is not readable: " + arCharacteristic);
+    }
+    return it->second;
+}
+
+void SimulatedMeter::WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    WriteCommand(arService, arCharacteristic, arValue);
+}
+
+void SimulatedMeter::WriteCommand(const std::string &, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    if (!mConnected) {
+        throw std::runtime_error("Simulated meter is not connected");
+    }
+    if (arCharacteristic == uuid::ToFullString(Identifiers::RecordAccessControlPoint)) {
+        racp(arValue);
+    }
+    else {
+        throw std::runtime_error("Characteristic is not writable: " + arCharacteristic);
+    }
+}
+
+void SimulatedMeter::WriteDescriptor(const std::string &, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue)
+{
+    if (!mConnected) {
+        throw std::runtime_error("Simulated meter is not connected");
+    }
+    if (arDescriptor != uuid::ToFullString(Identifiers::ClientCharacteristicConfiguration)) {
+        throw std::runtime_error("Descriptor is not writable: " + arDescriptor);
+    }
+    AttributeStream s(arValue);
+    std::lock_guard<std::mutex> lock(mMutex);
+    // CurrentTimeServiceProfile::SetTime() writes the Current Time through its configuration descriptor
+    if (arCharacteristic == uuid::ToFullString(Identifiers::CurrentTime) && arValue.size() == 10) {
+        std::chrono::system_clock::time_point time = s.DateTime(true, true);
+        mClockOffset = time - std::chrono::system_clock::now();
+        mAdjustReason = s.Uint8();
+        mLogger.Info() << "Simulated clock set to " << utils::DateTime(time);
+        return;
+    }
+    if (arValue.size() != 2) {
+        throw std::runtime_error("Invalid Client Characteristic Configuration for " + arCharacteristic);
+    }
+    mClientConfigurations[arCharacteristic] = s.Uint16();
+}
+
+std::uint16_t SimulatedMeter::GetClientConfiguration(const std::string &arCharacteristic)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mClientConfigurations.find(arCharacteristic);
+    return (it == mClientConfigurations.end()) ? 0 : it->second;
+}
+
+void SimulatedMeter::Notify(const std::string &, const std::string &arCharacteristic, Callback aCallback)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSubscriptions[arCharacteristic] = std::move(aCallback);
+}
+
+void SimulatedMeter::Unsubscribe(const std::string &, const std::string &arCharacteristic)
+{
+    // Wait for a notification being delivered, the subscriber may be destroyed once we return
+    std::scoped_lock lock(mDeliverMutex, mMutex);
+    mSubscriptions.erase(arCharacteristic);
+}
+
+void SimulatedMeter::Print(std::ostream &o)
+{
+    o << "Services on " << mConfig.mName << " [" << mConfig.mAddress << "] (simulated):" << std::endl;
+    for (auto &service : Services()) {
+        o << "  " << uuid::ToName(uuid::FromString(service.mUuid)) << " [" << service.mUuid << "]" << std::endl;
+        for (auto &characteristic : service.mCharacteristics) {
+            o << "    " << uuid::ToName(uuid::FromString(characteristic)) << " [" << characteristic << "]" << std::endl;
+        }
+    }
+}
+
+void SimulatedMeter::generateRecords()
+{
+    utils::DateTime time(2024, 1, 1, 8, 0, 0);
+
+    mRecords.clear();
+    mRecords.reserve(mConfig.mRecords);
+    for (std::size_t i = 0; i < mConfig.mRecords; i++) {
+        mRecords.push_back(makeRecord(std::uint16_t(i + 1), time, mRandom));
+        time += std::chrono::hours(4);
+    }
+}
+
+SimulatedMeter::Record SimulatedMeter::makeRecord(std::uint16_t aSequenceNo, const utils::DateTime &arTime, std::mt19937 &arRandom) const
+{
+    std::uniform_real_distribution<float> glucose(3.5f, 12.0f);
+    std::uniform_int_distribution<int> meal(1, 5);
+    bool has_context = mConfig.mContextEvery && (aSequenceNo % mConfig.mContextEvery == 0);
+    Record rec;
+
+    // Concentration and sensor status present, in mol/L, and a context follows if any.
+    AttributeStream m(15);
+    m.Uint8(std::uint8_t(0x02 | 0x04 | 0x08 | (has_context ? 0x10 : 0x00)))
+     .Uint16(aSequenceNo)
+     .DateTime(arTime)
+     .MedFloat16(std::round(glucose(arRandom) * 10.0f) / 10000.0f)
+     .Uint8(0x12)   // Capillary whole blood from finger
+     .Uint16(0x0000);
+    rec.mMeasurement = m.GetArray();
+
+    if (has_context) {
+        AttributeStream c(7);
+        c.Uint8(0x01 | 0x02)   // Carbohydrates and meal present
+         .Uint16(aSequenceNo)
+         .Uint8(std::uint8_t(meal(arRandom)))
+         .MedFloat16(0.05f)
+         .Uint8(std::uint8_t(meal(arRandom)));
+        rec.mContext = c.GetArray();
+    }
+    return rec;
+}
+
+void SimulatedMeter::takeMeasurements()
+{
+    const auto measurement = uuid::ToFullString(Identifiers::GlucoseMeasurement);
+    const auto context = uuid::ToFullString(Identifiers::GlucoseMeasurementContext);
+    const auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(mConfig.mLiveInterval));
+    std::mt19937 random(mConfig.mSeed + 1);
+    auto seq_no = std::uint16_t(mRecords.size());
+
+    std::unique_lock<std::mutex> lock(mLiveMutex);
+    while (!mLiveWake.wait_for(lock, interval, [this]() { return !mConnected; })) {
+        lock.unlock();
+        auto record = makeRecord(++seq_no, utils::DateTime::Now(), random);
+        mLogger.Info() << "Simulated measurement " << seq_no << " taken";
+        if (notify(measurement, record.mMeasurement) && !record.mContext.empty()) {
+            notify(context, record.mContext);
+        }
+        lock.lock();
+    }
+}
+
+void SimulatedMeter::stopLive()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLiveMutex);
+        mConnected = false;
+    }
+    mLiveWake.notify_all();
+    if (mLive.joinable()) {
+        mLive.join();
+    }
+}
+
+void SimulatedMeter::racp(const ByteArray &arCommand)
+{
+    // Requests are answered from a worker thread, as notifications from the Bluetooth stack are.
+    mAbort = true;
+    stopWorker();
+    mAbort = false;
+    mWorker = std::thread([this, command = arCommand]() {
+        if (command.size() < 2) {
+            respond(command.empty() ? 0 : std::uint8_t(command[0]), cOperatorNotSupported);
+            return;
+        }
+        auto op_code = std::uint8_t(command[0]);
+        auto op = std::uint8_t(command[1]);
+        switch (op_code) {
+            case cOpReportRecords:
+                if (mRecords.empty()) {
+                    respond(op_code, cNoRecordsFound);
+                }
+                else if (op == cOperatorAll) {
+                    reportRecords(0, mRecords.size());
+                }
+                else if (op == cOperatorFirst) {
+                    reportRecords(0, 1);
+                }
+                else if (op == cOperatorLast) {
+                    reportRecords(mRecords.size() - 1, 1);
+                }
+                else if (op == cOperatorGreaterOrEqual) {
+                    if ((command.size() != 5) || (std::uint8_t(command[2]) != cFilterSequenceNumber)) {
+                        respond(op_code, cOperandNotSupported);
+                        break;
+                    }
+                    // Sequence numbers start at 1 and follow the record index
+                    auto seq_no = std::size_t(std::uint8_t(command[3]) | (std::uint8_t(command[4]) << 8));
+                    auto first = std::max<std::size_t>(seq_no, 1) - 1;
+                    if (first >= mRecords.size()) {
+                        respond(op_code, cNoRecordsFound);
+                    }
+                    else {
+                        reportRecords(first, mRecords.size() - first);
+                    }
+                }
+                else {
+                    respond(op_code, cOperatorNotSupported);
+                }
+                break;
+
+            case cOpDeleteRecords:
+                if (op == cOperatorAll) {
+                    mRecords.clear();
+                    respond(op_code, cSuccess);
+                }
+                else {
+                    respond(op_code, cOperatorNotSupported);
+                }
+                break;
+
+            case cOpAbort:
+                respond(op_code, cSuccess);
+                break;
+
+            case cOpReportNumberOfRecords: {
+                AttributeStream s(4);
+                s.Uint8(cOpNumberOfRecordsResponse).Uint8(0).Uint16(std::uint16_t(mRecords.size()));
+                notify(uuid::ToFullString(Identifiers::RecordAccessControlPoint), s.GetArray());
+                break;
+            }
+
+            default:
+                respond(op_code, cOpCodeNotSupported);
+                break;
+        }
+    });
+}
+
+void SimulatedMeter::reportRecords(std::size_t aFirst, std::size_t aCount)
+{
+    const auto measurement = uuid::ToFullString(Identifiers::GlucoseMeasurement);
+    const auto context = uuid::ToFullString(Identifiers::GlucoseMeasurementContext);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    auto send = [&](const Record &arRecord) {
+        if (chance(mRandom) < mConfig.mLoss) {
+            return true; // Lost records show up as gaps in the sequence numbers
+        }
+        return notify(measurement, arRecord.mMeasurement) && (arRecord.mContext.empty() || notify(context, arRecord.mContext));
+    };
+
+    const Record *held = nullptr;
+    for (std::size_t i = aFirst; i < aFirst + aCount; i++) {
+        if (mAbort) {
+            return;
+        }
+        if (!held && (chance(mRandom) < mConfig.mReorder)) {
+            held = &mRecords[i];
+            continue;
+        }
+        if (!send(mRecords[i])) {
+            return;
+        }
+        if (held) {
+            if (!send(*held)) {
+                return;
+            }
+            held = nullptr;
+        }
+    }
+    if (held && !send(*held)) {
+        return;
+    }
+    respond(cOpReportRecords, cSuccess);
+}
+
+bool SimulatedMeter::notify(const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    if (!mConnected || mAbort) {
+        return false;
+    }
+    if (mConfig.mDisconnectAfter && (mNotificationsSent >= mConfig.mDisconnectAfter)) {
+        mLogger.Info() << "Simulating disconnect after " << mNotificationsSent << " notifications";
+        mConnected = false;
+        return false;
+    }
+    if (mConfig.mRate > 0.0) {
+        // Paced from the previous notification, but without catching up after idle periods.
+        // The slot is reserved under the lock, the wait for it is not.
+        std::chrono::steady_clock::time_point slot;
+        {
+            std::lock_guard<std::mutex> lock(mPaceMutex);
+            slot = std::max(mNextNotification, std::chrono::steady_clock::now());
+            mNextNotification = slot + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / mConfig.mRate));
+        }
+        std::this_thread::sleep_until(slot);
+    }
+    mNotificationsSent++;
+
+    // One notification at a time, like from the single callback thread of the Bluetooth stack
+    std::lock_guard<std::mutex> deliver_lock(mDeliverMutex);
+    Callback callback;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mSubscriptions.find(arCharacteristic);
+        if (it == mSubscriptions.end()) {
+            return true;
+        }
+        callback = it->second;
+    }
+    callback(arValue);
+    return true;
+}
+
+void SimulatedMeter::respond(std::uint8_t aOpCode, std::uint8_t aStatus)
+{
+    AttributeStream s(4);
+    s.Uint8(cOpResponseCode).Uint8(0).Uint8(aOpCode).Uint8(aStatus);
+    notify(uuid::ToFullString(Identifiers::RecordAccessControlPoint), s.GetArray());
+}
+
+void SimulatedMeter::stopWorker()
+{
+    if (mWorker.joinable() && (mWorker.get_id() != std::this_thread::get_id())) {
+        mWorker.join();
+    }
+}
+
+} // rsp
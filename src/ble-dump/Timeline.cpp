@@ -0,0 +1,244 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <Timeline.h>
+#include <UUID.h>
+
+namespace rsp {
+
+std::atomic_bool Timeline::mEnabled = false;
+
+static void writeString(std::ostream &o, const std::string &arValue)
+{
+    o << '"';
+    for (char c : arValue) {
+        if (c == '"' || c == '\\') {
+            o << '\\' << c;
+        }
+        else if (std::uint8_t(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+            o << escaped;
+        }
+        else {
+            o << c;
+        }
+    }
+    o << '"';
+}
+
+// Trace event times are in microseconds, kept with nanosecond precision.
+static void writeTime(std::ostream &o, std::int64_t aNanoseconds)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(aNanoseconds / 1000), static_cast<long long>(aNanoseconds % 1000));
+    o << text;
+}
+
+static std::string characteristicName(const std::string &arUuid)
+{
+    try {
+        auto name = uuid::ToName(uuid::FromString(arUuid));
+        return name.empty() ? arUuid : std::string(name);
+    }
+    catch (const std::exception&) {
+        return arUuid;
+    }
+}
+
+Timeline::Scope::Scope(std::string aName, const char *apCategory, Args aArgs)
+    : mEnabled(Timeline::IsEnabled()),
+      mName(std::move(aName)),
+      mpCategory(apCategory),
+      mArgs(std::move(aArgs)),
+      mStart(Clock::now())
+{
+}
+
+Timeline::Scope::~Scope()
+{
+    if (mEnabled) {
+        Timeline::Get().Complete(std::move(mName), mpCategory, mStart, Clock::now(), std::move(mArgs));
+    }
+}
+
+Timeline& Timeline::Get()
+{
+    static Timeline instance;
+    return instance;
+}
+
+std::uint32_t Timeline::threadId()
+{
+    static std::atomic<std::uint32_t> next = 1;
+    thread_local std::uint32_t id = next++;
+    return id;
+}
+
+void Timeline::SetThreadName(const std::string &arName)
+{
+    auto &timeline = Get();
+    std::lock_guard<std::mutex> lock(timeline.mMutex);
+    timeline.mThreadNames[threadId()] = arName;
+}
+
+void Timeline::Enable(bool aEnable)
+{
+    mEnabled = aEnable;
+}
+
+void Timeline::Complete(std::string aName, const char *apCategory, Clock::time_point aStart, Clock::time_point aEnd, Args aArgs)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    Event event;
+    event.mType = 'X';
+    event.mName = std::move(aName);
+    event.mpCategory = apCategory;
+    event.mStart = std::chrono::duration_cast<std::chrono::nanoseconds>(aStart - mOrigin).count();
+    event.mDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(aEnd - aStart).count();
+    event.mArgs = std::move(aArgs);
+    add(std::move(event));
+}
+
+void Timeline::Instant(std::string aName, const char *apCategory, Args aArgs)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    Event event;
+    event.mType = 'i';
+    event.mName = std::move(aName);
+    event.mpCategory = apCategory;
+    event.mStart = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mOrigin).count();
+    event.mArgs = std::move(aArgs);
+    add(std::move(event));
+}
+
+void Timeline::add(Event aEvent)
+{
+    aEvent.mThread = threadId();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEvents.push_back(std::move(aEvent));
+}
+
+void Timeline::Write(std::ostream &o) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    o << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&]() {
+        o << (first ? "" : ",\n");
+        first = false;
+    };
+    for (auto &[thread, name] : mThreadNames) {
+        separator();
+        o << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":";
+        writeString(o, name);
+        o << "}}";
+    }
+    for (auto &event : mEvents) {
+        separator();
+        o << "{\"ph\":\"" << event.mType << "\",\"name\":";
+        writeString(o, event.mName);
+        o << ",\"cat\":\"" << event.mpCategory << "\",\"pid\":1,\"tid\":" << event.mThread << ",\"ts\":";
+        writeTime(o, event.mStart);
+        if (event.mType == 'X') {
+            o << ",\"dur\":";
+            writeTime(o, event.mDuration);
+        }
+        else {
+            o << ",\"s\":\"t\"";
+        }
+        if (!event.mArgs.empty()) {
+            o << ",\"args\":{";
+            bool first_arg = true;
+            for (auto &[name, value] : event.mArgs) {
+                o << (first_arg ? "" : ",");
+                writeString(o, name);
+                o << ":";
+                writeString(o, value);
+                first_arg = false;
+            }
+            o << "}";
+        }
+        o << "}";
+    }
+    o << "\n]}\n";
+}
+
+void Timeline::Save(const std::string &arFileName) const
+{
+    std::ofstream file;
+    file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    file.open(arFileName, std::ios::out | std::ios::trunc);
+    Write(file);
+}
+
+void TimelinePeripheral::Disconnect()
+{
+    Timeline::Scope scope("Disconnect", "gatt");
+    mPeripheral->Disconnect();
+}
+
+std::vector<GattPeripheral::Service> TimelinePeripheral::Services()
+{
+    Timeline::Scope scope("Services", "gatt");
+    return mPeripheral->Services();
+}
+
+GattPeripheral::ByteArray TimelinePeripheral::Read(const std::string &arService, const std::string &arCharacteristic)
+{
+    auto start = Timeline::Clock::now();
+    auto value = mPeripheral->Read(arService, arCharacteristic);
+    Timeline::Get().Complete("Read " + characteristicName(arCharacteristic), "gatt", start, Timeline::Clock::now(),
+                             {{"bytes", std::to_string(value.size())}});
+    return value;
+}
+
+void TimelinePeripheral::WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    Timeline::Scope scope("WriteRequest " + characteristicName(arCharacteristic), "gatt", {{"bytes", std::to_string(arValue.size())}});
+    mPeripheral->WriteRequest(arService, arCharacteristic, arValue);
+}
+
+void TimelinePeripheral::WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue)
+{
+    Timeline::Scope scope("WriteCommand " + characteristicName(arCharacteristic), "gatt", {{"bytes", std::to_string(arValue.size())}});
+    mPeripheral->WriteCommand(arService, arCharacteristic, arValue);
+}
+
+void TimelinePeripheral::WriteDescriptor(const std::string &arService, const std::string &arCharacteristic, const std::string &arDescriptor, const ByteArray &arValue)
+{
+    Timeline::Scope scope("WriteDescriptor " + characteristicName(arCharacteristic), "gatt", {{"bytes", std::to_string(arValue.size())}});
+    mPeripheral->WriteDescriptor(arService, arCharacteristic, arDescriptor, arValue);
+}
+
+void TimelinePeripheral::Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback)
+{
+    Timeline::Scope scope("Subscribe " + characteristicName(arCharacteristic), "gatt");
+    auto name = "Notification " + characteristicName(arCharacteristic);
+    mPeripheral->Notify(arService, arCharacteristic, [name, callback = std::move(aCallback)](ByteArray aValue) {
+        Timeline::Get().Instant(name, "gatt", {{"bytes", std::to_string(aValue.size())}});
+        callback(std::move(aValue));
+    });
+}
+
+void TimelinePeripheral::Unsubscribe(const std::string &arService, const std::string &arCharacteristic)
+{
+    Timeline::Scope scope("Unsubscribe " + characteristicName(arCharacteristic), "gatt");
+    mPeripheral->Unsubscribe(arService, arCharacteristic);
+}
+
+} // rsp
@@ -0,0 +1,319 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <Trace.h>
+#include <UUID.h>
+
+namespace rsp {
+
+namespace {
+
+/*
+ * Each slot is a seqlock: the sequence is odd while the owner thread writes it,
+ * so readers on other threads can tell a torn copy and skip it.
+ */
+struct alignas(64) Slot {
+    std::atomic<std::uint64_t> mSequence{0};
+    std::int64_t mTime = 0;
+    std::uint32_t mThread = 0;
+    std::uint16_t mEvent = 0;
+    std::uint16_t mSize = 0;
+    std::uint32_t mTag = 0;
+    char mData[Trace::cMaxPayload]{};
+};
+static_assert(sizeof(Slot) == 64, "A trace slot should fill one cache line");
+
+struct Ring {
+    std::atomic_bool mInUse{true};
+    std::uint32_t mThread = 0;
+    std::atomic<std::uint64_t> mNext{0};
+    std::array<Slot, Trace::cRingSize> mSlots{};
+};
+
+struct Entry {
+    std::int64_t mTime = 0;
+    std::uint32_t mThread = 0;
+    std::uint16_t mEvent = 0;
+    std::uint16_t mSize = 0;
+    std::uint32_t mTag = 0;
+    char mData[Trace::cMaxPayload]{};
+};
+
+const char* const cEventNames[] = {
+    "None",
+    "Measurement",
+    "MeasurementContext",
+    "RacpResponse",
+    "CharacteristicRead",
+    "CgmMeasurement",
+    "CgmOpsResponse"
+};
+
+// Rings are never freed, the ring of a finished thread is reused by the next new thread.
+std::mutex gMutex{};
+std::array<std::atomic<Ring*>, Trace::cMaxThreads> gRings{};
+std::uint32_t gThreadCount = 0;
+const auto gStart = std::chrono::steady_clock::now();
+
+class Owner
+{
+public:
+    ~Owner()
+    {
+        if (mpRing) {
+            mpRing->mInUse = false;
+        }
+    }
+
+    Ring* Get()
+    {
+        if (!mpRing && !mFull) {
+            acquire();
+        }
+        return mpRing;
+    }
+
+protected:
+    Ring *mpRing = nullptr;
+    bool mFull = false;
+
+    void acquire()
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        for (auto &ring : gRings) {
+            auto *p = ring.load();
+            if (!p) {
+                p = new Ring();
+                ring.store(p);
+            }
+            else if (p->mInUse) {
+                continue;
+            }
+            p->mInUse = true;
+            p->mThread = ++gThreadCount;
+            mpRing = p;
+            return;
+        }
+        // More threads than rings, this thread is not traced.
+        mFull = true;
+    }
+};
+
+thread_local Owner tOwner{};
+
+const char* eventName(std::uint16_t aEvent)
+{
+    return (aEvent < std::size(cEventNames)) ? cEventNames[aEvent] : "Unknown";
+}
+
+bool readSlot(const Slot &arSlot, Entry &arEntry)
+{
+    auto sequence = arSlot.mSequence.load(std::memory_order_acquire);
+    if ((sequence == 0) || (sequence & 1)) {
+        return false;
+    }
+    arEntry.mTime = arSlot.mTime;
+    arEntry.mThread = arSlot.mThread;
+    arEntry.mEvent = arSlot.mEvent;
+    arEntry.mSize = arSlot.mSize;
+    arEntry.mTag = arSlot.mTag;
+    std::memcpy(arEntry.mData, arSlot.mData, sizeof(arEntry.mData));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return arSlot.mSequence.load(std::memory_order_relaxed) == sequence;
+}
+
+/*
+ * Line formatting for the crash handler, into a fixed buffer without allocations.
+ */
+class SignalLine
+{
+public:
+    SignalLine& Text(const char *apText)
+    {
+        while (*apText && (mSize < sizeof(mBuffer))) {
+            mBuffer[mSize++] = *apText++;
+        }
+        return *this;
+    }
+
+    SignalLine& Decimal(std::uint64_t aValue, int aWidth = 0)
+    {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = char('0' + (aValue % 10));
+            aValue /= 10;
+        } while (aValue);
+        while (count < aWidth) {
+            digits[count++] = '0';
+        }
+        while (count && (mSize < sizeof(mBuffer))) {
+            mBuffer[mSize++] = digits[--count];
+        }
+        return *this;
+    }
+
+    SignalLine& Hex(std::uint8_t aByte)
+    {
+        char text[4] = { cHexDigits[aByte >> 4], cHexDigits[aByte & 0x0F], ' ', 0 };
+        return Text(text);
+    }
+
+    SignalLine& Hex(std::uint32_t aValue)
+    {
+        char text[11] = "0x";
+        int count = 2;
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            if ((aValue >> shift) || (shift == 0) || (count > 2)) {
+                text[count++] = cHexDigits[(aValue >> shift) & 0x0F];
+            }
+        }
+        text[count] = 0;
+        return Text(text);
+    }
+
+    void Write(int aFd)
+    {
+        Text("\n");
+        auto written = ::write(aFd, mBuffer, mSize);
+        (void)written;
+        mSize = 0;
+    }
+
+protected:
+    static constexpr const char *cHexDigits = "0123456789abcdef";
+    char mBuffer[256]{};
+    std::size_t mSize = 0;
+};
+
+void crashHandler(int aSignal)
+{
+    static std::atomic_flag active = ATOMIC_FLAG_INIT;
+    if (!active.test_and_set()) {
+        SignalLine line;
+        line.Text("Trace of the last events before signal ").Decimal(std::uint64_t(aSignal)).Text(":").Write(STDERR_FILENO);
+        for (auto &ring_ptr : gRings) {
+            auto *ring = ring_ptr.load();
+            if (!ring) {
+                break;
+            }
+            auto next = ring->mNext.load(std::memory_order_relaxed);
+            for (std::uint64_t i = (next > Trace::cRingSize) ? next - Trace::cRingSize : 0; i < next; ++i) {
+                Entry entry;
+                if (!readSlot(ring->mSlots[i % Trace::cRingSize], entry)) {
+                    continue;
+                }
+                auto us = std::uint64_t(std::max<std::int64_t>(entry.mTime, 0) / 1000);
+                line.Decimal(us / 1000000).Text(".").Decimal(us % 1000000, 6)
+                    .Text(" [").Decimal(entry.mThread).Text("] ").Text(eventName(entry.mEvent));
+                if (entry.mTag) {
+                    line.Text(" ").Hex(entry.mTag);
+                }
+                line.Text(" (").Decimal(entry.mSize).Text("): ");
+                for (std::size_t b = 0; b < std::min<std::size_t>(entry.mSize, Trace::cMaxPayload); ++b) {
+                    line.Hex(std::uint8_t(entry.mData[b]));
+                }
+                line.Write(STDERR_FILENO);
+            }
+        }
+    }
+    std::raise(aSignal);
+}
+
+} // namespace
+
+void Trace::Record(Events aEvent, std::string_view aPayload, std::uint32_t aTag)
+{
+    auto *ring = tOwner.Get();
+    if (!ring) {
+        return;
+    }
+    auto next = ring->mNext.load(std::memory_order_relaxed);
+    auto &slot = ring->mSlots[next % cRingSize];
+    auto sequence = 2 * (next + 1);
+    slot.mSequence.store(sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.mTime = std::chrono::duration_cast<Timestamp>(std::chrono::steady_clock::now() - gStart).count();
+    slot.mThread = ring->mThread;
+    slot.mEvent = std::uint16_t(aEvent);
+    slot.mSize = std::uint16_t(std::min<std::size_t>(aPayload.size(), 0xFFFF));
+    slot.mTag = aTag;
+    std::memcpy(slot.mData, aPayload.data(), std::min(aPayload.size(), cMaxPayload));
+
+    slot.mSequence.store(sequence, std::memory_order_release);
+    ring->mNext.store(next + 1, std::memory_order_relaxed);
+}
+
+Trace::Timestamp Trace::Dump(std::ostream &o, Timestamp aAfter)
+{
+    std::vector<Entry> entries;
+    for (auto &ring_ptr : gRings) {
+        auto *ring = ring_ptr.load();
+        if (!ring) {
+            break;
+        }
+        for (auto &slot : ring->mSlots) {
+            Entry entry;
+            if (readSlot(slot, entry) && (Timestamp(entry.mTime) > aAfter)) {
+                entries.push_back(entry);
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.mTime < b.mTime; });
+
+    auto flags = o.flags();
+    auto fill = o.fill();
+    for (auto &entry : entries) {
+        auto us = entry.mTime / 1000;
+        o << std::dec << std::setfill(' ') << std::setw(6) << (us / 1000000) << "." << std::setfill('0') << std::setw(6) << (us % 1000000)
+          << " [" << entry.mThread << "] " << eventName(entry.mEvent);
+        if (entry.mEvent == std::uint16_t(Events::CharacteristicRead)) {
+            o << " " << uuid::ToName(uuid::Identifiers(entry.mTag));
+        }
+        else if (entry.mTag) {
+            o << " " << entry.mTag;
+        }
+        o << " (" << entry.mSize << "):";
+        for (std::size_t b = 0; b < std::min<std::size_t>(entry.mSize, cMaxPayload); ++b) {
+            o << " " << std::hex << std::setw(2) << std::setfill('0') << std::uint32_t(std::uint8_t(entry.mData[b]));
+        }
+        if (entry.mSize > cMaxPayload) {
+            o << " ...";
+        }
+        o << "\n";
+    }
+    o.flags(flags);
+    o.fill(fill);
+    return entries.empty() ? aAfter : Timestamp(entries.back().mTime);
+}
+
+void Trace::InstallCrashHandler()
+{
+    struct sigaction action{};
+    action.sa_handler = crashHandler;
+    sigemptyset(&action.sa_mask);
+    // Restore the default action, so the signal re-raised by the handler terminates with a core dump.
+    action.sa_flags = SA_RESETHAND;
+    for (int signal : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT}) {
+        sigaction(signal, &action, nullptr);
+    }
+}
+
+} // rsp
@@ -9,54 +9,104 @@
 */
 #include <TrustedDevice.h>
 #include <exceptions.h>
+#include <Metrics.h>
 #include <UUID.h>
-#include <magic_enum.hpp>
 
 namespace rsp {
 
-TrustedDevice::TrustedDevice(const SimpleBLE::Peripheral &arDevice)
-    : mDevice(arDevice)
+TrustedDevice::TrustedDevice(const SimpleBLE::Peripheral &arDevice, std::string aCacheDirectory)
+    : TrustedDevice(std::make_shared<SimpleBlePeripheral>(arDevice), std::move(aCacheDirectory))
 {
-    mLogger.Info() << "Attempting to connect with " << mDevice.address() << std::endl;
-    mDevice.connect();
-    if (mDevice.is_connected()) {
-        if (mDevice.initialized()) {
-            return;
-        }
+}
+
+TrustedDevice::TrustedDevice(std::shared_ptr<GattPeripheral> aDevice, std::string aCacheDirectory)
+    : mDevice(std::move(aDevice)),
+      mCache(std::move(aCacheDirectory))
+{
+    mLogger.Info() << "Attempting to connect with " << mDevice->Address() << std::endl;
+    auto timer = Metrics::Get().Time("connect");
+    mDevice->Connect();
+    timer.Stop();
+    if (mDevice->IsConnected()) {
+        auto discovery = Metrics::Get().Time("service_discovery");
+        indexFromPeripheral();
+        return;
     }
-    mLogger.Error() << "Failed to connect to " << " [" << mDevice.address() << "]" << std::endl;
+    Metrics::Get().Count("connect_failures");
+    mLogger.Error() << "Failed to connect to " << " [" << mDevice->Address() << "]" << std::endl;
     THROW_WITH_BACKTRACE(EDeviceNotPaired);
 }
 
 TrustedDevice::~TrustedDevice()
 {
-    if (mDevice.is_connected()) {
-        mDevice.disconnect();
+    if (mDevice->IsConnected()) {
+        mDevice->Disconnect();
     }
 }
 
-bool TrustedDevice::HasServiceWithId(uuid::Identifiers aId)
-try {
-    auto service = GetServiceById(uuid::Identifiers::GlucoseService);
-    return true;
+bool TrustedDevice::HasServiceWithId(uuid::Identifiers aId) const
+{
+    return mIndex.contains(aId);
+}
+
+bool TrustedDevice::HasCharacteristic(uuid::Identifiers aServiceId, uuid::Identifiers aCharacteristicId) const
+{
+    auto it = mIndex.find(aServiceId);
+    return (it != mIndex.end()) && it->second.mCharacteristics.contains(aCharacteristicId);
 }
-catch (const EServiceNotFound&) {
-    return false;
+
+const std::string& TrustedDevice::GetServiceUuid(uuid::Identifiers aServiceId) const
+{
+    return getServiceEntry(aServiceId).mUuid;
 }
 
-SimpleBLE::Service TrustedDevice::GetServiceById(uuid::Identifiers aId)
+const std::string& TrustedDevice::GetCharacteristicUuid(uuid::Identifiers aServiceId, uuid::Identifiers aCharacteristicId) const
 {
-    for (auto &service : mDevice.services()) {
-        if (uuid::FromString(service.uuid()) == aId) {
-            return service;
+    auto &entry = getServiceEntry(aServiceId);
+    auto it = entry.mCharacteristics.find(aCharacteristicId);
+    if (it == entry.mCharacteristics.end()) {
+        THROW_WITH_BACKTRACE1(ECharacteristicNotFound, std::string(uuid::ToName(aCharacteristicId)));
+    }
+    return it->second;
+}
+
+const TrustedDevice::ServiceEntry& TrustedDevice::getServiceEntry(uuid::Identifiers aServiceId) const
+{
+    auto it = mIndex.find(aServiceId);
+    if (it == mIndex.end()) {
+        THROW_WITH_BACKTRACE1(EServiceNotFound, std::string(uuid::ToName(aServiceId)));
+    }
+    return it->second;
+}
+
+void TrustedDevice::indexFromPeripheral()
+{
+    // The index is keyed by assigned number, which only identifies UUIDs derived from the
+    // Bluetooth Base UUID. Vendor specific UUIDs sharing the leading 32 bits would shadow each other.
+    mIndex.clear();
+    for (auto &service : mDevice->Services()) {
+        uuid::Uuid service_uuid(service.mUuid);
+        if (!service_uuid.IsBase()) {
+            mLogger.Debug() << "Not indexing vendor specific service " << service.mUuid;
+            continue;
+        }
+        auto &entry = mIndex[service_uuid.ToIdentifier()];
+        entry.mUuid = service.mUuid;
+        for (auto &characteristic : service.mCharacteristics) {
+            uuid::Uuid characteristic_uuid(characteristic);
+            if (!characteristic_uuid.IsBase()) {
+                mLogger.Debug() << "Not indexing vendor specific characteristic " << characteristic;
+                continue;
+            }
+            entry.mCharacteristics[characteristic_uuid.ToIdentifier()] = characteristic;
         }
     }
-    THROW_WITH_BACKTRACE1(EServiceNotFound, std::string(magic_enum::enum_name(aId)));
+    mLogger.Debug() << "Indexed " << mIndex.size() << " services on " << mDevice->Address();
 }
 
 std::ostream& operator<<(std::ostream &o, TrustedDevice &arDevice)
 {
-    o << arDevice.GetPeripheral();
+    arDevice.GetPeripheral().Print(o);
     return o;
 }
 
@@ -8,57 +8,80 @@
 * \author      steffen
 */
 #include <UUID.h>
-#include <iomanip>
-#include <sstream>
 
 namespace rsp::uuid {
 
+static_assert(Uuid("1808") == Uuid(Identifiers::GlucoseService));
+static_assert(Uuid("00001808-0000-1000-8000-00805F9B34FB").IsBase());
+static_assert(Uuid("00001808-0000-1000-8000-00805f9b34fb").ToIdentifier() == Identifiers::GlucoseService);
+static_assert(Uuid(Identifiers::GlucoseService).Format()[7] == '8');
+static_assert(Uuid("2a18") < Uuid("2a34"));
 
 Identifiers FromString(const std::string &arUUID)
 {
-    uint32_t id = std::stoul(arUUID, nullptr, 16);
-    return static_cast<Identifiers>(id);
+    return Uuid(arUUID).ToIdentifier();
 }
 
 std::string ToString(Identifiers aIdentifier)
 {
-    std::stringstream stream;
-    stream << std::setfill ('0') << std::setw(8) << std::hex << uint32_t(aIdentifier);
-    return stream.str();
+    auto text = Uuid(aIdentifier).Format();
+    return {text.data(), 8};
 }
 
-std::string ToName(Identifiers aId)
+std::string ToFullString(Identifiers aIdentifier)
 {
-    const struct {
-        Identifiers id;
-        const char *name;
-    } cMap[] {
-        { Identifiers::GenericAttributeProfileService, "Generic Attribute Profile" },
-        { Identifiers::CurrentTimeService, "Current Time" },
-        { Identifiers::GlucoseService, "Glucose" },
-        { Identifiers::DeviceInformationService, "Device Information" },
-        { Identifiers::ClientCharacteristicConfiguration, "Client Characteristic Configuration" },
-        { Identifiers::GlucoseMeasurement, "Glucose Measurement" },
-        { Identifiers::GlucoseMeasurementContext, "Glucose Measurement Context" },
-        { Identifiers::GlucoseFeature, "Glucose Feature" },
-        { Identifiers::RecordAccessControlPoint, "Record Access Control Point" },
-        { Identifiers::SystemID, "System ID" },
-        { Identifiers::ModelNumberString, "Model Number String" },
-        { Identifiers::SerialNumberString, "Serial Number String" },
-        { Identifiers::FirmwareRevisionString, "Firmware Revision String" },
-        { Identifiers::SoftwareRevisionString, "Software Revision String" },
-        { Identifiers::ManufacturerNameString, "Manufacturer Name String" },
-        { Identifiers::IEEE_11073_20601_RegulatoryCertDataList, "IEEE 11073-20601 Regulatory Cert. Data List" },
-        { Identifiers::PnPID, "PnP ID" },
-        { Identifiers::CurrentTime, "Current Time" }
-    };
-
-    for (auto &el : cMap) {
-        if (el.id == aId) {
-            return el.name;
-        }
+    return Uuid(aIdentifier).ToString();
+}
+
+namespace {
+
+struct AssignedNumber {
+    std::uint16_t mValue;
+    std::string_view mName;
+};
+
+constexpr AssignedNumber cAssignedNumbers[] = {
+    { 0, "Vendor specific" }, // Index 0 is used for values without an assigned number
+#define BLE_ASSIGNED_NUMBER(kind, value, symbol, name) { value, name },
+#include <sig-assigned-numbers.inc>
+#undef BLE_ASSIGNED_NUMBER
+};
+
+// Range of all 16-bit service, characteristic and descriptor assigned numbers.
+constexpr std::uint32_t cFirstAssigned = 0x1800;
+constexpr std::uint32_t cLastAssigned = 0x2DFF;
+
+/*
+ * The assigned numbers are dense within their range, so the value itself is used as
+ * a collision free (perfect) hash into this index table, built at compile time.
+ */
+constexpr auto cAssignedIndex = [] {
+    std::array<std::uint16_t, cLastAssigned - cFirstAssigned + 1> index{};
+    for (std::size_t i = 1; i < std::size(cAssignedNumbers); ++i) {
+        index[cAssignedNumbers[i].mValue - cFirstAssigned] = std::uint16_t(i);
+    }
+    return index;
+}();
+
+static_assert(std::size(cAssignedNumbers) < 0xFFFF);
+
+} // namespace
+
+std::string_view ToName(Identifiers aId)
+{
+    auto value = std::uint32_t(aId);
+    if (value < cFirstAssigned || value > cLastAssigned) {
+        return cAssignedNumbers[0].mName;
+    }
+    return cAssignedNumbers[cAssignedIndex[value - cFirstAssigned]].mName;
+}
+
+std::string_view ToName(const Uuid &arUuid)
+{
+    if (!arUuid.IsBase()) {
+        return cAssignedNumbers[0].mName;
     }
-    return "Vendor specific";
+    return ToName(arUuid.ToIdentifier());
 }
 
 std::ostream &operator<<(std::ostream &o, Identifiers aIdentifier)
@@ -67,6 +90,13 @@ std::ostream &operator<<(std::ostream &o, Identifiers aIdentifier)
     return o;
 }
 
+std::ostream &operator<<(std::ostream &o, const Uuid &arUuid)
+{
+    auto text = arUuid.Format();
+    o.write(text.data(), std::streamsize(text.size()));
+    return o;
+}
+
 } // rsp::uuid
 
 namespace SimpleBLE {
@@ -89,21 +119,21 @@ std::ostream& operator<<(std::ostream &o, Peripheral &arPeripheral)
 std::ostream &operator<<(std::ostream &o, Service &arService)
 {
     using namespace rsp::uuid;
-    o << "Service: " << ToName(FromString(arService.uuid())) << ", " << arService.uuid();
+    o << "Service: " << ToName(Uuid(arService.uuid())) << ", " << arService.uuid();
     return o;
 }
 
 std::ostream &operator<<(std::ostream &o, Characteristic &arCharacteristic)
 {
     using namespace rsp::uuid;
-    o << "  Characteristic: " << ToName(FromString(arCharacteristic.uuid())) << ", " << arCharacteristic.uuid();
+    o << "  Characteristic: " << ToName(Uuid(arCharacteristic.uuid())) << ", " << arCharacteristic.uuid();
     return o;
 }
 
 std::ostream &operator<<(std::ostream &o, Descriptor &arDescriptor)
 {
     using namespace rsp::uuid;
-    o << "    Descriptor: " << ToName(FromString(arDescriptor.uuid())) << ", " << arDescriptor.uuid();
+    o << "    Descriptor: " << ToName(Uuid(arDescriptor.uuid())) << ", " << arDescriptor.uuid();
     return o;
 }
 
@@ -0,0 +1,221 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <AttributeStream.h>
+#include <CgmServiceProfile.h>
+#include <exceptions.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+#include <UUID.h>
+
+using namespace rsp;
+using uuid::Identifiers;
+
+namespace {
+
+using Measurement = CgmServiceProfile::Measurement;
+
+/**
+ * \brief Simulated meter with a CGM service, its measurements are sent by the test.
+ */
+class CgmMeter : public SimulatedMeter
+{
+public:
+    explicit CgmMeter(bool aCrc)
+        : SimulatedMeter(Config()),
+          mCrc(aCrc)
+    {
+    }
+
+    std::vector<Service> Services() override
+    {
+        auto s = [](Identifiers aId) { return uuid::ToFullString(aId); };
+        auto result = SimulatedMeter::Services();
+        result.push_back({ s(Identifiers::ContinuousGlucoseMonitoringService), {
+            s(Identifiers::CgmMeasurement),
+            s(Identifiers::CgmFeature),
+            s(Identifiers::CgmSessionStartTime),
+            s(Identifiers::CgmSessionRunTime),
+            s(Identifiers::RecordAccessControlPoint),
+            s(Identifiers::CgmSpecificOpsControlPoint) }});
+        return result;
+    }
+
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override
+    {
+        if (arCharacteristic == uuid::ToFullString(Identifiers::CgmFeature)) {
+            AttributeStream s(6);
+            s.Uint16(std::uint16_t(mCrc ? CgmServiceProfile::Features::E2ECrcSupported : 0)).Uint8(0).Uint8(0x11);
+            // Always there, 0xFFFF without E2E-CRC
+            s.Uint16(mCrc ? CgmServiceProfile::Crc(s.GetArray().data(), 4) : 0xFFFF);
+            return s.GetArray();
+        }
+        if (arCharacteristic == uuid::ToFullString(Identifiers::CgmSessionStartTime)) {
+            AttributeStream s(mCrc ? 11 : 9);
+            s.DateTime(utils::DateTime(2024, 3, 1, 8, 0, 0)).Uint8(0).Uint8(0);
+            if (mCrc) {
+                s.Uint16(CgmServiceProfile::Crc(s.GetArray().data(), 9));
+            }
+            return s.GetArray();
+        }
+        return SimulatedMeter::Read(arService, arCharacteristic);
+    }
+
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override
+    {
+        if (arCharacteristic == uuid::ToFullString(Identifiers::CgmMeasurement)) {
+            std::lock_guard<std::mutex> lock(mMeasurementMutex);
+            mMeasurement = std::move(aCallback);
+            return;
+        }
+        SimulatedMeter::Notify(arService, arCharacteristic, std::move(aCallback));
+    }
+
+    void Unsubscribe(const std::string &arService, const std::string &arCharacteristic) override
+    {
+        if (arCharacteristic == uuid::ToFullString(Identifiers::CgmMeasurement)) {
+            std::lock_guard<std::mutex> lock(mMeasurementMutex);
+            mMeasurement = nullptr;
+            return;
+        }
+        SimulatedMeter::Unsubscribe(arService, arCharacteristic);
+    }
+
+    void SendMeasurement(const ByteArray &arValue)
+    {
+        std::lock_guard<std::mutex> lock(mMeasurementMutex);
+        mMeasurement(arValue);
+    }
+
+protected:
+    bool mCrc;
+    std::mutex mMeasurementMutex{};
+    Callback mMeasurement{};
+};
+
+/*
+ * One record as in section 3.2.1 of Continuous Glucose Monitoring Service 1.0.2: size, flags,
+ * glucose concentration, time offset, the optional fields and the E2E-CRC.
+ */
+std::string record(std::uint8_t aFlags, std::uint16_t aTimeOffset, std::initializer_list<std::uint8_t> aOptional, bool aCrc)
+{
+    auto size = std::uint8_t(6 + aOptional.size() + (aCrc ? 2 : 0));
+    AttributeStream s(size);
+    s.Uint8(size).Uint8(aFlags).MedFloat16(120.0f).Uint16(aTimeOffset);
+    for (auto byte : aOptional) {
+        s.Uint8(byte);
+    }
+    if (aCrc) {
+        s.Uint16(CgmServiceProfile::Crc(s.GetArray().data(), size - 2));
+    }
+    return s.GetArray();
+}
+
+TEST(CgmMeasurementTest, DecodesSensorStatusInFlagOrder)
+{
+    // Warning, Cal/Temp and Status octets in that order, then the trend
+    auto value = record(Measurement::Flags::TrendInformationPresent | Measurement::Flags::WarningOctetPresent
+                        | Measurement::Flags::CalTempOctetPresent | Measurement::Flags::StatusOctetPresent,
+                        30, {0x01, 0x08, 0x02, 0xF1, 0xFF}, false);
+    Measurement m(value, false);
+    EXPECT_FLOAT_EQ(m.mGlucoseConcentration, 120.0f);
+    EXPECT_EQ(m.mTimeOffset, 30);
+    EXPECT_EQ(m.mSensorStatus, CgmServiceProfile::SensorStatus(CgmServiceProfile::SensorStatus::ResultBelowPatientLow
+                                                                | CgmServiceProfile::SensorStatus::CalibrationRequired
+                                                                | CgmServiceProfile::SensorStatus::DeviceBatteryLow));
+    EXPECT_FLOAT_EQ(m.mTrend, -1.5f);
+
+    // Only the Status octet
+    Measurement status(record(Measurement::Flags::StatusOctetPresent, 0, {0x01}, false), false);
+    EXPECT_EQ(status.mSensorStatus, CgmServiceProfile::SensorStatus::SessionStopped);
+}
+
+TEST(CgmMeasurementTest, ChecksE2ECrc)
+{
+    auto value = record(Measurement::Flags::QualityPresent, 5, {0x5A, 0x00}, true);
+    EXPECT_NO_THROW(Measurement(value, true));
+
+    for (std::size_t i = 0; i < value.size(); i++) {
+        auto damaged = value;
+        damaged[i] = char(damaged[i] ^ 0x10);
+        EXPECT_THROW(Measurement(damaged, true), ECgmArgument) << "byte " << i;
+    }
+    // Too short for the flags plus the CRC
+    EXPECT_THROW(Measurement(record(Measurement::Flags::QualityPresent, 5, {0x5A, 0x00}, false), true), ECgmArgument);
+}
+
+class CgmNotificationTest : public ::testing::TestWithParam<bool>
+{
+};
+
+TEST_P(CgmNotificationTest, DeliversEveryRecordOfANotification)
+{
+    bool crc = GetParam();
+    auto meter = std::make_shared<CgmMeter>(crc);
+    TrustedDevice device(meter);
+    CgmServiceProfile cgm(device);
+    ASSERT_EQ(bool(cgm.GetFeatures() & CgmServiceProfile::Features::E2ECrcSupported), crc);
+
+    std::vector<Measurement> received;
+    cgm.OnMeasurement([&](const Measurement &arRecord) {
+        received.push_back(arRecord);
+        // Not called with the profile locked
+        cgm.GetSessionStartTime();
+    });
+    meter->SendMeasurement(record(0, 10, {}, crc)
+                           + record(Measurement::Flags::WarningOctetPresent | Measurement::Flags::TrendInformationPresent, 15, {0x02, 0x0A, 0x00}, crc)
+                           + record(0, 20, {}, crc));
+
+    ASSERT_EQ(received.size(), 3u);
+    EXPECT_EQ(received[0].mTimeOffset, 10);
+    EXPECT_EQ(received[1].mTimeOffset, 15);
+    EXPECT_EQ(received[1].mSensorStatus, CgmServiceProfile::SensorStatus::ResultAbovePatientHigh);
+    EXPECT_FLOAT_EQ(received[1].mTrend, 10.0f);
+    EXPECT_EQ(received[2].mTimeOffset, 20);
+    ASSERT_TRUE(received[0].mCaptureTime.IsKnown());
+    EXPECT_EQ(received[2].mCaptureTime.mSeconds - received[0].mCaptureTime.mSeconds, 10 * 60);
+}
+
+TEST_P(CgmNotificationTest, SkipsInvalidRecords)
+{
+    bool crc = GetParam();
+    auto meter = std::make_shared<CgmMeter>(crc);
+    TrustedDevice device(meter);
+    CgmServiceProfile cgm(device);
+
+    std::vector<std::uint16_t> received;
+    cgm.OnMeasurement([&](const Measurement &arRecord) { received.push_back(arRecord.mTimeOffset); });
+
+    // Claims a trend it does not have, or has a broken CRC, only that record is dropped
+    auto invalid = record(0, 2, {}, crc);
+    if (crc) {
+        invalid[4] = char(invalid[4] ^ 0x01);
+    }
+    else {
+        invalid[1] = char(Measurement::Flags::TrendInformationPresent);
+    }
+    meter->SendMeasurement(record(0, 1, {}, crc) + invalid + record(0, 3, {}, crc));
+    EXPECT_EQ(received, (std::vector<std::uint16_t>{1, 3}));
+
+    // A size running past the end drops the rest of the notification
+    auto truncated = record(0, 5, {}, crc);
+    truncated[0] = char(truncated.size() + 1);
+    meter->SendMeasurement(record(0, 4, {}, crc) + truncated);
+    EXPECT_EQ(received, (std::vector<std::uint16_t>{1, 3, 4}));
+}
+
+INSTANTIATE_TEST_SUITE_P(WithAndWithoutE2ECrc, CgmNotificationTest, ::testing::Bool());
+
+} // namespace
@@ -0,0 +1,138 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+#include <AsyncGatt.h>
+#include <Coroutine.h>
+#include <GlucoseServiceProfile.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+
+using namespace rsp;
+using namespace std::chrono_literals;
+
+namespace {
+
+Task<int> sleepAndReturn(Executor &arExecutor, int aValue)
+{
+    co_await arExecutor.Sleep(20ms);
+    co_return aValue;
+}
+
+TEST(ExecutorTest, ResumesAfterSleep)
+{
+    Executor executor;
+    auto start = Executor::Clock::now();
+    EXPECT_EQ(executor.SyncWait(sleepAndReturn(executor, 42)), 42);
+    EXPECT_GE(Executor::Clock::now() - start, 20ms);
+}
+
+TEST(ExecutorTest, OffloadPassesOnExceptions)
+{
+    Executor executor;
+    EXPECT_EQ(executor.SyncWait(executor.Offload([]() { return 7; })), 7);
+    EXPECT_THROW(executor.SyncWait(executor.Offload([]() -> int { throw std::runtime_error("offloaded"); })), std::runtime_error);
+}
+
+Task<std::optional<int>> pop(Executor &arExecutor, AsyncQueue<int> &arQueue, std::chrono::milliseconds aTimeout)
+{
+    co_return co_await arQueue.Pop(arExecutor, aTimeout);
+}
+
+TEST(AsyncQueueTest, ReturnsQueuedValueOrTimesOut)
+{
+    Executor executor;
+    AsyncQueue<int> queue;
+    queue.Push(1);
+    EXPECT_EQ(executor.SyncWait(pop(executor, queue, 1000ms)), 1);
+    EXPECT_EQ(executor.SyncWait(pop(executor, queue, 10ms)), std::nullopt);
+}
+
+TEST(AsyncQueueTest, PushFromAnotherThreadResumesWaiter)
+{
+    Executor executor(2);
+    AsyncQueue<int> queue;
+    // Pushes racing the suspension and the timeout, every value is either popped or left queued.
+    int popped = 0;
+    for (int i = 0; i < 200; i++) {
+        std::thread pusher([&queue, i]() { queue.Push(i); });
+        auto value = executor.SyncWait(pop(executor, queue, std::chrono::milliseconds(i % 2)));
+        pusher.join();
+        if (!value) {
+            value = executor.SyncWait(pop(executor, queue, 1000ms));
+        }
+        EXPECT_EQ(value, i);
+        popped++;
+    }
+    EXPECT_EQ(popped, 200);
+}
+
+Task<bool> wait(Executor &arExecutor, AsyncEvent &arEvent, std::chrono::milliseconds aTimeout)
+{
+    co_return co_await arEvent.Wait(arExecutor, aTimeout);
+}
+
+TEST(AsyncEventTest, SetResumesWaiters)
+{
+    Executor executor(2);
+    AsyncEvent event;
+    EXPECT_FALSE(executor.SyncWait(wait(executor, event, 10ms)));
+
+    std::thread setter([&event]() {
+        std::this_thread::sleep_for(10ms);
+        event.Set();
+    });
+    EXPECT_TRUE(executor.SyncWait(wait(executor, event, 5000ms)));
+    setter.join();
+    EXPECT_TRUE(executor.SyncWait(wait(executor, event, 0ms)));
+    event.Reset();
+    EXPECT_FALSE(executor.SyncWait(wait(executor, event, 0ms)));
+}
+
+TEST(AsyncGlucoseTest, CountsReadsAndClearsRecords)
+{
+    Executor executor;
+    auto meter = std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:50,context:5"));
+    TrustedDevice device(meter);
+    GlucoseServiceProfile gls(device);
+
+    EXPECT_EQ(executor.SyncWait(gls.GetMeasurementsCountAsync(executor)), 50u);
+    auto records = executor.SyncWait(gls.ReadAllMeasurementsAsync(executor));
+    ASSERT_EQ(records.size(), 50u);
+    for (std::size_t i = 0; i < records.size(); i++) {
+        EXPECT_EQ(records[i].mSequenceNo, i + 1);
+    }
+    executor.SyncWait(gls.ClearAllMeasurementsAsync(executor));
+    EXPECT_EQ(executor.SyncWait(gls.GetMeasurementsCountAsync(executor)), 0u);
+}
+
+Task<std::optional<SimpleBLE::ByteArray>> countRequest(AsyncGatt &arGatt)
+{
+    using uuid::Identifiers;
+    // Subscribes, so the response is not missed
+    co_await arGatt.Notification(Identifiers::GlucoseService, Identifiers::RecordAccessControlPoint, 0ms);
+    co_await arGatt.Write(Identifiers::GlucoseService, Identifiers::RecordAccessControlPoint, std::string("\x04\x01", 2));
+    co_return co_await arGatt.Notification(Identifiers::GlucoseService, Identifiers::RecordAccessControlPoint, 5000ms);
+}
+
+TEST(AsyncGattTest, WritesAndAwaitsNotification)
+{
+    Executor executor;
+    TrustedDevice device(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:50")));
+    AsyncGatt gatt(executor, device);
+    EXPECT_EQ(executor.SyncWait(countRequest(gatt)), std::string("\x05\x00\x32\x00", 4));
+}
+
+} // namespace
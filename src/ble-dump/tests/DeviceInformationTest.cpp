@@ -0,0 +1,101 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <gtest/gtest.h>
+#include <DeviceInformationServiceProfile.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+
+using namespace rsp;
+
+namespace {
+
+/**
+ * \brief Simulated meter counting characteristic reads.
+ */
+class CountingMeter : public SimulatedMeter
+{
+public:
+    std::atomic<int> mReads = 0;
+
+    ByteArray Read(const std::string &arService, const std::string &arCharacteristic) override
+    {
+        mReads++;
+        return SimulatedMeter::Read(arService, arCharacteristic);
+    }
+};
+
+class DeviceInformationCacheTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path mDirectory = std::filesystem::path(::testing::TempDir()) / "ble-dump-dis-test";
+    std::shared_ptr<CountingMeter> mMeter = std::make_shared<CountingMeter>();
+
+    void SetUp() override
+    {
+        std::filesystem::remove_all(mDirectory);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(mDirectory);
+    }
+
+    std::optional<std::string> readModel(TrustedDevice &arDevice)
+    {
+        DeviceInformationServiceProfile dis(arDevice);
+        return dis.GetModelNumber();
+    }
+};
+
+TEST_F(DeviceInformationCacheTest, ReadsNothingUntilAValueIsRequested)
+{
+    TrustedDevice device(mMeter, mDirectory.string());
+    auto before = mMeter->mReads.load();
+    {
+        DeviceInformationServiceProfile dis(device);
+        EXPECT_EQ(mMeter->mReads, before);
+    }
+    EXPECT_EQ(mMeter->mReads, before);
+    EXPECT_FALSE(std::filesystem::exists(mDirectory));
+}
+
+TEST_F(DeviceInformationCacheTest, CachedValuesOnlyReadTheFirmwareRevision)
+{
+    TrustedDevice device(mMeter, mDirectory.string());
+    EXPECT_EQ(readModel(device), "SIM-1");
+
+    auto before = mMeter->mReads.load();
+    EXPECT_EQ(readModel(device), "SIM-1");
+    EXPECT_EQ(mMeter->mReads - before, 1);
+}
+
+TEST_F(DeviceInformationCacheTest, DamagedCacheIsReadAgain)
+{
+    TrustedDevice device(mMeter, mDirectory.string());
+    EXPECT_EQ(readModel(device), "SIM-1");
+    for (auto &entry : std::filesystem::directory_iterator(mDirectory)) {
+        std::ofstream(entry.path(), std::ios::out | std::ios::trunc) << "2a24 5x\n";
+    }
+
+    auto before = mMeter->mReads.load();
+    EXPECT_EQ(readModel(device), "SIM-1");
+    EXPECT_EQ(mMeter->mReads - before, 2);
+    // Replaced by the values read from the device
+    before = mMeter->mReads.load();
+    EXPECT_EQ(readModel(device), "SIM-1");
+    EXPECT_EQ(mMeter->mReads - before, 1);
+}
+
+} // namespace
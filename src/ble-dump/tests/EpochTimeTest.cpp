@@ -0,0 +1,87 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <stdexcept>
+#include <string>
+#include <gtest/gtest.h>
+#include <EpochTime.h>
+
+using namespace rsp;
+
+namespace {
+
+TEST(EpochTimeTest, FromDateTime)
+{
+    EXPECT_EQ(EpochTime::FromDateTime(1970, 1, 1, 0, 0, 0).mSeconds, 0);
+    EXPECT_EQ(EpochTime::FromDateTime(2024, 2, 29, 13, 45, 30).mSeconds, 1709214330);
+    EXPECT_EQ(EpochTime::FromDateTime(1969, 12, 31, 23, 59, 59).mSeconds, -1);
+    // A year, month or day of 0 is not known
+    EXPECT_FALSE(EpochTime::FromDateTime(0, 1, 1, 0, 0, 0).IsKnown());
+    EXPECT_FALSE(EpochTime::FromDateTime(2024, 0, 1, 0, 0, 0).IsKnown());
+    EXPECT_FALSE(EpochTime::FromDateTime(2024, 1, 0, 0, 0, 0).IsKnown());
+}
+
+TEST(EpochTimeTest, FromDateTimeRejectsFieldsOutOfRange)
+{
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 13, 1, 0, 0, 0), std::invalid_argument);
+    // Would wrap to December in std::chrono::month
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 268, 1, 0, 0, 0), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 4, 31, 0, 0, 0), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(2023, 2, 29, 0, 0, 0), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 1, 1, 24, 0, 0), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 1, 1, 0, 60, 0), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(2024, 1, 1, 0, 0, 60), std::invalid_argument);
+    EXPECT_THROW(EpochTime::FromDateTime(10000, 1, 1, 0, 0, 0), std::invalid_argument);
+    EXPECT_NO_THROW(EpochTime::FromDateTime(2024, 12, 31, 23, 59, 59));
+}
+
+TEST(Iso8601FormatterTest, FormatsTimesBeforeTheEpoch)
+{
+    Iso8601Formatter formatter;
+    // Floor division, the time of day counts forward from the start of the earlier day
+    EXPECT_EQ(formatter.Format(-1), "1969-12-31T23:59:59.000Z");
+    EXPECT_EQ(formatter.Format(-86400), "1969-12-31T00:00:00.000Z");
+    EXPECT_EQ(formatter.Format(-86401), "1969-12-30T23:59:59.000Z");
+    EXPECT_EQ(formatter.Format(EpochTime::FromDateTime(1900, 3, 1, 6, 30, 0)), "1900-03-01T06:30:00.000Z");
+}
+
+TEST(Iso8601FormatterTest, DateChangesWithTheDay)
+{
+    Iso8601Formatter formatter;
+    auto midnight = EpochTime::FromDateTime(2024, 2, 29, 0, 0, 0).mSeconds;
+    EXPECT_EQ(formatter.Format(midnight - 1), "2024-02-28T23:59:59.000Z");
+    EXPECT_EQ(formatter.Format(midnight), "2024-02-29T00:00:00.000Z");
+    EXPECT_EQ(formatter.Format(midnight + 86399), "2024-02-29T23:59:59.000Z");
+    EXPECT_EQ(formatter.Format(midnight + 86400), "2024-03-01T00:00:00.000Z");
+    // Out of order, back to the day before
+    EXPECT_EQ(formatter.Format(midnight - 60), "2024-02-28T23:59:00.000Z");
+    // An unknown time leaves the cached day alone
+    EXPECT_EQ(formatter.Format(EpochTime::cUnknown), "");
+    EXPECT_EQ(formatter.Format(midnight - 30), "2024-02-28T23:59:30.000Z");
+}
+
+TEST(Iso8601FormatterTest, AppliesTimeOffsetAndWritesWholeSeconds)
+{
+    Iso8601Formatter formatter;
+    auto time = EpochTime::FromDateTime(2024, 12, 31, 23, 30, 15);
+    time.mOffsetMinutes = 45;
+    EXPECT_EQ(formatter.Format(time), "2025-01-01T00:15:15.000Z");
+    time.mOffsetMinutes = -1440;
+    EXPECT_EQ(formatter.Format(time), "2024-12-30T23:30:15.000Z");
+
+    // Whole seconds only, the fraction stays zero whatever was formatted before
+    for (std::int64_t seconds : {-86401LL, 0LL, 59LL, 1709214330LL, 253402300799LL}) {
+        auto text = formatter.Format(seconds);
+        ASSERT_EQ(text.size(), Iso8601Formatter::cLength);
+        EXPECT_EQ(text.substr(19), ".000Z") << seconds;
+    }
+    EXPECT_EQ(formatter.Format(253402300799), "9999-12-31T23:59:59.000Z");
+}
+
+} // namespace
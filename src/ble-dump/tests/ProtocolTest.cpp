@@ -0,0 +1,173 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <AttributeStream.h>
+#include <GlucoseServiceProfile.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+#include <UUID.h>
+
+using namespace rsp;
+
+namespace {
+
+std::string bytes(std::initializer_list<std::uint8_t> aBytes)
+{
+    return {aBytes.begin(), aBytes.end()};
+}
+
+/*
+ * SFLOAT and FLOAT as in IEEE 11073-20601, little endian with the exponent in the high bits.
+ */
+TEST(AttributeStreamTest, DecodesSFloat)
+{
+    // 80 * 10^-5 kg/L, i.e. 80 mg/dL as a glucose meter sends it
+    AttributeStream s(bytes({0x50, 0xB0}));
+    EXPECT_FLOAT_EQ(s.MedFloat16(), 0.0008f);
+
+    AttributeStream special(bytes({0xFF, 0x07, 0xFE, 0x07, 0x02, 0x08}));
+    EXPECT_TRUE(std::isnan(special.MedFloat16()));
+    EXPECT_EQ(special.MedFloat16(), std::numeric_limits<float>::infinity());
+    EXPECT_EQ(special.MedFloat16(), -std::numeric_limits<float>::infinity());
+}
+
+TEST(AttributeStreamTest, EncodesSFloat)
+{
+    AttributeStream s(6);
+    s.MedFloat16(120.0f).MedFloat16(0.0008f).MedFloat16(-2.5f);
+    // 1200 * 10^-1, 800 * 10^-6 and -250 * 10^-2
+    EXPECT_EQ(s.GetArray(), bytes({0xB0, 0xF4, 0x20, 0xA3, 0x06, 0xEF}));
+
+    AttributeStream r(s.GetArray());
+    EXPECT_FLOAT_EQ(r.MedFloat16(), 120.0f);
+    EXPECT_FLOAT_EQ(r.MedFloat16(), 0.0008f);
+    EXPECT_FLOAT_EQ(r.MedFloat16(), -2.5f);
+}
+
+TEST(AttributeStreamTest, EncodesFloat)
+{
+    AttributeStream s(4);
+    s.MedFloat32(5.5f);
+    // 5500000 * 10^-6, all four bytes
+    EXPECT_EQ(s.GetArray(), bytes({0x60, 0xEC, 0x53, 0xFA}));
+    AttributeStream r(s.GetArray());
+    EXPECT_FLOAT_EQ(r.MedFloat32(), 5.5f);
+}
+
+TEST(AttributeStreamTest, EncodesDateTime)
+{
+    AttributeStream s(7);
+    s.DateTime(utils::DateTime(2024, 2, 29, 13, 45, 30));
+    // Year 2024 and month 2 as in the GATT Date Time, not as in std::tm
+    EXPECT_EQ(s.GetArray().substr(0, 3), bytes({0xE8, 0x07, 0x02}));
+
+    AttributeStream r(s.GetArray());
+    std::tm tm = r.DateTime();
+    EXPECT_EQ(tm.tm_year + 1900, 2024);
+    EXPECT_EQ(tm.tm_mon + 1, 2);
+    EXPECT_EQ(tm.tm_mday, 29);
+}
+
+/**
+ * \brief Simulated meter keeping the raw RACP traffic, to check it against the specification.
+ */
+class RacpCapture : public SimulatedMeter
+{
+public:
+    using SimulatedMeter::SimulatedMeter;
+
+    void WriteRequest(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override
+    {
+        capture(mWritten, arCharacteristic, arValue);
+        SimulatedMeter::WriteRequest(arService, arCharacteristic, arValue);
+    }
+
+    void WriteCommand(const std::string &arService, const std::string &arCharacteristic, const ByteArray &arValue) override
+    {
+        capture(mWritten, arCharacteristic, arValue);
+        SimulatedMeter::WriteCommand(arService, arCharacteristic, arValue);
+    }
+
+    void Notify(const std::string &arService, const std::string &arCharacteristic, Callback aCallback) override
+    {
+        SimulatedMeter::Notify(arService, arCharacteristic, [this, arCharacteristic, aCallback](const ByteArray &arValue) {
+            capture(mResponses, arCharacteristic, arValue);
+            aCallback(arValue);
+        });
+    }
+
+    std::vector<ByteArray> Written()
+    {
+        std::lock_guard<std::mutex> lock(mCaptureMutex);
+        return std::exchange(mWritten, {});
+    }
+
+    std::vector<ByteArray> Responses()
+    {
+        std::lock_guard<std::mutex> lock(mCaptureMutex);
+        return std::exchange(mResponses, {});
+    }
+
+protected:
+    std::mutex mCaptureMutex{};
+    std::vector<ByteArray> mWritten{};
+    std::vector<ByteArray> mResponses{};
+
+    void capture(std::vector<ByteArray> &arList, const std::string &arCharacteristic, const ByteArray &arValue)
+    {
+        if (arCharacteristic == uuid::ToFullString(uuid::Identifiers::RecordAccessControlPoint)) {
+            std::lock_guard<std::mutex> lock(mCaptureMutex);
+            arList.push_back(arValue);
+        }
+    }
+};
+
+/*
+ * Record Access Control Point values from section 3.3.2 in Glucose Service 1.0: op code byte,
+ * then operator byte, then the operand.
+ */
+TEST(GlucoseRacpBytes, CommandsAndResponses)
+{
+    auto meter = std::make_shared<RacpCapture>(SimulatedMeter::Config("records:50"));
+    {
+        TrustedDevice device(meter);
+        GlucoseServiceProfile gls(device);
+
+        EXPECT_EQ(gls.GetMeasurementsCount(), 50u);
+        EXPECT_EQ(meter->Written(), std::vector<std::string>{bytes({0x04, 0x01})});
+        // Number of Stored Records response, operator null, count 50
+        EXPECT_EQ(meter->Responses(), std::vector<std::string>{bytes({0x05, 0x00, 0x32, 0x00})});
+
+        gls.ReadMeasurementsFrom(41);
+        EXPECT_EQ(meter->Written(), std::vector<std::string>{bytes({0x01, 0x03, 0x01, 0x29, 0x00})});
+        // Response Code, operator null, request op code, success
+        EXPECT_EQ(meter->Responses(), std::vector<std::string>{bytes({0x06, 0x00, 0x01, 0x01})});
+
+        gls.ReadLastMeasurement();
+        EXPECT_EQ(meter->Written(), std::vector<std::string>{bytes({0x01, 0x06})});
+        meter->Responses();
+
+        gls.ClearAllMeasurements();
+        EXPECT_EQ(meter->Written(), std::vector<std::string>{bytes({0x02, 0x01})});
+        EXPECT_EQ(meter->Responses(), std::vector<std::string>{bytes({0x06, 0x00, 0x02, 0x01})});
+
+        gls.ReadAllMeasurements();
+        EXPECT_EQ(meter->Written(), std::vector<std::string>{bytes({0x01, 0x01})});
+        // Nothing left after the delete
+        EXPECT_EQ(meter->Responses(), std::vector<std::string>{bytes({0x06, 0x00, 0x01, 0x06})});
+    }
+}
+
+} // namespace
@@ -0,0 +1,79 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <GlucoseServiceProfile.h>
+#include <ReplayPeripheral.h>
+#include <SessionRecording.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+#include <UUID.h>
+
+using namespace rsp;
+
+namespace {
+
+class SessionRecordingTest : public ::testing::Test
+{
+protected:
+    std::string mFileName = ::testing::TempDir() + "ble-dump-session-test.bgsr";
+
+    void TearDown() override
+    {
+        std::remove(mFileName.c_str());
+    }
+
+    std::vector<std::uint16_t> readAll(std::shared_ptr<GattPeripheral> aPeripheral)
+    {
+        TrustedDevice device(std::move(aPeripheral));
+        GlucoseServiceProfile gls(device);
+        std::vector<std::uint16_t> result;
+        for (auto &record : gls.ReadAllMeasurements()) {
+            result.push_back(record.mSequenceNo);
+        }
+        return result;
+    }
+};
+
+TEST_F(SessionRecordingTest, ReplaysRecordedTransfer)
+{
+    auto recorded = readAll(std::make_shared<RecordingPeripheral>(std::make_shared<SimulatedMeter>(SimulatedMeter::Config("records:20,context:4")), mFileName));
+    ASSERT_EQ(recorded.size(), 20u);
+
+    auto replay = std::make_shared<ReplayPeripheral>(mFileName, 0.0);
+    EXPECT_EQ(readAll(replay), recorded);
+    EXPECT_GT(replay->GetNotificationsReplayed(), 20u);
+}
+
+TEST_F(SessionRecordingTest, RecordsDescriptorOfDescriptorWrites)
+{
+    const auto service = uuid::ToFullString(uuid::Identifiers::CurrentTimeService);
+    const auto current_time = uuid::ToFullString(uuid::Identifiers::CurrentTime);
+    const auto cccd = uuid::ToFullString(uuid::Identifiers::ClientCharacteristicConfiguration);
+    {
+        RecordingPeripheral recording(std::make_shared<SimulatedMeter>(), mFileName);
+        recording.Connect();
+        recording.WriteDescriptor(service, current_time, cccd, std::string("\x01\x00", 2));
+    }
+
+    SessionReader reader(mFileName);
+    SessionEvent event;
+    ASSERT_TRUE(reader.Next(event));
+    EXPECT_EQ(event.mType, SessionEvent::Types::WriteDescriptor);
+    EXPECT_EQ(event.mCharacteristic, current_time);
+    EXPECT_EQ(event.mDescriptor, cccd);
+    EXPECT_EQ(event.mValue, std::string("\x01\x00", 2));
+    EXPECT_FALSE(reader.Next(event));
+}
+
+} // namespace
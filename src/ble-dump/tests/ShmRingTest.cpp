@@ -0,0 +1,158 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <ShmRing.h>
+
+using namespace rsp;
+using namespace std::chrono_literals;
+
+namespace {
+
+class ShmRingTest : public ::testing::Test
+{
+protected:
+    std::string mName = "/ble-dump-test-" + std::to_string(::getpid());
+
+    void TearDown() override
+    {
+        ::shm_unlink(mName.c_str());
+    }
+
+    [[nodiscard]] std::size_t segmentSize() const
+    {
+        int fd = ::shm_open(mName.c_str(), O_RDONLY, 0);
+        struct stat st{};
+        ::fstat(fd, &st);
+        ::close(fd);
+        return std::size_t(st.st_size);
+    }
+
+    static bg_glucose_measurement record(std::int64_t aIndex)
+    {
+        bg_glucose_measurement r{};
+        r.sequence_number = std::uint16_t(aIndex);
+        r.capture_time_ms = aIndex;
+        return r;
+    }
+};
+
+/*
+ * A reader process following a writer process. Every record is either delivered in order or
+ * counted as lost, when the reader falls more than the capacity behind.
+ */
+TEST_F(ShmRingTest, ReaderProcessFollowsWriterProcess)
+{
+    constexpr std::int64_t cRecords = 100000;
+    ShmRingWriter writer(mName, 4096);
+
+    int ready[2];
+    ASSERT_EQ(::pipe(ready), 0);
+    auto pid = ::fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // Reports failures with the exit code, gtest assertions do not work in the child.
+        int status = 0;
+        try {
+            ShmRingReader reader(mName, true);
+            char c = 1;
+            (void)!::write(ready[1], &c, 1);
+            std::int64_t next = 0;
+            std::int64_t received = 0;
+            while (status == 0 && received + std::int64_t(reader.GetLost()) < cRecords) {
+                if (reader.Read([&](const bg_glucose_measurement &arRecord) {
+                    if (arRecord.capture_time_ms < next) {
+                        status = 2;
+                    }
+                    next = arRecord.capture_time_ms + 1;
+                    received++;
+                }, 5000ms) == 0) {
+                    status = 3;
+                }
+            }
+            if (next != cRecords || received + std::int64_t(reader.GetLost()) != cRecords) {
+                status = 4;
+            }
+        }
+        catch (...) {
+            status = 5;
+        }
+        ::_exit(status);
+    }
+
+    char c;
+    ASSERT_EQ(::read(ready[0], &c, 1), 1);
+    ::close(ready[0]);
+    ::close(ready[1]);
+    for (std::int64_t i = 0; i < cRecords; i++) {
+        writer.Write(record(i));
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(writer.GetWritten(), std::uint64_t(cRecords));
+}
+
+TEST_F(ShmRingTest, SmallerRingKeepsSegmentSize)
+{
+    std::size_t large;
+    {
+        ShmRingWriter writer(mName, 1024);
+        large = segmentSize();
+        EXPECT_EQ(large, ShmRingLayout::Size(1024));
+    }
+    ShmRingReader reader(mName, true);
+    ShmRingWriter writer(mName, 16);
+    EXPECT_EQ(segmentSize(), large);
+
+    writer.Write(record(7));
+    std::int64_t received = -1;
+    EXPECT_EQ(reader.Read([&](const bg_glucose_measurement &arRecord) { received = arRecord.capture_time_ms; }, 1000ms), 1u);
+    EXPECT_EQ(received, 7);
+}
+
+TEST_F(ShmRingTest, WriterClearsWaitersThatWentAway)
+{
+    ShmRingWriter writer(mName, 16);
+    int fd = ::shm_open(mName.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    auto *header = static_cast<ShmRingLayout::Header*>(::mmap(nullptr, sizeof(ShmRingLayout::Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    ::close(fd);
+    ASSERT_NE(header, MAP_FAILED);
+
+    // As left by a reader killed while waiting
+    header->mWaiters.fetch_add(1);
+    writer.Write(record(0));
+    EXPECT_EQ(header->mWaiters & ShmRingLayout::cWaiterMask, 0u);
+
+    // A reader really waiting is woken, and takes itself off the count
+    ShmRingReader reader(mName);
+    std::int64_t received = -1;
+    std::thread delayed([&writer]() {
+        std::this_thread::sleep_for(50ms);
+        writer.Write(record(1));
+    });
+    EXPECT_EQ(reader.Read([&](const bg_glucose_measurement &arRecord) { received = arRecord.capture_time_ms; }, 5000ms), 1u);
+    delayed.join();
+    EXPECT_EQ(received, 1);
+    EXPECT_EQ(header->mWaiters & ShmRingLayout::cWaiterMask, 0u);
+    ::munmap(header, sizeof(ShmRingLayout::Header));
+}
+
+} // namespace
@@ -0,0 +1,286 @@
+/**
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*
+* \copyright   Copyright 2024 RSP Systems A/S. All rights reserved.
+* \license     Mozilla Public License 2.0
+* \author      steffen
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <AllocationStats.h>
+#include <GlucoseServiceProfile.h>
+#include <Metrics.h>
+#include <SimulatedMeter.h>
+#include <TrustedDevice.h>
+#include <UUID.h>
+
+using namespace rsp;
+using namespace std::chrono_literals;
+
+namespace {
+
+/**
+ * \brief Record Access Control Point round trips through the Glucose Service profile.
+ */
+class GlucoseRacpTest : public ::testing::Test
+{
+protected:
+    std::shared_ptr<SimulatedMeter> mMeter{};
+    std::unique_ptr<TrustedDevice> mDevice{};
+    std::unique_ptr<GlucoseServiceProfile> mGls{};
+    std::uint64_t mRacpErrors = 0;
+
+    void connect(const std::string &arOptions)
+    {
+        mMeter = std::make_shared<SimulatedMeter>(SimulatedMeter::Config(arOptions));
+        mDevice = std::make_unique<TrustedDevice>(mMeter);
+        mGls = std::make_unique<GlucoseServiceProfile>(*mDevice);
+        mRacpErrors = Metrics::Get().GetCount("racp_errors");
+    }
+
+    void TearDown() override
+    {
+        // The profile unsubscribes on destruction, so it must go before the connection.
+        mGls.reset();
+        mDevice.reset();
+    }
+
+    [[nodiscard]] std::uint64_t racpErrors() const
+    {
+        return Metrics::Get().GetCount("racp_errors") - mRacpErrors;
+    }
+};
+
+TEST_F(GlucoseRacpTest, ReportsAllRecordsWithContexts)
+{
+    connect("records:50,context:5");
+    EXPECT_EQ(mGls->GetMeasurementsCount(), 50u);
+
+    auto &records = mGls->ReadAllMeasurements();
+    ASSERT_EQ(records.size(), 50u);
+    for (std::size_t i = 0; i < records.size(); i++) {
+        EXPECT_EQ(records[i].mSequenceNo, i + 1);
+        bool has_context = (records[i].mSequenceNo % 5) == 0;
+        EXPECT_EQ(bool(records[i].mFlags & GlucoseServiceProfile::GlucoseMeasurement::ContextInformationFollows), has_context);
+        EXPECT_EQ(records[i].mContext.mFlags != 0, has_context);
+    }
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, ReportsRecordsFromSequenceNumber)
+{
+    connect("records:50");
+    auto &records = mGls->ReadMeasurementsFrom(41);
+    ASSERT_EQ(records.size(), 10u);
+    EXPECT_EQ(records.front().mSequenceNo, 41);
+    EXPECT_EQ(records.back().mSequenceNo, 50);
+
+    auto &last = mGls->ReadLastMeasurement();
+    ASSERT_EQ(last.size(), 1u);
+    EXPECT_EQ(last.front().mSequenceNo, 50);
+
+    EXPECT_TRUE(mGls->ReadMeasurementsFrom(51).empty());
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, EmptyMeterCompletesWithoutRecords)
+{
+    connect("records:0");
+    EXPECT_EQ(mGls->GetMeasurementsCount(), 0u);
+    EXPECT_TRUE(mGls->ReadAllMeasurements().empty());
+    EXPECT_TRUE(mGls->ReadLastMeasurement().empty());
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, ClearDeletesAllRecords)
+{
+    connect("records:20");
+    mGls->ClearAllMeasurements();
+    EXPECT_EQ(mGls->GetMeasurementsCount(), 0u);
+    EXPECT_TRUE(mGls->ReadAllMeasurements().empty());
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, RecordSinkReceivesCompleteRecordsInOrder)
+{
+    connect("records:50,context:5");
+    std::vector<GlucoseServiceProfile::GlucoseMeasurement> received;
+    mGls->SetRecordSink(3, [&](std::span<const GlucoseServiceProfile::GlucoseMeasurement> aRecords) {
+        EXPECT_LE(aRecords.size(), 3u);
+        received.insert(received.end(), aRecords.begin(), aRecords.end());
+    });
+
+    EXPECT_TRUE(mGls->ReadAllMeasurements().empty());
+    ASSERT_EQ(received.size(), 50u);
+    for (std::size_t i = 0; i < received.size(); i++) {
+        EXPECT_EQ(received[i].mSequenceNo, i + 1);
+        EXPECT_EQ(received[i].mContext.mFlags != 0, (received[i].mSequenceNo % 5) == 0);
+    }
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, CallbackThreadAllocationsCountInTransferPhase)
+{
+    connect("records:20");
+    std::set<int> phases;
+    mGls->SetRecordSink(1, [&](std::span<const GlucoseServiceProfile::GlucoseMeasurement>) {
+        phases.insert(AllocationStats::GetCurrentPhase());
+    });
+    AllocationStats::Enable();
+    mGls->ReadAllMeasurements();
+    AllocationStats::Enable(false);
+
+    auto list = AllocationStats::GetPhases();
+    auto it = std::find_if(list.begin(), list.end(), [](const auto &arCounts) { return arCounts.mPhase == "racp_transfer"; });
+    ASSERT_NE(it, list.end());
+    EXPECT_EQ(phases, std::set<int>{int(it - list.begin())});
+}
+
+TEST_F(GlucoseRacpTest, SubscriberMaySubscribe)
+{
+    connect("records:10");
+    std::vector<std::uint16_t> first;
+    std::vector<std::uint16_t> second;
+    mGls->SetBatchSize(2);
+    mGls->Subscribe([&](const GlucoseServiceProfile::GlucoseMeasurement &arRecord, const GlucoseServiceProfile::RecordBatch&) {
+        if (first.empty()) {
+            mGls->Subscribe([&](const GlucoseServiceProfile::GlucoseMeasurement &arRecord, const GlucoseServiceProfile::RecordBatch&) {
+                second.push_back(arRecord.mSequenceNo);
+            });
+        }
+        first.push_back(arRecord.mSequenceNo);
+    });
+
+    mGls->ReadAllMeasurements();
+    EXPECT_EQ(first.size(), 10u);
+    // From the batch after the one it was added in
+    ASSERT_EQ(second.size(), 8u);
+    EXPECT_EQ(second.front(), 3);
+}
+
+TEST_F(GlucoseRacpTest, LossLeavesGapsInSequenceNumbers)
+{
+    connect("records:200,loss:0.25,seed:3");
+    auto &records = mGls->ReadAllMeasurements();
+    EXPECT_GT(records.size(), 100u);
+    EXPECT_LT(records.size(), 200u);
+    for (std::size_t i = 1; i < records.size(); i++) {
+        EXPECT_LT(records[i - 1].mSequenceNo, records[i].mSequenceNo);
+    }
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+TEST_F(GlucoseRacpTest, ReorderSwapsRecordsWithoutLosingAny)
+{
+    connect("records:100,reorder:0.2,seed:3");
+    auto &records = mGls->ReadAllMeasurements();
+    ASSERT_EQ(records.size(), 100u);
+    std::set<std::uint16_t> seq_nos;
+    std::size_t out_of_order = 0;
+    for (std::size_t i = 0; i < records.size(); i++) {
+        seq_nos.insert(records[i].mSequenceNo);
+        if ((i > 0) && (records[i - 1].mSequenceNo > records[i].mSequenceNo)) {
+            out_of_order++;
+        }
+    }
+    EXPECT_EQ(seq_nos.size(), 100u);
+    EXPECT_EQ(*seq_nos.begin(), 1);
+    EXPECT_EQ(*seq_nos.rbegin(), 100);
+    EXPECT_GT(out_of_order, 0u);
+    EXPECT_EQ(racpErrors(), 0u);
+}
+
+/**
+ * \brief Records notified until the simulated disconnect, on a meter used directly.
+ */
+std::size_t reportUntilDisconnect(SimulatedMeter &arMeter)
+{
+    const auto service = uuid::ToFullString(uuid::Identifiers::GlucoseService);
+    const auto measurement = uuid::ToFullString(uuid::Identifiers::GlucoseMeasurement);
+    const auto racp = uuid::ToFullString(uuid::Identifiers::RecordAccessControlPoint);
+
+    std::atomic_size_t received = 0;
+    arMeter.Connect();
+    arMeter.Notify(service, measurement, [&](const GattPeripheral::ByteArray &) { received++; });
+    arMeter.WriteRequest(service, racp, std::string("\x01\x01", 2));   // Report all records
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (arMeter.IsConnected() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_FALSE(arMeter.IsConnected());
+    arMeter.Disconnect();
+    arMeter.Unsubscribe(service, measurement);
+    return received;
+}
+
+TEST(SimulatedMeterLink, DisconnectsAfterNotificationsOnEveryConnection)
+{
+    SimulatedMeter meter(SimulatedMeter::Config("records:100,disconnect:10"));
+    EXPECT_EQ(reportUntilDisconnect(meter), 10u);
+    // Counted from the new connection, not disconnected right away
+    EXPECT_EQ(reportUntilDisconnect(meter), 10u);
+}
+
+/**
+ * \brief Abort of a running transfer, written directly to the RACP of the simulated meter.
+ */
+TEST(SimulatedMeterRacp, AbortStopsReport)
+{
+    const auto service = uuid::ToFullString(uuid::Identifiers::GlucoseService);
+    const auto measurement = uuid::ToFullString(uuid::Identifiers::GlucoseMeasurement);
+    const auto racp = uuid::ToFullString(uuid::Identifiers::RecordAccessControlPoint);
+
+    SimulatedMeter meter(SimulatedMeter::Config("records:500,rate:1000"));
+    meter.Connect();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t received = 0;
+    std::vector<GattPeripheral::ByteArray> responses;
+    meter.Notify(service, measurement, [&](const GattPeripheral::ByteArray &) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received++;
+        changed.notify_all();
+    });
+    meter.Notify(service, racp, [&](const GattPeripheral::ByteArray &arValue) {
+        std::lock_guard<std::mutex> lock(mutex);
+        responses.push_back(arValue);
+        changed.notify_all();
+    });
+
+    meter.WriteRequest(service, racp, std::string("\x01\x01", 2));   // Report all records
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(changed.wait_for(lock, 5s, [&]() { return received >= 10; }));
+    }
+    meter.WriteRequest(service, racp, std::string("\x03\x00", 2));   // Abort
+    std::size_t at_abort;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(changed.wait_for(lock, 5s, [&]() { return !responses.empty(); }));
+        at_abort = received;
+        // Only the abort is answered, the aborted report is not
+        ASSERT_EQ(responses.size(), 1u);
+        EXPECT_EQ(responses.front(), std::string("\x06\x00\x03\x01", 4));
+    }
+    std::this_thread::sleep_for(50ms);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(received, at_abort);
+        EXPECT_LT(received, 500u);
+    }
+    meter.Disconnect();
+}
+
+} // namespace